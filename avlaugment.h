@@ -0,0 +1,167 @@
+/*********************************************************************
+ *
+ * avlaugment.h - augmented avl tree, like linux's rbtree_augmented
+ *
+ * NOTE:
+ * the rebalancing core of avlmini (avlcore.h) is instantiated here for
+ * avl_node, with hooks to maintain per-subtree values (sum, max, ...).
+ * avlmini.c passes a NULL augment and all hooks are compiled out,
+ * AVL_AUGMENT_DEFINE instantiates a variant with inlined hooks:
+ *
+ * struct mynode {
+ *     struct avl_node node;
+ *     int key, value, maxval;    // maxval: max value in subtree
+ * };
+ *
+ * static int mynode_compute(struct mynode *n) {
+ *     int m = n->value;
+ *     if (n->node.left) { ... m = max(m, left->maxval) ... }
+ *     if (n->node.right) { ... m = max(m, right->maxval) ... }
+ *     return m;
+ * }
+ *
+ * AVL_AUGMENT_DEFINE(static, mytree, struct mynode, node, maxval,
+ *         mynode_compute)
+ *
+ * then use mytree_post_insert / mytree_erase / mytree_replace instead
+ * of avl_node_post_insert / avl_node_erase / avl_node_replace.
+ *
+ *********************************************************************/
+#ifndef _AVLAUGMENT_H__
+#define _AVLAUGMENT_H__
+
+#include "avlmini.h"
+
+
+/*====================================================================*/
+/* augment callbacks                                                  */
+/*====================================================================*/
+struct avl_augment
+{
+	/* recompute values from node up to stop (exclusive) */
+	void (*propagate)(struct avl_node *node, struct avl_node *stop);
+	/* newnode takes the place of oldnode */
+	void (*copy)(struct avl_node *oldnode, struct avl_node *newnode);
+	/* newnode has been rotated up over oldnode */
+	void (*rotate)(struct avl_node *oldnode, struct avl_node *newnode);
+};
+
+
+/*====================================================================*/
+/* rebalancing core                                                   */
+/*====================================================================*/
+#define AVL_T_NAME(x)               _avl_node##x
+#define AVL_T_HANDLE                struct avl_node *
+#define AVL_T_ROOT                  struct avl_root
+#define AVL_T_CTX                   const struct avl_augment *
+#define AVL_T_NIL                   NULL
+#define AVL_T_LEFT(r, n)            ((n)->left)
+#define AVL_T_RIGHT(r, n)           ((n)->right)
+#define AVL_T_PARENT(r, n)          AVL_PARENT(n)
+#define AVL_T_SET_PARENT(r, n, p)   AVL_SET_PARENT(n, p)
+#define AVL_T_HEIGHT(r, n)          AVL_HEIGHT(n)
+#define AVL_T_SET_HEIGHT(r, n, h)   AVL_SET_HEIGHT(n, h)
+#define AVL_T_ROOTNODE(r)           ((r)->node)
+#define AVL_T_ROTATE(c, o, n)       do { if (c) (c)->rotate(o, n); } while (0)
+#define AVL_T_COPY(c, o, n)         do { if (c) (c)->copy(o, n); } while (0)
+#define AVL_T_PROPAGATE(c, n)       do { if (c) (c)->propagate(n, NULL); } while (0)
+
+#ifdef AVL_THREADED
+#define AVL_T_UNLINK(r, n) do { \
+		if ((n)->prev) (n)->prev->next = (n)->next; \
+		if ((n)->next) (n)->next->prev = (n)->prev; \
+	}	while (0)
+#define AVL_T_SUBST(r, o, n) do { \
+		(n)->prev = (o)->prev; \
+		(n)->next = (o)->next; \
+		if ((o)->prev) (o)->prev->next = (n); \
+		if ((o)->next) (o)->next->prev = (n); \
+	}	while (0)
+#else
+#define AVL_T_UNLINK(r, n)          ((void)0)
+#define AVL_T_SUBST(r, o, n)        ((void)0)
+#endif
+
+#include "avlcore.h"
+
+static INLINE void
+avl_node_post_insert_augmented(struct avl_node *node, struct avl_root *root,
+		const struct avl_augment *augment)
+{
+	_avl_node_post_insert(node, root, augment);
+}
+
+static INLINE void
+avl_node_erase_augmented(struct avl_node *node, struct avl_root *root,
+		const struct avl_augment *augment)
+{
+	_avl_node_erase(node, root, augment);
+}
+
+static INLINE void
+avl_node_replace_augmented(struct avl_node *victim, struct avl_node *newnode,
+		struct avl_root *root, const struct avl_augment *augment)
+{
+	_avl_node_replace(victim, newnode, root, augment);
+}
+
+
+/*====================================================================*/
+/* augmented variant generator                                        */
+/*====================================================================*/
+
+/* with AVL_ORDER_STATISTIC the generated hooks keep node->count too */
+#ifdef AVL_ORDER_STATISTIC
+#define AVL_AUGMENT_COUNT(n) \
+	((n)->count = AVL_LEFT_COUNT(n) + AVL_RIGHT_COUNT(n) + 1)
+#define AVL_AUGMENT_COUNT_COPY(o, n) ((n)->count = (o)->count)
+#else
+#define AVL_AUGMENT_COUNT(n) ((void)0)
+#define AVL_AUGMENT_COUNT_COPY(o, n) ((void)0)
+#endif
+
+/* instantiate PREFIX_post_insert, PREFIX_erase and PREFIX_replace for
+ * TYPE embedding avl_node as MEMBER, whose augmented value FIELD is
+ * COMPUTE(TYPE *data) from the data itself and FIELD of its children. */
+#define AVL_AUGMENT_DEFINE(STATIC, PREFIX, TYPE, MEMBER, FIELD, COMPUTE) \
+static void PREFIX##_propagate(struct avl_node *node, \
+		struct avl_node *stop) { \
+	for (; node != stop; node = AVL_PARENT(node)) { \
+		TYPE *__d = AVL_ENTRY(node, TYPE, MEMBER); \
+		AVL_AUGMENT_COUNT(node); \
+		__d->FIELD = COMPUTE(__d); \
+	} \
+} \
+static void PREFIX##_copy(struct avl_node *oldnode, \
+		struct avl_node *newnode) { \
+	AVL_AUGMENT_COUNT_COPY(oldnode, newnode); \
+	AVL_ENTRY(newnode, TYPE, MEMBER)->FIELD = \
+		AVL_ENTRY(oldnode, TYPE, MEMBER)->FIELD; \
+} \
+static void PREFIX##_rotate(struct avl_node *oldnode, \
+		struct avl_node *newnode) { \
+	TYPE *__o = AVL_ENTRY(oldnode, TYPE, MEMBER); \
+	AVL_AUGMENT_COUNT_COPY(oldnode, newnode); \
+	AVL_AUGMENT_COUNT(oldnode); \
+	AVL_ENTRY(newnode, TYPE, MEMBER)->FIELD = __o->FIELD; \
+	__o->FIELD = COMPUTE(__o); \
+} \
+static const struct avl_augment PREFIX##_augment = { \
+	PREFIX##_propagate, PREFIX##_copy, PREFIX##_rotate \
+}; \
+STATIC void PREFIX##_post_insert(struct avl_node *node, \
+		struct avl_root *root) { \
+	avl_node_post_insert_augmented(node, root, &PREFIX##_augment); \
+} \
+STATIC void PREFIX##_erase(struct avl_node *node, struct avl_root *root) { \
+	avl_node_erase_augmented(node, root, &PREFIX##_augment); \
+} \
+STATIC void PREFIX##_replace(struct avl_node *victim, \
+		struct avl_node *newnode, struct avl_root *root) { \
+	avl_node_replace_augmented(victim, newnode, root, &PREFIX##_augment); \
+}
+
+
+#endif
+
+
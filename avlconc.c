@@ -0,0 +1,776 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "avlconc.h"
+
+
+/*====================================================================*/
+/* node access                                                        */
+/*====================================================================*/
+#define AVL_CUNLINKED        1
+#define AVL_CSHRINKING       2
+#define AVL_CSHRINK_INCR     4
+
+/* results of _avl_cnode_condition other than a new height */
+#define AVL_CNOTHING        (-1)
+#define AVL_CREBALANCE      (-2)
+#define AVL_CUNLINK         (-3)
+
+/* unlinked nodes of a thread collected before trying to free them */
+#define AVL_CBATCH           64
+
+/* a test may define it to be preempted before stores, so races show
+ * on a single cpu too */
+#ifndef AVL_CYIELD
+#define AVL_CYIELD()         ((void)0)
+#endif
+
+#define AVL_CLOAD(x)         avl_atomic_load(&(x))
+#define AVL_CSTORE(x, v)     do { AVL_CYIELD(); \
+		avl_atomic_store(&(x), v); } while (0)
+#define AVL_CLOADP(x)        ((struct avl_cnode*)avl_atomic_load_ptr(&(x)))
+#define AVL_CSTOREP(x, v)    do { AVL_CYIELD(); \
+		avl_atomic_store_ptr(&(x), v); } while (0)
+
+#define AVL_CVERSION(n)      AVL_CLOAD((n)->version)
+#define AVL_CHEIGHT(n)       ((n)? AVL_CLOAD((n)->height) : 0)
+#define AVL_CCHILD(n, dir)   (((dir) < 0)? AVL_CLOADP((n)->left) : \
+		AVL_CLOADP((n)->right))
+#define AVL_CMAX(x, y)       (((x) > (y))? (x) : (y))
+
+#define avl_cnode_lock(n)    avl_spin_lock(&(n)->lock)
+#define avl_cnode_unlock(n)  avl_spin_unlock(&(n)->lock)
+
+/* returned by attempts that saw a change and must restart higher */
+static char _avl_cretry;
+#define AVL_CRETRY           ((void*)&_avl_cretry)
+
+/* state of one update */
+struct avl_cctx
+{
+	struct avl_ctree *tree;
+	struct avl_cthread *self;
+	const void *key;
+	void *value;                /* NULL for removing */
+	struct avl_cnode *node;     /* preallocated for adding */
+};
+
+/* spin a little on a rotation in progress, then wait for its lock */
+static void _avl_cnode_wait(struct avl_cnode *node)
+{
+	long version = AVL_CVERSION(node);
+	int i;
+	if ((version & AVL_CSHRINKING) == 0) return;
+	for (i = 0; i < 100; i++) {
+		if (AVL_CVERSION(node) != version) return;
+		avl_cpu_relax();
+	}
+	avl_cnode_lock(node);
+	avl_cnode_unlock(node);
+}
+
+
+/*====================================================================*/
+/* epoch based reclamation                                            */
+/*====================================================================*/
+static void _avl_ctree_retire(struct avl_cctx *ctx, struct avl_cnode *node)
+{
+	struct avl_cthread *self = ctx->self;
+	node->epoch = avl_atomic_inc(&ctx->tree->epoch) - 1;
+	node->retired = self->retired;
+	self->retired = node;
+	self->nretired++;
+}
+
+static void _avl_ctree_reclaim(struct avl_ctree *tree,
+		struct avl_cthread *self)
+{
+	struct avl_cnode **link = &self->retired;
+	long oldest = 0, count = avl_atomic_load(&tree->nthreads);
+	long i;
+	if (count > tree->maxthreads) count = tree->maxthreads;
+	avl_atomic_fence();
+	for (i = 0; i < count; i++) {
+		long epoch = avl_atomic_load(&tree->threads[i].epoch);
+		if (epoch != 0 && (oldest == 0 || epoch < oldest)) oldest = epoch;
+	}
+	while (link[0]) {
+		struct avl_cnode *node = link[0];
+		if (oldest == 0 || node->epoch < oldest) {
+			link[0] = node->retired;
+			self->nretired--;
+			free(node);
+		}	else {
+			link = &node->retired;
+		}
+	}
+}
+
+static inline void _avl_ctree_enter(struct avl_ctree *tree,
+		struct avl_cthread *self)
+{
+	avl_atomic_store(&self->epoch, avl_atomic_load(&tree->epoch));
+	avl_atomic_fence();
+}
+
+static inline void _avl_ctree_leave(struct avl_ctree *tree,
+		struct avl_cthread *self)
+{
+	avl_atomic_store(&self->epoch, 0);
+	if (self->nretired >= AVL_CBATCH) _avl_ctree_reclaim(tree, self);
+}
+
+
+/*====================================================================*/
+/* relaxed balance, called with the locks noted by _nl                */
+/*====================================================================*/
+
+/* new height if only the height is wrong */
+static long _avl_cnode_condition(struct avl_cnode *node)
+{
+	struct avl_cnode *left = AVL_CLOADP(node->left);
+	struct avl_cnode *right = AVL_CLOADP(node->right);
+	long h0, h1, height;
+	if ((left == NULL || right == NULL) && AVL_CLOADP(node->value) == NULL)
+		return AVL_CUNLINK;
+	h0 = AVL_CHEIGHT(left);
+	h1 = AVL_CHEIGHT(right);
+	if (h0 - h1 < -1 || h0 - h1 > 1) return AVL_CREBALANCE;
+	height = 1 + AVL_CMAX(h0, h1);
+	return (AVL_CLOAD(node->height) != height)? height : AVL_CNOTHING;
+}
+
+/* node locked: returns the next node to fix, or NULL */
+static struct avl_cnode *_avl_cnode_fix_height_nl(struct avl_cnode *node)
+{
+	long c = _avl_cnode_condition(node);
+	if (c == AVL_CREBALANCE || c == AVL_CUNLINK) return node;
+	if (c == AVL_CNOTHING) return NULL;
+	AVL_CSTORE(node->height, c);
+	return AVL_CLOADP(node->parent);
+}
+
+/* parent and node locked, node has at most one child */
+static int _avl_cnode_unlink_nl(struct avl_cnode *parent,
+		struct avl_cnode *node)
+{
+	struct avl_cnode *pl = AVL_CLOADP(parent->left);
+	struct avl_cnode *pr = AVL_CLOADP(parent->right);
+	struct avl_cnode *left, *right, *splice;
+	if (pl != node && pr != node) return 0;
+	left = AVL_CLOADP(node->left);
+	right = AVL_CLOADP(node->right);
+	if (left != NULL && right != NULL) return 0;
+	splice = (left != NULL)? left : right;
+	if (pl == node) AVL_CSTOREP(parent->left, splice);
+	else AVL_CSTOREP(parent->right, splice);
+	if (splice) AVL_CSTOREP(splice->parent, parent);
+	AVL_CSTORE(node->version, AVL_CUNLINKED);
+	AVL_CSTOREP(node->value, NULL);
+	return 1;
+}
+
+static inline void _avl_cnode_replace_child(struct avl_cnode *parent,
+		struct avl_cnode *old, struct avl_cnode *node)
+{
+	if (AVL_CLOADP(parent->left) == old) AVL_CSTOREP(parent->left, node);
+	else AVL_CSTOREP(parent->right, node);
+	AVL_CSTOREP(node->parent, parent);
+}
+
+/* parent, node and left locked */
+static struct avl_cnode *_avl_cnode_rotate_right_nl(struct avl_cnode *parent,
+		struct avl_cnode *node, struct avl_cnode *left, long hr, long hll,
+		struct avl_cnode *lr, long hlr)
+{
+	long version = AVL_CVERSION(node);
+	long hn, bal;
+	AVL_CSTORE(node->version, version | AVL_CSHRINKING);
+	AVL_CSTOREP(node->left, lr);
+	if (lr) AVL_CSTOREP(lr->parent, node);
+	AVL_CSTOREP(left->right, node);
+	AVL_CSTOREP(node->parent, left);
+	_avl_cnode_replace_child(parent, node, left);
+	hn = 1 + AVL_CMAX(hlr, hr);
+	AVL_CSTORE(node->height, hn);
+	AVL_CSTORE(left->height, 1 + AVL_CMAX(hll, hn));
+	AVL_CSTORE(node->version, version + AVL_CSHRINK_INCR);
+	bal = hlr - hr;
+	if (bal < -1 || bal > 1) return node;
+	if ((lr == NULL || hr == 0) && AVL_CLOADP(node->value) == NULL)
+		return node;
+	bal = hll - hn;
+	if (bal < -1 || bal > 1) return left;
+	if (hll == 0 && AVL_CLOADP(left->value) == NULL) return left;
+	return _avl_cnode_fix_height_nl(parent);
+}
+
+static struct avl_cnode *_avl_cnode_rotate_left_nl(struct avl_cnode *parent,
+		struct avl_cnode *node, long hl, struct avl_cnode *right,
+		struct avl_cnode *rl, long hrl, long hrr)
+{
+	long version = AVL_CVERSION(node);
+	long hn, bal;
+	AVL_CSTORE(node->version, version | AVL_CSHRINKING);
+	AVL_CSTOREP(node->right, rl);
+	if (rl) AVL_CSTOREP(rl->parent, node);
+	AVL_CSTOREP(right->left, node);
+	AVL_CSTOREP(node->parent, right);
+	_avl_cnode_replace_child(parent, node, right);
+	hn = 1 + AVL_CMAX(hl, hrl);
+	AVL_CSTORE(node->height, hn);
+	AVL_CSTORE(right->height, 1 + AVL_CMAX(hn, hrr));
+	AVL_CSTORE(node->version, version + AVL_CSHRINK_INCR);
+	bal = hrl - hl;
+	if (bal < -1 || bal > 1) return node;
+	if ((rl == NULL || hl == 0) && AVL_CLOADP(node->value) == NULL)
+		return node;
+	bal = hrr - hn;
+	if (bal < -1 || bal > 1) return right;
+	if (hrr == 0 && AVL_CLOADP(right->value) == NULL) return right;
+	return _avl_cnode_fix_height_nl(parent);
+}
+
+/* parent, node, left and lr locked */
+static struct avl_cnode *_avl_cnode_rotate_right_over_left_nl(
+		struct avl_cnode *parent, struct avl_cnode *node,
+		struct avl_cnode *left, long hr, long hll, struct avl_cnode *lr,
+		long hlrl)
+{
+	long version = AVL_CVERSION(node);
+	long lversion = AVL_CVERSION(left);
+	struct avl_cnode *lrl = AVL_CLOADP(lr->left);
+	struct avl_cnode *lrr = AVL_CLOADP(lr->right);
+	long hlrr = AVL_CHEIGHT(lrr);
+	long hn, hl, bal;
+	AVL_CSTORE(node->version, version | AVL_CSHRINKING);
+	AVL_CSTORE(left->version, lversion | AVL_CSHRINKING);
+	AVL_CSTOREP(node->left, lrr);
+	if (lrr) AVL_CSTOREP(lrr->parent, node);
+	AVL_CSTOREP(left->right, lrl);
+	if (lrl) AVL_CSTOREP(lrl->parent, left);
+	AVL_CSTOREP(lr->left, left);
+	AVL_CSTOREP(left->parent, lr);
+	AVL_CSTOREP(lr->right, node);
+	AVL_CSTOREP(node->parent, lr);
+	_avl_cnode_replace_child(parent, node, lr);
+	hn = 1 + AVL_CMAX(hlrr, hr);
+	AVL_CSTORE(node->height, hn);
+	hl = 1 + AVL_CMAX(hll, hlrl);
+	AVL_CSTORE(left->height, hl);
+	AVL_CSTORE(lr->height, 1 + AVL_CMAX(hl, hn));
+	AVL_CSTORE(node->version, version + AVL_CSHRINK_INCR);
+	AVL_CSTORE(left->version, lversion + AVL_CSHRINK_INCR);
+	bal = hlrr - hr;
+	if (bal < -1 || bal > 1) return node;
+	if ((lrr == NULL || hr == 0) && AVL_CLOADP(node->value) == NULL)
+		return node;
+	if ((lrl == NULL || hll == 0) && AVL_CLOADP(left->value) == NULL)
+		return left;
+	bal = hl - hn;
+	if (bal < -1 || bal > 1) return lr;
+	return _avl_cnode_fix_height_nl(parent);
+}
+
+static struct avl_cnode *_avl_cnode_rotate_left_over_right_nl(
+		struct avl_cnode *parent, struct avl_cnode *node, long hl,
+		struct avl_cnode *right, struct avl_cnode *rl, long hrr, long hrlr)
+{
+	long version = AVL_CVERSION(node);
+	long rversion = AVL_CVERSION(right);
+	struct avl_cnode *rll = AVL_CLOADP(rl->left);
+	struct avl_cnode *rlr = AVL_CLOADP(rl->right);
+	long hrll = AVL_CHEIGHT(rll);
+	long hn, hr, bal;
+	AVL_CSTORE(node->version, version | AVL_CSHRINKING);
+	AVL_CSTORE(right->version, rversion | AVL_CSHRINKING);
+	AVL_CSTOREP(node->right, rll);
+	if (rll) AVL_CSTOREP(rll->parent, node);
+	AVL_CSTOREP(right->left, rlr);
+	if (rlr) AVL_CSTOREP(rlr->parent, right);
+	AVL_CSTOREP(rl->right, right);
+	AVL_CSTOREP(right->parent, rl);
+	AVL_CSTOREP(rl->left, node);
+	AVL_CSTOREP(node->parent, rl);
+	_avl_cnode_replace_child(parent, node, rl);
+	hn = 1 + AVL_CMAX(hl, hrll);
+	AVL_CSTORE(node->height, hn);
+	hr = 1 + AVL_CMAX(hrlr, hrr);
+	AVL_CSTORE(right->height, hr);
+	AVL_CSTORE(rl->height, 1 + AVL_CMAX(hn, hr));
+	AVL_CSTORE(node->version, version + AVL_CSHRINK_INCR);
+	AVL_CSTORE(right->version, rversion + AVL_CSHRINK_INCR);
+	bal = hrll - hl;
+	if (bal < -1 || bal > 1) return node;
+	if ((rll == NULL || hl == 0) && AVL_CLOADP(node->value) == NULL)
+		return node;
+	if ((rlr == NULL || hrr == 0) && AVL_CLOADP(right->value) == NULL)
+		return right;
+	bal = hr - hn;
+	if (bal < -1 || bal > 1) return rl;
+	return _avl_cnode_fix_height_nl(parent);
+}
+
+static struct avl_cnode *_avl_cnode_rebalance_to_left_nl(
+		struct avl_cnode *parent, struct avl_cnode *node,
+		struct avl_cnode *right, long hl0);
+
+/* parent and node locked, left subtree too high */
+static struct avl_cnode *_avl_cnode_rebalance_to_right_nl(
+		struct avl_cnode *parent, struct avl_cnode *node,
+		struct avl_cnode *left, long hr0)
+{
+	struct avl_cnode *lr, *result;
+	long hll0, hlr0, hlr, hlrl, bal;
+	avl_cnode_lock(left);
+	if (AVL_CLOAD(left->height) - hr0 <= 1) {
+		avl_cnode_unlock(left);
+		return node;
+	}
+	lr = AVL_CLOADP(left->right);
+	hll0 = AVL_CHEIGHT(AVL_CLOADP(left->left));
+	hlr0 = AVL_CHEIGHT(lr);
+	if (hll0 >= hlr0) {
+		result = _avl_cnode_rotate_right_nl(parent, node, left, hr0, hll0,
+				lr, hlr0);
+		avl_cnode_unlock(left);
+		return result;
+	}
+	avl_cnode_lock(lr);
+	hlr = AVL_CLOAD(lr->height);
+	if (hll0 >= hlr) {
+		result = _avl_cnode_rotate_right_nl(parent, node, left, hr0, hll0,
+				lr, hlr);
+		avl_cnode_unlock(lr);
+		avl_cnode_unlock(left);
+		return result;
+	}
+	hlrl = AVL_CHEIGHT(AVL_CLOADP(lr->left));
+	bal = hll0 - hlrl;
+	if (bal >= -1 && bal <= 1) {
+		result = _avl_cnode_rotate_right_over_left_nl(parent, node, left,
+				hr0, hll0, lr, hlrl);
+		avl_cnode_unlock(lr);
+		avl_cnode_unlock(left);
+		return result;
+	}
+	avl_cnode_unlock(lr);
+	/* the left child itself needs a rotation first */
+	result = _avl_cnode_rebalance_to_left_nl(node, left, lr, hll0);
+	avl_cnode_unlock(left);
+	return result;
+}
+
+/* parent and node locked, right subtree too high */
+static struct avl_cnode *_avl_cnode_rebalance_to_left_nl(
+		struct avl_cnode *parent, struct avl_cnode *node,
+		struct avl_cnode *right, long hl0)
+{
+	struct avl_cnode *rl, *result;
+	long hrr0, hrl0, hrl, hrlr, bal;
+	avl_cnode_lock(right);
+	if (AVL_CLOAD(right->height) - hl0 <= 1) {
+		avl_cnode_unlock(right);
+		return node;
+	}
+	rl = AVL_CLOADP(right->left);
+	hrl0 = AVL_CHEIGHT(rl);
+	hrr0 = AVL_CHEIGHT(AVL_CLOADP(right->right));
+	if (hrr0 >= hrl0) {
+		result = _avl_cnode_rotate_left_nl(parent, node, hl0, right,
+				rl, hrl0, hrr0);
+		avl_cnode_unlock(right);
+		return result;
+	}
+	avl_cnode_lock(rl);
+	hrl = AVL_CLOAD(rl->height);
+	if (hrr0 >= hrl) {
+		result = _avl_cnode_rotate_left_nl(parent, node, hl0, right,
+				rl, hrl, hrr0);
+		avl_cnode_unlock(rl);
+		avl_cnode_unlock(right);
+		return result;
+	}
+	hrlr = AVL_CHEIGHT(AVL_CLOADP(rl->right));
+	bal = hrr0 - hrlr;
+	if (bal >= -1 && bal <= 1) {
+		result = _avl_cnode_rotate_left_over_right_nl(parent, node, hl0,
+				right, rl, hrr0, hrlr);
+		avl_cnode_unlock(rl);
+		avl_cnode_unlock(right);
+		return result;
+	}
+	avl_cnode_unlock(rl);
+	result = _avl_cnode_rebalance_to_right_nl(node, right, rl, hrr0);
+	avl_cnode_unlock(right);
+	return result;
+}
+
+/* parent and node locked: returns the next node to fix, or NULL */
+static struct avl_cnode *_avl_cnode_rebalance_nl(struct avl_cctx *ctx,
+		struct avl_cnode *parent, struct avl_cnode *node)
+{
+	struct avl_cnode *left = AVL_CLOADP(node->left);
+	struct avl_cnode *right = AVL_CLOADP(node->right);
+	long h0, h1, height;
+	if ((left == NULL || right == NULL) && AVL_CLOADP(node->value) == NULL) {
+		if (_avl_cnode_unlink_nl(parent, node)) {
+			_avl_ctree_retire(ctx, node);
+			return _avl_cnode_fix_height_nl(parent);
+		}
+		return node;
+	}
+	h0 = AVL_CHEIGHT(left);
+	h1 = AVL_CHEIGHT(right);
+	if (h0 - h1 > 1)
+		return _avl_cnode_rebalance_to_right_nl(parent, node, left, h1);
+	if (h1 - h0 > 1)
+		return _avl_cnode_rebalance_to_left_nl(parent, node, right, h0);
+	height = 1 + AVL_CMAX(h0, h1);
+	if (AVL_CLOAD(node->height) != height) {
+		AVL_CSTORE(node->height, height);
+		return _avl_cnode_fix_height_nl(parent);
+	}
+	return NULL;
+}
+
+/* walk up from a damaged node until nothing is left to repair, or up
+ * from below, a node whose height changed. nodes are checked with the
+ * parent and the node locked, and links only change under the lock of
+ * the old parent, so whatever is above below is found again under its
+ * lock and sees the new height. a rotation that hands back a node
+ * under it has left its parent unchecked, the walk then goes on up
+ * through that parent whatever it meets on the way */
+static void _avl_cnode_fix(struct avl_cctx *ctx, struct avl_cnode *node,
+		struct avl_cnode *below)
+{
+	struct avl_cnode *target = NULL;
+	while (1) {
+		struct avl_cnode *parent, *next;
+		if (below != NULL) {
+			/* an unlinked node has no height anybody reads */
+			if (AVL_CVERSION(below) == AVL_CUNLINKED && target == NULL)
+				break;
+			node = AVL_CLOADP(below->parent);
+			if (AVL_CVERSION(below) == AVL_CUNLINKED) below = NULL;
+		}
+		if (node == NULL) break;
+		parent = AVL_CLOADP(node->parent);
+		if (parent == NULL) break;
+		if (AVL_CVERSION(node) == AVL_CUNLINKED) {
+			/* the thread unlinking it checks its parent */
+			if (below != NULL) continue;
+			if (target == NULL) break;
+			node = parent;
+			continue;
+		}
+		avl_cnode_lock(parent);
+		if (AVL_CVERSION(parent) == AVL_CUNLINKED ||
+				AVL_CLOADP(node->parent) != parent ||
+				AVL_CVERSION(node) == AVL_CUNLINKED) {
+			avl_cnode_unlock(parent);
+			continue;
+		}
+		avl_cnode_lock(node);
+		if (below != NULL && AVL_CLOADP(below->parent) != node) {
+			avl_cnode_unlock(node);
+			avl_cnode_unlock(parent);
+			continue;
+		}
+		if (node == target) target = NULL;
+		next = _avl_cnode_rebalance_nl(ctx, parent, node);
+		avl_cnode_unlock(node);
+		below = NULL;
+		if (next == NULL) {
+			if (target != NULL) next = parent;
+		}
+		else if (next == AVL_CLOADP(parent->parent)) {
+			below = parent;
+		}
+		else if (next != parent && target == NULL) {
+			target = parent;
+		}
+		avl_cnode_unlock(parent);
+		node = next;
+	}
+}
+
+
+/*====================================================================*/
+/* search and update                                                  */
+/*====================================================================*/
+
+/* search below the child at dir of node, valid while node is version */
+static void *_avl_cnode_get(struct avl_ctree *tree, const void *key,
+		struct avl_cnode *node, int dir, long version)
+{
+	while (1) {
+		struct avl_cnode *child = AVL_CCHILD(node, dir);
+		long cversion;
+		int hr;
+		if (AVL_CVERSION(node) != version) return AVL_CRETRY;
+		if (child == NULL) return NULL;
+		hr = tree->compare(key, AVL_CNODE_KEY(child));
+		if (hr == 0) return AVL_CLOADP(child->value);
+		cversion = AVL_CVERSION(child);
+		if (cversion & AVL_CSHRINKING) {
+			_avl_cnode_wait(child);
+		}
+		else if (cversion != AVL_CUNLINKED && child == AVL_CCHILD(node, dir)) {
+			void *result;
+			if (AVL_CVERSION(node) != version) return AVL_CRETRY;
+			result = _avl_cnode_get(tree, key, child, hr, cversion);
+			if (result != AVL_CRETRY) return result;
+		}
+	}
+}
+
+/* key matches node */
+static void *_avl_cnode_update_node(struct avl_cctx *ctx,
+		struct avl_cnode *parent, struct avl_cnode *node)
+{
+	void *prev;
+	if (ctx->value == NULL) {
+		if (AVL_CLOADP(node->value) == NULL) return NULL;
+		if (AVL_CLOADP(node->left) == NULL || AVL_CLOADP(node->right) == NULL) {
+			struct avl_cnode *damaged;
+			avl_cnode_lock(parent);
+			if (AVL_CVERSION(parent) == AVL_CUNLINKED ||
+					AVL_CLOADP(node->parent) != parent) {
+				avl_cnode_unlock(parent);
+				return AVL_CRETRY;
+			}
+			avl_cnode_lock(node);
+			prev = AVL_CLOADP(node->value);
+			if (prev == NULL || !_avl_cnode_unlink_nl(parent, node)) {
+				avl_cnode_unlock(node);
+				avl_cnode_unlock(parent);
+				return (prev == NULL)? NULL : AVL_CRETRY;
+			}
+			avl_cnode_unlock(node);
+			_avl_ctree_retire(ctx, node);
+			damaged = _avl_cnode_fix_height_nl(parent);
+			avl_cnode_unlock(parent);
+			if (damaged != NULL && damaged != parent) {
+				_avl_cnode_fix(ctx, NULL, parent);
+			}
+			else {
+				_avl_cnode_fix(ctx, damaged, NULL);
+			}
+			return prev;
+		}
+	}
+	avl_cnode_lock(node);
+	if (AVL_CVERSION(node) == AVL_CUNLINKED) {
+		avl_cnode_unlock(node);
+		return AVL_CRETRY;
+	}
+	prev = AVL_CLOADP(node->value);
+	if (ctx->value == NULL) {
+		/* lost a child meanwhile, it has to be unlinked instead */
+		if (prev != NULL && (AVL_CLOADP(node->left) == NULL ||
+					AVL_CLOADP(node->right) == NULL)) {
+			avl_cnode_unlock(node);
+			return AVL_CRETRY;
+		}
+		/* keep it as a routing node */
+		AVL_CSTOREP(node->value, NULL);
+	}
+	else if (prev == NULL) {
+		AVL_CSTOREP(node->value, ctx->value);
+	}
+	avl_cnode_unlock(node);
+	return prev;
+}
+
+static void *_avl_cnode_update(struct avl_cctx *ctx,
+		struct avl_cnode *parent, struct avl_cnode *node, long version)
+{
+	int hr = ctx->tree->compare(ctx->key, AVL_CNODE_KEY(node));
+	if (hr == 0) return _avl_cnode_update_node(ctx, parent, node);
+	while (1) {
+		struct avl_cnode *child = AVL_CCHILD(node, hr);
+		long cversion;
+		if (AVL_CVERSION(node) != version) return AVL_CRETRY;
+		if (child == NULL) {
+			struct avl_cnode *newnode = ctx->node, *damaged;
+			if (ctx->value == NULL) return NULL;
+			avl_cnode_lock(node);
+			if (AVL_CVERSION(node) != version) {
+				avl_cnode_unlock(node);
+				return AVL_CRETRY;
+			}
+			if (AVL_CCHILD(node, hr) != NULL) {
+				avl_cnode_unlock(node);
+				continue;
+			}
+			newnode->parent = node;
+			if (hr < 0) AVL_CSTOREP(node->left, newnode);
+			else AVL_CSTOREP(node->right, newnode);
+			ctx->node = NULL;
+			damaged = _avl_cnode_fix_height_nl(node);
+			avl_cnode_unlock(node);
+			if (damaged != NULL && damaged != node) {
+				_avl_cnode_fix(ctx, NULL, node);
+			}
+			else {
+				_avl_cnode_fix(ctx, damaged, NULL);
+			}
+			return NULL;
+		}
+		cversion = AVL_CVERSION(child);
+		if (cversion & AVL_CSHRINKING) {
+			_avl_cnode_wait(child);
+		}
+		else if (cversion != AVL_CUNLINKED && child == AVL_CCHILD(node, hr)) {
+			void *result;
+			if (AVL_CVERSION(node) != version) return AVL_CRETRY;
+			result = _avl_cnode_update(ctx, node, child, cversion);
+			if (result != AVL_CRETRY) return result;
+		}
+	}
+}
+
+/* update starting at the root, the holder never changes version */
+static void *_avl_ctree_update(struct avl_cctx *ctx)
+{
+	struct avl_cnode *holder = &ctx->tree->holder;
+	while (1) {
+		struct avl_cnode *root = AVL_CLOADP(holder->right);
+		long version;
+		if (root == NULL) {
+			if (ctx->value == NULL) return NULL;
+			avl_cnode_lock(holder);
+			if (holder->right == NULL) {
+				ctx->node->parent = holder;
+				AVL_CSTOREP(holder->right, ctx->node);
+				AVL_CSTORE(holder->height, 2);
+				ctx->node = NULL;
+				avl_cnode_unlock(holder);
+				return NULL;
+			}
+			avl_cnode_unlock(holder);
+			continue;
+		}
+		version = AVL_CVERSION(root);
+		if (version & AVL_CSHRINKING) {
+			_avl_cnode_wait(root);
+		}
+		else if (root == AVL_CLOADP(holder->right)) {
+			void *result = _avl_cnode_update(ctx, holder, root, version);
+			if (result != AVL_CRETRY) return result;
+		}
+	}
+}
+
+
+/*====================================================================*/
+/* tree interface                                                     */
+/*====================================================================*/
+
+int avl_ctree_init(struct avl_ctree *tree,
+		int (*compare)(const void*, const void*), size_t key_size,
+		int maxthreads)
+{
+	size_t bytes = sizeof(struct avl_cthread) * (size_t)maxthreads;
+	char *buffer = (char*)malloc(bytes + 64);
+	if (buffer == NULL) return -1;
+	memset(buffer, 0, bytes + 64);
+	memset(&tree->holder, 0, sizeof(tree->holder));
+	tree->key_size = key_size;
+	tree->epoch = 1;
+	tree->nthreads = 0;
+	tree->maxthreads = maxthreads;
+	tree->buffer = buffer;
+	tree->threads = (struct avl_cthread*)(((size_t)buffer + 63) &
+			~((size_t)63));
+	tree->compare = compare;
+	return 0;
+}
+
+static void _avl_cnode_free(struct avl_cnode *node)
+{
+	while (node) {
+		struct avl_cnode *right = node->right;
+		_avl_cnode_free(node->left);
+		free(node);
+		node = right;
+	}
+}
+
+void avl_ctree_destroy(struct avl_ctree *tree)
+{
+	int i;
+	_avl_cnode_free(tree->holder.right);
+	tree->holder.right = NULL;
+	for (i = 0; i < tree->maxthreads; i++) {
+		struct avl_cthread *self = &tree->threads[i];
+		while (self->retired) {
+			struct avl_cnode *node = self->retired;
+			self->retired = node->retired;
+			free(node);
+		}
+	}
+	free(tree->buffer);
+	tree->buffer = NULL;
+	tree->threads = NULL;
+}
+
+int avl_ctree_thread(struct avl_ctree *tree)
+{
+	long id = avl_atomic_inc(&tree->nthreads) - 1;
+	return (id < tree->maxthreads)? (int)id : -1;
+}
+
+void *avl_ctree_find(struct avl_ctree *tree, int tid, const void *key)
+{
+	struct avl_cthread *self = &tree->threads[tid];
+	void *value;
+	_avl_ctree_enter(tree, self);
+	value = _avl_cnode_get(tree, key, &tree->holder, 1, 0);
+	_avl_ctree_leave(tree, self);
+	return value;
+}
+
+int avl_ctree_add(struct avl_ctree *tree, int tid, const void *key,
+		void *value)
+{
+	struct avl_cctx ctx;
+	struct avl_cnode *node;
+	void *prev;
+	node = (struct avl_cnode*)malloc(sizeof(struct avl_cnode) +
+			tree->key_size);
+	if (node == NULL) return -1;
+	memset(node, 0, sizeof(struct avl_cnode));
+	memcpy(AVL_CNODE_KEY(node), key, tree->key_size);
+	node->value = value;
+	node->height = 1;
+	ctx.tree = tree;
+	ctx.self = &tree->threads[tid];
+	ctx.key = key;
+	ctx.value = value;
+	ctx.node = node;
+	_avl_ctree_enter(tree, ctx.self);
+	prev = _avl_ctree_update(&ctx);
+	_avl_ctree_leave(tree, ctx.self);
+	/* never published when the key is found */
+	if (ctx.node) free(ctx.node);
+	return (prev == NULL)? 0 : 1;
+}
+
+void *avl_ctree_remove(struct avl_ctree *tree, int tid, const void *key)
+{
+	struct avl_cctx ctx;
+	void *prev;
+	ctx.tree = tree;
+	ctx.self = &tree->threads[tid];
+	ctx.key = key;
+	ctx.value = NULL;
+	ctx.node = NULL;
+	_avl_ctree_enter(tree, ctx.self);
+	prev = _avl_ctree_update(&ctx);
+	_avl_ctree_leave(tree, ctx.self);
+	return prev;
+}
+
+
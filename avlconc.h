@@ -0,0 +1,98 @@
+/*********************************************************************
+ *
+ * avlconc.h - concurrent avl tree with optimistic version validation
+ *
+ * NOTE:
+ * after Bronson, Casper, Chafi and Olukotun, "A Practical Concurrent
+ * Binary Search Tree". searches take no lock and validate a version
+ * word of each node hand over hand, retrying below the last node that
+ * did not change. writers lock a parent and a child at most, removing
+ * a node with two children only clears its value and leaves a routing
+ * node, and balance is restored by relaxed fix-ups after each update.
+ * routing nodes outlive the user data, so nodes are allocated by the
+ * tree with a copy of the key and point to the user value. unlinked
+ * nodes are freed once no thread inside an operation can reach them.
+ *
+ *********************************************************************/
+#ifndef _AVLCONC_H__
+#define _AVLCONC_H__
+
+#include "avlsync.h"
+
+
+/*====================================================================*/
+/* concurrent tree                                                    */
+/*====================================================================*/
+struct avl_cnode
+{
+	struct avl_cnode *left;
+	struct avl_cnode *right;
+	struct avl_cnode *parent;
+	void *value;                /* NULL for a routing node */
+	long version;               /* unlinked, shrinking and shrink count */
+	long height;
+	long lock;                  /* spin lock */
+	long epoch;                 /* epoch when unlinked */
+	struct avl_cnode *retired;  /* next unlinked node of a thread */
+};
+
+/* key of key_size bytes stored right after the node */
+#define AVL_CNODE_KEY(node) ((void*)((node) + 1))
+
+/* per thread state, one cache line each */
+struct avl_cthread
+{
+	long epoch;                 /* epoch when entered, 0 for outside */
+	size_t nretired;
+	struct avl_cnode *retired;  /* unlinked nodes to free */
+	char padding[64 - sizeof(long) - sizeof(size_t) - sizeof(void*)];
+};
+
+struct avl_ctree
+{
+	struct avl_cnode holder;    /* the root is the right child of holder */
+	size_t key_size;
+	long epoch;
+	long nthreads;              /* registered threads */
+	int maxthreads;
+	struct avl_cthread *threads;
+	void *buffer;               /* memory block of threads */
+	/* compare two keys: returns 0 for equal, < 0 or > 0 */
+	int (*compare)(const void *k1, const void *k2);
+};
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* returns zero for success, -1 for out of memory */
+int avl_ctree_init(struct avl_ctree *tree,
+		int (*compare)(const void*, const void*), size_t key_size,
+		int maxthreads);
+
+/* no other thread may use the tree any more, values are not touched */
+void avl_ctree_destroy(struct avl_ctree *tree);
+
+/* returns an id for the calling thread, -1 if all are taken */
+int avl_ctree_thread(struct avl_ctree *tree);
+
+/* returns value of key, or NULL */
+void *avl_ctree_find(struct avl_ctree *tree, int tid, const void *key);
+
+/* add key with value (not NULL) if absent, returns 0 for added, 1 if
+ * the key is already there and -1 for out of memory */
+int avl_ctree_add(struct avl_ctree *tree, int tid, const void *key,
+		void *value);
+
+/* returns the value removed, or NULL if key is absent */
+void *avl_ctree_remove(struct avl_ctree *tree, int tid, const void *key);
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif
+
+
@@ -0,0 +1,434 @@
+/*********************************************************************
+ *
+ * avlcore.h - avl rebalancing core, instantiated by macros
+ *
+ * NOTE:
+ * this file has no include guard for the template part, it is meant
+ * to be included once per node flavor after defining:
+ *
+ * AVL_T_NAME(x)            - mangle function names: _avl_node##x
+ * AVL_T_HANDLE             - node handle type: struct avl_node *
+ * AVL_T_ROOT               - root type: struct avl_root
+ * AVL_T_CTX                - hook context type: const struct avl_augment *
+ * AVL_T_NIL                - null handle: NULL
+ * AVL_T_LEFT(r, n)         - lvalue of left child
+ * AVL_T_RIGHT(r, n)        - lvalue of right child
+ * AVL_T_PARENT(r, n)       - parent handle
+ * AVL_T_SET_PARENT(r, n, p)
+ * AVL_T_HEIGHT(r, n)       - height of a non-null node
+ * AVL_T_SET_HEIGHT(r, n, h)
+ * AVL_T_ROOTNODE(r)        - lvalue of root node handle
+ * AVL_T_ROTATE(c, o, n)    - hook: n has been rotated up over o
+ * AVL_T_COPY(c, o, n)      - hook: n takes the place of o
+ * AVL_T_PROPAGATE(c, n)    - hook: values changed from n up to the root
+ * AVL_T_UNLINK(r, n)       - hook: n is going to be erased
+ * AVL_T_SUBST(r, o, n)     - hook: n is going to replace o
+ *
+ * all of them are undefined at the end of this file.
+ *
+ * with AVL_WAVL the height holds rank + 1 of a weak avl tree instead:
+ * rank differences are 1 or 2 and leaves have rank 0. inserts leave
+ * the same tree as avl, an erase does at most two rotations.
+ *
+ *********************************************************************/
+#ifndef _AVLCORE_H__
+#define _AVLCORE_H__
+
+#include "avlmini.h"
+
+static INLINE int AVL_MAX(int x, int y)
+{
+	return (x < y)? y : x;
+}
+
+#endif
+
+
+/*====================================================================*/
+/* rebalancing core                                                   */
+/*====================================================================*/
+#define AVL_T_LH(r, n) \
+	((AVL_T_LEFT(r, n) != AVL_T_NIL)? AVL_T_HEIGHT(r, AVL_T_LEFT(r, n)) : 0)
+#define AVL_T_RH(r, n) \
+	((AVL_T_RIGHT(r, n) != AVL_T_NIL)? AVL_T_HEIGHT(r, AVL_T_RIGHT(r, n)) : 0)
+
+static INLINE void
+AVL_T_NAME(_child_replace)(AVL_T_HANDLE oldnode, AVL_T_HANDLE newnode,
+		AVL_T_HANDLE parent, AVL_T_ROOT *root)
+{
+	if (parent != AVL_T_NIL) {
+		if (AVL_T_LEFT(root, parent) == oldnode)
+			AVL_T_LEFT(root, parent) = newnode;
+		else
+			AVL_T_RIGHT(root, parent) = newnode;
+	}	else {
+		AVL_T_ROOTNODE(root) = newnode;
+	}
+}
+
+static INLINE AVL_T_HANDLE
+AVL_T_NAME(_rotate_left)(AVL_T_HANDLE node, AVL_T_ROOT *root, AVL_T_CTX ctx)
+{
+	AVL_T_HANDLE right = AVL_T_RIGHT(root, node);
+	AVL_T_HANDLE parent = AVL_T_PARENT(root, node);
+	AVL_T_RIGHT(root, node) = AVL_T_LEFT(root, right);
+	ASSERTION(node != AVL_T_NIL && right != AVL_T_NIL);
+	if (AVL_T_LEFT(root, right) != AVL_T_NIL)
+		AVL_T_SET_PARENT(root, AVL_T_LEFT(root, right), node);
+	AVL_T_LEFT(root, right) = node;
+	AVL_T_SET_PARENT(root, right, parent);
+	AVL_T_NAME(_child_replace)(node, right, parent, root);
+	AVL_T_SET_PARENT(root, node, right);
+	AVL_T_ROTATE(ctx, node, right);
+	AVL_ROTATION_STEP();
+	return right;
+}
+
+static INLINE AVL_T_HANDLE
+AVL_T_NAME(_rotate_right)(AVL_T_HANDLE node, AVL_T_ROOT *root, AVL_T_CTX ctx)
+{
+	AVL_T_HANDLE left = AVL_T_LEFT(root, node);
+	AVL_T_HANDLE parent = AVL_T_PARENT(root, node);
+	AVL_T_LEFT(root, node) = AVL_T_RIGHT(root, left);
+	ASSERTION(node != AVL_T_NIL && left != AVL_T_NIL);
+	if (AVL_T_RIGHT(root, left) != AVL_T_NIL)
+		AVL_T_SET_PARENT(root, AVL_T_RIGHT(root, left), node);
+	AVL_T_RIGHT(root, left) = node;
+	AVL_T_SET_PARENT(root, left, parent);
+	AVL_T_NAME(_child_replace)(node, left, parent, root);
+	AVL_T_SET_PARENT(root, node, left);
+	AVL_T_ROTATE(ctx, node, left);
+	AVL_ROTATION_STEP();
+	return left;
+}
+
+static INLINE void
+AVL_T_NAME(_height_update)(AVL_T_HANDLE node, AVL_T_ROOT *root)
+{
+	int h0 = AVL_T_LH(root, node);
+	int h1 = AVL_T_RH(root, node);
+	AVL_T_SET_HEIGHT(root, node, AVL_MAX(h0, h1) + 1);
+	(void)root;
+}
+
+#ifndef AVL_WAVL
+
+static INLINE AVL_T_HANDLE
+AVL_T_NAME(_fix_l)(AVL_T_HANDLE node, AVL_T_ROOT *root, AVL_T_CTX ctx)
+{
+	AVL_T_HANDLE right = AVL_T_RIGHT(root, node);
+	int rh0, rh1;
+	ASSERTION(right != AVL_T_NIL);
+	rh0 = AVL_T_LH(root, right);
+	rh1 = AVL_T_RH(root, right);
+	if (rh0 > rh1) {
+		right = AVL_T_NAME(_rotate_right)(right, root, ctx);
+		AVL_T_NAME(_height_update)(AVL_T_RIGHT(root, right), root);
+		AVL_T_NAME(_height_update)(right, root);
+		/* _avl_node_height_update(node); */
+	}
+	node = AVL_T_NAME(_rotate_left)(node, root, ctx);
+	AVL_T_NAME(_height_update)(AVL_T_LEFT(root, node), root);
+	AVL_T_NAME(_height_update)(node, root);
+	return node;
+}
+
+static INLINE AVL_T_HANDLE
+AVL_T_NAME(_fix_r)(AVL_T_HANDLE node, AVL_T_ROOT *root, AVL_T_CTX ctx)
+{
+	AVL_T_HANDLE left = AVL_T_LEFT(root, node);
+	int rh0, rh1;
+	ASSERTION(left != AVL_T_NIL);
+	rh0 = AVL_T_LH(root, left);
+	rh1 = AVL_T_RH(root, left);
+	if (rh0 < rh1) {
+		left = AVL_T_NAME(_rotate_left)(left, root, ctx);
+		AVL_T_NAME(_height_update)(AVL_T_LEFT(root, left), root);
+		AVL_T_NAME(_height_update)(left, root);
+		/* _avl_node_height_update(node); */
+	}
+	node = AVL_T_NAME(_rotate_right)(node, root, ctx);
+	AVL_T_NAME(_height_update)(AVL_T_RIGHT(root, node), root);
+	AVL_T_NAME(_height_update)(node, root);
+	return node;
+}
+
+static INLINE void
+AVL_T_NAME(_rebalance)(AVL_T_HANDLE node, AVL_T_ROOT *root, AVL_T_CTX ctx)
+{
+	while (node != AVL_T_NIL) {
+		int h0 = (int)AVL_T_LH(root, node);
+		int h1 = (int)AVL_T_RH(root, node);
+		int diff = h0 - h1;
+		int height = AVL_MAX(h0, h1) + 1;
+		if (AVL_T_HEIGHT(root, node) != height) {
+			AVL_T_SET_HEIGHT(root, node, height);
+		}
+		else if (diff >= -1 && diff <= 1) {
+			break;
+		}
+		/* printf("rebalance %d\n", avl_value(node)); */
+		if (diff <= -2) {
+			node = AVL_T_NAME(_fix_l)(node, root, ctx);
+		}
+		else if (diff >= 2) {
+			node = AVL_T_NAME(_fix_r)(node, root, ctx);
+		}
+		node = AVL_T_PARENT(root, node);
+		/* printf("parent %d\n", (!node)? -1 : avl_value(node)); */
+	}
+}
+
+static INLINE void
+AVL_T_NAME(_post_insert)(AVL_T_HANDLE node, AVL_T_ROOT *root, AVL_T_CTX ctx)
+{
+	AVL_T_SET_HEIGHT(root, node, 1);
+	AVL_T_PROPAGATE(ctx, node);
+#if 0
+	AVL_T_NAME(_rebalance)(AVL_T_PARENT(root, node), root, ctx);
+#else
+	for (node = AVL_T_PARENT(root, node); node != AVL_T_NIL;
+			node = AVL_T_PARENT(root, node)) {
+		int h0 = (int)AVL_T_LH(root, node);
+		int h1 = (int)AVL_T_RH(root, node);
+		int height = AVL_MAX(h0, h1) + 1;
+		int diff = h0 - h1;
+		if (AVL_T_HEIGHT(root, node) == height) break;
+		AVL_T_SET_HEIGHT(root, node, height);
+		/* printf("rebalance %d\n", avl_value(node)); */
+		if (diff <= -2) {
+			node = AVL_T_NAME(_fix_l)(node, root, ctx);
+		}
+		else if (diff >= 2) {
+			node = AVL_T_NAME(_fix_r)(node, root, ctx);
+		}
+		/* printf("parent %d\n", (!node)? -1 : avl_value(node)); */
+	}
+#endif
+}
+
+#else
+
+#define AVL_T_RANK(r, n) (((n) != AVL_T_NIL)? AVL_T_HEIGHT(r, n) : 0)
+
+/* node has grown to the rank of its parent: promote the parent and go
+ * up, or stop with one single or double rotation */
+static INLINE void
+AVL_T_NAME(_wavl_insert_fix)(AVL_T_HANDLE node, AVL_T_ROOT *root,
+		AVL_T_CTX ctx)
+{
+	AVL_T_HANDLE parent;
+	while ((parent = AVL_T_PARENT(root, node)) != AVL_T_NIL) {
+		int rank = AVL_T_HEIGHT(root, parent);
+		int left = (AVL_T_LEFT(root, parent) == node);
+		AVL_T_HANDLE sibling;
+		AVL_T_HANDLE inner;
+		if (AVL_T_HEIGHT(root, node) != rank) break;
+		sibling = (left)? AVL_T_RIGHT(root, parent) : AVL_T_LEFT(root, parent);
+		if (rank - AVL_T_RANK(root, sibling) == 1) {
+			AVL_T_SET_HEIGHT(root, parent, rank + 1);
+			node = parent;
+			continue;
+		}
+		inner = (left)? AVL_T_RIGHT(root, node) : AVL_T_LEFT(root, node);
+		if (rank - AVL_T_RANK(root, inner) == 2) {
+			if (left) AVL_T_NAME(_rotate_right)(parent, root, ctx);
+			else AVL_T_NAME(_rotate_left)(parent, root, ctx);
+			AVL_T_SET_HEIGHT(root, parent, rank - 1);
+		}
+		else {
+			if (left) {
+				AVL_T_NAME(_rotate_left)(node, root, ctx);
+				AVL_T_NAME(_rotate_right)(parent, root, ctx);
+			}	else {
+				AVL_T_NAME(_rotate_right)(node, root, ctx);
+				AVL_T_NAME(_rotate_left)(parent, root, ctx);
+			}
+			AVL_T_SET_HEIGHT(root, inner, rank);
+			AVL_T_SET_HEIGHT(root, node, rank - 1);
+			AVL_T_SET_HEIGHT(root, parent, rank - 1);
+		}
+		break;
+	}
+}
+
+/* the child of parent on the side of node (may be NIL) has lost one
+ * rank: demote upward while node is a 3-child, then rotate once */
+static INLINE void
+AVL_T_NAME(_wavl_erase_fix)(AVL_T_HANDLE node, AVL_T_HANDLE parent,
+		AVL_T_ROOT *root, AVL_T_CTX ctx)
+{
+	if (AVL_T_LEFT(root, parent) == AVL_T_NIL &&
+			AVL_T_RIGHT(root, parent) == AVL_T_NIL) {
+		if (AVL_T_HEIGHT(root, parent) == 1) return;
+		AVL_T_SET_HEIGHT(root, parent, 1);  /* a 2,2 leaf */
+		node = parent;
+		parent = AVL_T_PARENT(root, node);
+	}
+	while (parent != AVL_T_NIL) {
+		int rank = AVL_T_HEIGHT(root, parent);
+		int left = (AVL_T_LEFT(root, parent) == node);
+		AVL_T_HANDLE sibling;
+		AVL_T_HANDLE outer;
+		AVL_T_HANDLE inner;
+		int rs;
+		if (rank - AVL_T_RANK(root, node) <= 2) break;
+		sibling = (left)? AVL_T_RIGHT(root, parent) : AVL_T_LEFT(root, parent);
+		ASSERTION(sibling != AVL_T_NIL);
+		rs = AVL_T_HEIGHT(root, sibling);
+		outer = (left)? AVL_T_RIGHT(root, sibling) : AVL_T_LEFT(root, sibling);
+		inner = (left)? AVL_T_LEFT(root, sibling) : AVL_T_RIGHT(root, sibling);
+		if (rank - rs == 2) {
+			AVL_T_SET_HEIGHT(root, parent, rank - 1);
+		}
+		else if (rs - AVL_T_RANK(root, outer) == 2 &&
+				rs - AVL_T_RANK(root, inner) == 2) {
+			AVL_T_SET_HEIGHT(root, sibling, rs - 1);
+			AVL_T_SET_HEIGHT(root, parent, rank - 1);
+		}
+		else if (rs - AVL_T_RANK(root, outer) == 1) {
+			if (left) AVL_T_NAME(_rotate_left)(parent, root, ctx);
+			else AVL_T_NAME(_rotate_right)(parent, root, ctx);
+			AVL_T_SET_HEIGHT(root, sibling, rank);
+			if (AVL_T_LEFT(root, parent) == AVL_T_NIL &&
+					AVL_T_RIGHT(root, parent) == AVL_T_NIL)
+				AVL_T_SET_HEIGHT(root, parent, 1);
+			else
+				AVL_T_SET_HEIGHT(root, parent, rank - 1);
+			break;
+		}
+		else {
+			if (left) {
+				AVL_T_NAME(_rotate_right)(sibling, root, ctx);
+				AVL_T_NAME(_rotate_left)(parent, root, ctx);
+			}	else {
+				AVL_T_NAME(_rotate_left)(sibling, root, ctx);
+				AVL_T_NAME(_rotate_right)(parent, root, ctx);
+			}
+			AVL_T_SET_HEIGHT(root, inner, rank);
+			AVL_T_SET_HEIGHT(root, sibling, rs - 1);
+			AVL_T_SET_HEIGHT(root, parent, rank - 2);
+			break;
+		}
+		node = parent;
+		parent = AVL_T_PARENT(root, node);
+	}
+}
+
+/* a child of node may have grown to its rank (join) */
+static INLINE void
+AVL_T_NAME(_rebalance)(AVL_T_HANDLE node, AVL_T_ROOT *root, AVL_T_CTX ctx)
+{
+	int rank = AVL_T_HEIGHT(root, node);
+	if (AVL_T_LH(root, node) == rank)
+		AVL_T_NAME(_wavl_insert_fix)(AVL_T_LEFT(root, node), root, ctx);
+	else if (AVL_T_RH(root, node) == rank)
+		AVL_T_NAME(_wavl_insert_fix)(AVL_T_RIGHT(root, node), root, ctx);
+}
+
+static INLINE void
+AVL_T_NAME(_post_insert)(AVL_T_HANDLE node, AVL_T_ROOT *root, AVL_T_CTX ctx)
+{
+	AVL_T_SET_HEIGHT(root, node, 1);
+	AVL_T_PROPAGATE(ctx, node);
+	AVL_T_NAME(_wavl_insert_fix)(node, root, ctx);
+}
+
+#endif
+
+static INLINE void
+AVL_T_NAME(_erase)(AVL_T_HANDLE node, AVL_T_ROOT *root, AVL_T_CTX ctx)
+{
+	AVL_T_HANDLE child;
+	AVL_T_HANDLE parent;
+	ASSERTION(node != AVL_T_NIL);
+	AVL_T_UNLINK(root, node);
+	if (AVL_T_LEFT(root, node) != AVL_T_NIL &&
+			AVL_T_RIGHT(root, node) != AVL_T_NIL) {
+		AVL_T_HANDLE old = node;
+		AVL_T_HANDLE left;
+		node = AVL_T_RIGHT(root, node);
+		while ((left = AVL_T_LEFT(root, node)) != AVL_T_NIL)
+			node = left;
+		child = AVL_T_RIGHT(root, node);
+		parent = AVL_T_PARENT(root, node);
+		if (child != AVL_T_NIL) {
+			AVL_T_SET_PARENT(root, child, parent);
+		}
+		AVL_T_NAME(_child_replace)(node, child, parent, root);
+		if (AVL_T_PARENT(root, node) == old)
+			parent = node;
+		AVL_T_LEFT(root, node) = AVL_T_LEFT(root, old);
+		AVL_T_RIGHT(root, node) = AVL_T_RIGHT(root, old);
+		AVL_T_SET_PARENT(root, node, AVL_T_PARENT(root, old));
+		AVL_T_SET_HEIGHT(root, node, AVL_T_HEIGHT(root, old));
+		AVL_T_NAME(_child_replace)(old, node, AVL_T_PARENT(root, old), root);
+		ASSERTION(AVL_T_LEFT(root, old) != AVL_T_NIL);
+		AVL_T_SET_PARENT(root, AVL_T_LEFT(root, old), node);
+		if (AVL_T_RIGHT(root, old) != AVL_T_NIL) {
+			AVL_T_SET_PARENT(root, AVL_T_RIGHT(root, old), node);
+		}
+		AVL_T_COPY(ctx, old, node);
+	}
+	else {
+		if (AVL_T_LEFT(root, node) == AVL_T_NIL)
+			child = AVL_T_RIGHT(root, node);
+		else
+			child = AVL_T_LEFT(root, node);
+		parent = AVL_T_PARENT(root, node);
+		AVL_T_NAME(_child_replace)(node, child, parent, root);
+		if (child != AVL_T_NIL) {
+			AVL_T_SET_PARENT(root, child, parent);
+		}
+	}
+	if (parent != AVL_T_NIL) {
+		AVL_T_PROPAGATE(ctx, parent);
+#ifndef AVL_WAVL
+		AVL_T_NAME(_rebalance)(parent, root, ctx);
+#else
+		AVL_T_NAME(_wavl_erase_fix)(child, parent, root, ctx);
+#endif
+	}
+}
+
+static INLINE void
+AVL_T_NAME(_replace)(AVL_T_HANDLE victim, AVL_T_HANDLE newnode,
+		AVL_T_ROOT *root, AVL_T_CTX ctx)
+{
+	AVL_T_HANDLE parent = AVL_T_PARENT(root, victim);
+	AVL_T_NAME(_child_replace)(victim, newnode, parent, root);
+	if (AVL_T_LEFT(root, victim) != AVL_T_NIL)
+		AVL_T_SET_PARENT(root, AVL_T_LEFT(root, victim), newnode);
+	if (AVL_T_RIGHT(root, victim) != AVL_T_NIL)
+		AVL_T_SET_PARENT(root, AVL_T_RIGHT(root, victim), newnode);
+	AVL_T_LEFT(root, newnode) = AVL_T_LEFT(root, victim);
+	AVL_T_RIGHT(root, newnode) = AVL_T_RIGHT(root, victim);
+	AVL_T_SET_PARENT(root, newnode, AVL_T_PARENT(root, victim));
+	AVL_T_SET_HEIGHT(root, newnode, AVL_T_HEIGHT(root, victim));
+	AVL_T_SUBST(root, victim, newnode);
+	AVL_T_COPY(ctx, victim, newnode);
+}
+
+
+#undef AVL_T_LH
+#undef AVL_T_RANK
+#undef AVL_T_RH
+#undef AVL_T_NAME
+#undef AVL_T_HANDLE
+#undef AVL_T_ROOT
+#undef AVL_T_CTX
+#undef AVL_T_NIL
+#undef AVL_T_LEFT
+#undef AVL_T_RIGHT
+#undef AVL_T_PARENT
+#undef AVL_T_SET_PARENT
+#undef AVL_T_HEIGHT
+#undef AVL_T_SET_HEIGHT
+#undef AVL_T_ROOTNODE
+#undef AVL_T_ROTATE
+#undef AVL_T_COPY
+#undef AVL_T_PROPAGATE
+#undef AVL_T_UNLINK
+#undef AVL_T_SUBST
+
+
@@ -143,7 +143,7 @@ void avl_hash_erase(struct avl_hash_table *ht, struct avl_hash_node *node)
 	ASSERTION(node && ht);
 	ASSERTION(!avl_node_empty(&node->avlnode));
 	index = &ht->index[node->hash & ht->index_mask];
-	if (index->avlroot.node == &node->avlnode && node->avlnode.height == 1) {
+	if (index->avlroot.node == &node->avlnode && AVL_HEIGHT(&node->avlnode) == 1) {
 		index->avlroot.node = NULL;
 		ilist_del_init(&index->node);
 	}
@@ -192,11 +192,8 @@ struct avl_hash_node* avl_hash_add(struct avl_hash_table *ht,
 {
 	struct avl_hash_index *index = &(ht->index[node->hash & ht->index_mask]);
 	if (index->avlroot.node == NULL) {
-		index->avlroot.node = &node->avlnode;
-		node->avlnode.parent = NULL;
-		node->avlnode.left = NULL;
-		node->avlnode.right = NULL;
-		node->avlnode.height = 1;
+		avl_node_link(&node->avlnode, NULL, &index->avlroot.node);
+		avl_node_post_insert(&node->avlnode, &index->avlroot);
 		ilist_add_tail(&index->node, &ht->head);
 	}
 	else {
@@ -492,12 +489,9 @@ avl_hash_update(struct avl_hash_map *hm, void *key, void *value, int update)
 	if (index->avlroot.node == NULL) {
 		entry = avl_hash_entry_allocate(hm, key, value);
 		ASSERTION(entry);
-		entry->node.avlnode.height = 1;
-		entry->node.avlnode.left = NULL;
-		entry->node.avlnode.right = NULL;
-		entry->node.avlnode.parent = NULL;
 		entry->node.hash = hash;
-		index->avlroot.node = &(entry->node.avlnode);
+		avl_node_link(&(entry->node.avlnode), NULL, &index->avlroot.node);
+		avl_node_post_insert(&(entry->node.avlnode), &index->avlroot);
 		ilist_add_tail(&index->node, &(hm->ht.head));
 		hm->ht.count++;
 		hm->insert = 1;
@@ -0,0 +1,115 @@
+#include "avlindex.h"
+
+
+/*====================================================================*/
+/* rebalancing core for index nodes                                   */
+/*====================================================================*/
+#define AVL_T_NAME(x)               _avl_inode##x
+#define AVL_T_HANDLE                unsigned int
+#define AVL_T_ROOT                  struct avl_iroot
+#define AVL_T_CTX                   const void *
+#define AVL_T_NIL                   AVL_INULL
+#define AVL_T_LEFT(r, n)            (AVL_INODE(r, n)->left)
+#define AVL_T_RIGHT(r, n)           (AVL_INODE(r, n)->right)
+#define AVL_T_PARENT(r, n)          (AVL_INODE(r, n)->parent)
+#define AVL_T_SET_PARENT(r, n, p)   do { AVL_INODE(r, n)->parent = (p); } while (0)
+#define AVL_T_HEIGHT(r, n)          ((int)AVL_INODE(r, n)->height)
+#define AVL_T_SET_HEIGHT(r, n, h)   do { AVL_INODE(r, n)->height = (h); } while (0)
+#define AVL_T_ROOTNODE(r)           ((r)->node)
+#define AVL_T_ROTATE(c, o, n)       ((void)(c))
+#define AVL_T_COPY(c, o, n)         ((void)(c))
+#define AVL_T_PROPAGATE(c, n)       ((void)(c))
+#define AVL_T_UNLINK(r, n)          ((void)0)
+#define AVL_T_SUBST(r, o, n)        ((void)0)
+
+#include "avlcore.h"
+
+
+/*====================================================================*/
+/* index node manipulation                                            */
+/*====================================================================*/
+
+void avl_iroot_init(struct avl_iroot *root, void *base, size_t stride)
+{
+	root->base = (char*)base;
+	root->stride = stride;
+	root->node = AVL_INULL;
+}
+
+unsigned int avl_inode_first(struct avl_iroot *root)
+{
+	unsigned int index = root->node;
+	if (index == AVL_INULL) return AVL_INULL;
+	while (AVL_INODE(root, index)->left != AVL_INULL)
+		index = AVL_INODE(root, index)->left;
+	return index;
+}
+
+unsigned int avl_inode_last(struct avl_iroot *root)
+{
+	unsigned int index = root->node;
+	if (index == AVL_INULL) return AVL_INULL;
+	while (AVL_INODE(root, index)->right != AVL_INULL)
+		index = AVL_INODE(root, index)->right;
+	return index;
+}
+
+unsigned int avl_inode_next(struct avl_iroot *root, unsigned int index)
+{
+	struct avl_inode *node;
+	if (index == AVL_INULL) return AVL_INULL;
+	node = AVL_INODE(root, index);
+	if (node->right != AVL_INULL) {
+		index = node->right;
+		while (AVL_INODE(root, index)->left != AVL_INULL)
+			index = AVL_INODE(root, index)->left;
+	}
+	else {
+		while (1) {
+			unsigned int last = index;
+			index = AVL_INODE(root, index)->parent;
+			if (index == AVL_INULL) break;
+			if (AVL_INODE(root, index)->left == last) break;
+		}
+	}
+	return index;
+}
+
+unsigned int avl_inode_prev(struct avl_iroot *root, unsigned int index)
+{
+	struct avl_inode *node;
+	if (index == AVL_INULL) return AVL_INULL;
+	node = AVL_INODE(root, index);
+	if (node->left != AVL_INULL) {
+		index = node->left;
+		while (AVL_INODE(root, index)->right != AVL_INULL)
+			index = AVL_INODE(root, index)->right;
+	}
+	else {
+		while (1) {
+			unsigned int last = index;
+			index = AVL_INODE(root, index)->parent;
+			if (index == AVL_INULL) break;
+			if (AVL_INODE(root, index)->right == last) break;
+		}
+	}
+	return index;
+}
+
+void avl_inode_post_insert(struct avl_iroot *root, unsigned int index)
+{
+	_avl_inode_post_insert(index, root, NULL);
+}
+
+void avl_inode_erase(struct avl_iroot *root, unsigned int index)
+{
+	_avl_inode_erase(index, root, NULL);
+}
+
+void avl_inode_replace(struct avl_iroot *root, unsigned int victim,
+		unsigned int newindex)
+{
+	_avl_inode_replace(victim, newindex, root, NULL);
+}
+
+
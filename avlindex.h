@@ -0,0 +1,128 @@
+/*********************************************************************
+ *
+ * avlindex.h - avl tree linked by 32-bit indices into a node array
+ *
+ * NOTE:
+ * nodes live in one caller supplied array and refer to each other by
+ * index instead of pointer, a node takes 16 bytes and the tree can be
+ * moved, saved or mmap-ed as it is, only avl_iroot.base needs to be
+ * updated after that. the balancing code is shared with avl_node
+ * through avlcore.h:
+ *
+ * struct item { struct avl_inode node; int key; } items[N];
+ * avl_iroot_init(&root, &items[0].node, sizeof(items[0]));
+ *
+ *********************************************************************/
+#ifndef _AVLINDEX_H__
+#define _AVLINDEX_H__
+
+#include "avlmini.h"
+
+
+/*====================================================================*/
+/* avl_inode - index linked avl node                                  */
+/*====================================================================*/
+#define AVL_INULL    0xffffffffu        /* null index */
+
+struct avl_inode
+{
+	unsigned int left;
+	unsigned int right;
+	unsigned int parent;        /* equals to its own index for empty node */
+	unsigned int height;
+};
+
+struct avl_iroot
+{
+	char *base;                 /* address of avl_inode in element 0 */
+	size_t stride;              /* distance between two elements */
+	unsigned int node;          /* root index */
+};
+
+#define AVL_INODE(root, index) \
+	((struct avl_inode*)((root)->base + (size_t)(index) * (root)->stride))
+
+#define avl_inode_init(root, index) do { \
+		AVL_INODE(root, index)->parent = (index); \
+	}	while (0)
+
+#define avl_inode_empty(root, index) \
+	(AVL_INODE(root, index)->parent == (index))
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* base is the avl_inode of the first element, stride is element size */
+void avl_iroot_init(struct avl_iroot *root, void *base, size_t stride);
+
+unsigned int avl_inode_first(struct avl_iroot *root);
+unsigned int avl_inode_last(struct avl_iroot *root);
+unsigned int avl_inode_next(struct avl_iroot *root, unsigned int index);
+unsigned int avl_inode_prev(struct avl_iroot *root, unsigned int index);
+
+static inline void avl_inode_link(struct avl_iroot *root, unsigned int index,
+		unsigned int parent, unsigned int *avl_link) {
+	struct avl_inode *node = AVL_INODE(root, index);
+	node->parent = parent;
+	node->height = 0;
+	node->left = node->right = AVL_INULL;
+	avl_link[0] = index;
+}
+
+/* avl insert rebalance and erase */
+void avl_inode_post_insert(struct avl_iroot *root, unsigned int index);
+void avl_inode_erase(struct avl_iroot *root, unsigned int index);
+
+void avl_inode_replace(struct avl_iroot *root, unsigned int victim,
+		unsigned int newindex);
+
+
+/*--------------------------------------------------------------------*/
+/* avl inode templates, compare_fn(what, struct avl_inode *node)      */
+/*--------------------------------------------------------------------*/
+
+#define avl_inode_find(root, what, compare_fn, res_index) do {\
+		unsigned int __i = (root)->node; \
+		(res_index) = AVL_INULL; \
+		while (__i != AVL_INULL) { \
+			struct avl_inode *__n = AVL_INODE(root, __i); \
+			int __hr = (compare_fn)(what, __n); \
+			if (__hr == 0) { (res_index) = __i; break; } \
+			else if (__hr < 0) { __i = __n->left; } \
+			else { __i = __n->right; } \
+		} \
+	}   while (0)
+
+
+#define avl_inode_add(root, newindex, compare_fn, duplicate_index) do { \
+		unsigned int *__link = &((root)->node); \
+		unsigned int __parent = AVL_INULL; \
+		unsigned int __duplicate = AVL_INULL; \
+		struct avl_inode *__newnode = AVL_INODE(root, newindex); \
+		while (__link[0] != AVL_INULL) { \
+			struct avl_inode *__n; \
+			int __hr; \
+			__parent = __link[0]; \
+			__n = AVL_INODE(root, __parent); \
+			__hr = (compare_fn)(__newnode, __n); \
+			if (__hr == 0) { __duplicate = __parent; break; } \
+			else if (__hr < 0) { __link = &(__n->left); } \
+			else { __link = &(__n->right); } \
+		} \
+		(duplicate_index) = __duplicate; \
+		if (__duplicate == AVL_INULL) { \
+			avl_inode_link(root, newindex, __parent, __link); \
+			avl_inode_post_insert(root, newindex); \
+		} \
+	}   while (0)
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
+
@@ -0,0 +1,137 @@
+#include "avlitree.h"
+#include "avlaugment.h"
+
+
+/*====================================================================*/
+/* augmented avl: subtree_last                                        */
+/*====================================================================*/
+#define AVL_ITREE_NODE(n) AVL_ENTRY(n, struct avl_itree_node, node)
+
+static inline AVL_ITREE_KEY
+_avl_itree_compute(const struct avl_itree_node *node)
+{
+	AVL_ITREE_KEY last = node->last;
+	if (node->node.left) {
+		AVL_ITREE_KEY x = AVL_ITREE_NODE(node->node.left)->subtree_last;
+		if (x > last) last = x;
+	}
+	if (node->node.right) {
+		AVL_ITREE_KEY x = AVL_ITREE_NODE(node->node.right)->subtree_last;
+		if (x > last) last = x;
+	}
+	return last;
+}
+
+AVL_AUGMENT_DEFINE(static, _avl_itree, struct avl_itree_node, node,
+		subtree_last, _avl_itree_compute)
+
+
+/*====================================================================*/
+/* interval tree                                                      */
+/*====================================================================*/
+
+void avl_itree_init(struct avl_itree *tree)
+{
+	tree->root.node = NULL;
+	tree->count = 0;
+}
+
+void avl_itree_insert(struct avl_itree *tree, struct avl_itree_node *node)
+{
+	struct avl_node **link = &tree->root.node;
+	struct avl_node *parent = NULL;
+	AVL_ITREE_KEY start = node->start;
+	while (link[0]) {
+		parent = link[0];
+		if (start < AVL_ITREE_NODE(parent)->start) {
+			link = &(parent->left);
+		}	else {
+			link = &(parent->right);
+		}
+	}
+	avl_node_link(&node->node, parent, link);
+	_avl_itree_post_insert(&node->node, &tree->root);
+	tree->count++;
+}
+
+void avl_itree_erase(struct avl_itree *tree, struct avl_itree_node *node)
+{
+	ASSERTION(!avl_node_empty(&node->node));
+	_avl_itree_erase(&node->node, &tree->root);
+	avl_node_init(&node->node);
+	tree->count--;
+}
+
+void avl_itree_replace(struct avl_itree *tree, struct avl_itree_node *victim,
+		struct avl_itree_node *newnode)
+{
+	ASSERTION(victim->start == newnode->start);
+	ASSERTION(victim->last == newnode->last);
+	_avl_itree_replace(&victim->node, &newnode->node, &tree->root);
+	avl_node_init(&victim->node);
+}
+
+
+/* leftmost interval overlapping [start, last] in subtree */
+static struct avl_itree_node *
+_avl_itree_search(struct avl_itree_node *node, 
+		AVL_ITREE_KEY start, AVL_ITREE_KEY last)
+{
+	while (1) {
+		if (node->node.left) {
+			struct avl_itree_node *left = AVL_ITREE_NODE(node->node.left);
+			if (start <= left->subtree_last) {
+				node = left;
+				continue;
+			}
+		}
+		if (node->start <= last) {
+			if (start <= node->last) 
+				return node;
+			if (node->node.right) {
+				node = AVL_ITREE_NODE(node->node.right);
+				if (start <= node->subtree_last) 
+					continue;
+			}
+		}
+		return NULL;
+	}
+}
+
+struct avl_itree_node *avl_itree_first(struct avl_itree *tree,
+		AVL_ITREE_KEY start, AVL_ITREE_KEY last)
+{
+	struct avl_itree_node *node;
+	if (tree->root.node == NULL) return NULL;
+	node = AVL_ITREE_NODE(tree->root.node);
+	if (node->subtree_last < start) return NULL;
+	return _avl_itree_search(node, start, last);
+}
+
+struct avl_itree_node *avl_itree_next(struct avl_itree_node *node,
+		AVL_ITREE_KEY start, AVL_ITREE_KEY last)
+{
+	struct avl_node *next = node->node.right, *prev;
+	while (1) {
+		/* search right subtree if it may overlap */
+		if (next) {
+			struct avl_itree_node *right = AVL_ITREE_NODE(next);
+			if (start <= right->subtree_last) 
+				return _avl_itree_search(right, start, last);
+		}
+		/* move up until we come from a left child */
+		do {
+			next = AVL_PARENT(&node->node);
+			if (next == NULL) return NULL;
+			prev = &node->node;
+			node = AVL_ITREE_NODE(next);
+			next = node->node.right;
+		}	while (prev == next);
+		if (last < node->start) 
+			return NULL;
+		else if (start <= node->last)
+			return node;
+	}
+}
+
+
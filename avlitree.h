@@ -0,0 +1,77 @@
+/*********************************************************************
+ *
+ * avlitree.h - interval tree based on avl_node
+ *
+ * NOTE:
+ * intervals are closed [start, last] and ordered by start, every
+ * node keeps the max "last" in its subtree, so that all intervals
+ * overlapping [a, b] can be iterated in O(log n + k)
+ *
+ *********************************************************************/
+#ifndef _AVLITREE_H__
+#define _AVLITREE_H__
+
+#include "avlmini.h"
+
+
+/*====================================================================*/
+/* interval tree definition                                           */
+/*====================================================================*/
+
+/* you can change this by config.h or predefined macro */
+#ifndef AVL_ITREE_KEY
+#define AVL_ITREE_KEY    long long
+#endif
+
+struct avl_itree_node
+{
+	struct avl_node node;			/* avl node */
+	AVL_ITREE_KEY start;			/* interval start (included) */
+	AVL_ITREE_KEY last;				/* interval end (included) */
+	AVL_ITREE_KEY subtree_last;		/* max last in this subtree */
+};
+
+struct avl_itree
+{
+	struct avl_root root;			/* avl root */
+	size_t count;					/* node count */
+};
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void avl_itree_init(struct avl_itree *tree);
+
+/* setup start/last before insert, duplicated intervals are allowed */
+void avl_itree_insert(struct avl_itree *tree, struct avl_itree_node *node);
+
+void avl_itree_erase(struct avl_itree *tree, struct avl_itree_node *node);
+
+/* newnode must have the same interval as victim */
+void avl_itree_replace(struct avl_itree *tree, struct avl_itree_node *victim,
+		struct avl_itree_node *newnode);
+
+/* returns the first interval (ordered by start) overlapping with
+ * [start, last], or NULL if none */
+struct avl_itree_node *avl_itree_first(struct avl_itree *tree,
+		AVL_ITREE_KEY start, AVL_ITREE_KEY last);
+
+/* returns the next interval after node overlapping with [start, last] */
+struct avl_itree_node *avl_itree_next(struct avl_itree_node *node,
+		AVL_ITREE_KEY start, AVL_ITREE_KEY last);
+
+
+#define avl_itree_foreach(node, tree, start, last) \
+	for ((node) = avl_itree_first(tree, start, last); (node) != NULL; \
+		(node) = avl_itree_next(node, start, last))
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
+
@@ -1,4 +1,9 @@
 #include "avlmini.h"
+#include "avlaugment.h"
+
+#ifdef AVL_ROTATION_COUNT
+size_t avl_rotation_count = 0;
+#endif
 
 
 /*====================================================================*/
@@ -26,6 +31,9 @@ struct avl_node *avl_node_last(struct avl_root *root)
 struct avl_node *avl_node_next(struct avl_node *node)
 {
 	if (node == NULL) return NULL;
+#ifdef AVL_THREADED
+	return node->next;
+#endif
 	if (node->right) {
 		node = node->right;
 		while (node->left) 
@@ -34,7 +42,7 @@ struct avl_node *avl_node_next(struct avl_node *node)
 	else {
 		while (1) {
 			struct avl_node *last = node;
-			node = node->parent;
+			node = AVL_PARENT(node);
 			if (node == NULL) break;
 			if (node->left == last) break;
 		}
@@ -45,6 +53,9 @@ struct avl_node *avl_node_next(struct avl_node *node)
 struct avl_node *avl_node_prev(struct avl_node *node)
 {
 	if (node == NULL) return NULL;
+#ifdef AVL_THREADED
+	return node->prev;
+#endif
 	if (node->left) {
 		node = node->left;
 		while (node->right) 
@@ -53,7 +64,7 @@ struct avl_node *avl_node_prev(struct avl_node *node)
 	else {
 		while (1) {
 			struct avl_node *last = node;
-			node = node->parent;
+			node = AVL_PARENT(node);
 			if (node == NULL) break;
 			if (node->right == last) break;
 		}
@@ -61,63 +72,43 @@ struct avl_node *avl_node_prev(struct avl_node *node)
 	return node;
 }
 
-static inline void 
-_avl_child_replace(struct avl_node *oldnode, struct avl_node *newnode, 
-		struct avl_node *parent, struct avl_root *root) 
+#ifdef AVL_ORDER_STATISTIC
+
+/* subtree node count maintained as an augmented value */
+static void _avl_count_propagate(struct avl_node *node, struct avl_node *stop)
 {
-	if (parent) {
-		if (parent->left == oldnode)
-			parent->left = newnode;
-		else 
-			parent->right = newnode;
-	}	else {
-		root->node = newnode;
+	for (; node != stop; node = AVL_PARENT(node)) {
+		node->count = AVL_LEFT_COUNT(node) + AVL_RIGHT_COUNT(node) + 1;
 	}
 }
 
-static inline struct avl_node *
-_avl_node_rotate_left(struct avl_node *node, struct avl_root *root)
+static void _avl_count_copy(struct avl_node *oldnode, struct avl_node *newnode)
 {
-	struct avl_node *right = node->right;
-	struct avl_node *parent = node->parent;
-	node->right = right->left;
-	ASSERTION(node && right);
-	if (right->left) 
-		right->left->parent = node;
-	right->left = node;
-	right->parent = parent;
-	_avl_child_replace(node, right, parent, root);
-	node->parent = right;
-	return right;
+	newnode->count = oldnode->count;
 }
 
-static inline struct avl_node *
-_avl_node_rotate_right(struct avl_node *node, struct avl_root *root)
+static void _avl_count_rotate(struct avl_node *oldnode, 
+		struct avl_node *newnode)
 {
-	struct avl_node *left = node->left;
-	struct avl_node *parent = node->parent;
-	node->left = left->right;
-	ASSERTION(node && left);
-	if (left->right) 
-		left->right->parent = node;
-	left->right = node;
-	left->parent = parent;
-	_avl_child_replace(node, left, parent, root);
-	node->parent = left;
-	return left;
+	newnode->count = oldnode->count;
+	oldnode->count = AVL_LEFT_COUNT(oldnode) + AVL_RIGHT_COUNT(oldnode) + 1;
 }
 
+static const struct avl_augment _avl_count_augment = {
+	_avl_count_propagate, _avl_count_copy, _avl_count_rotate
+};
+
+#define AVL_AUGMENT    (&_avl_count_augment)
+
+#else
+#define AVL_AUGMENT    ((const struct avl_augment*)NULL)
+#endif
+
+
 void avl_node_replace(struct avl_node *victim, struct avl_node *newnode,
 		struct avl_root *root)
 {
-	struct avl_node *parent = victim->parent;
-	_avl_child_replace(victim, newnode, parent, root);
-	if (victim->left) victim->left->parent = newnode;
-	if (victim->right) victim->right->parent = newnode;
-	newnode->left = victim->left;
-	newnode->right = victim->right;
-	newnode->parent = victim->parent;
-	newnode->height = victim->height;
+	avl_node_replace_augmented(victim, newnode, root, AVL_AUGMENT);
 }
 
 
@@ -125,153 +116,483 @@ void avl_node_replace(struct avl_node *victim, struct avl_node *newnode,
 /* avl - node manipulation                                            */
 /*--------------------------------------------------------------------*/
 
-static inline int AVL_MAX(int x, int y) 
+void avl_node_post_insert(struct avl_node *node, struct avl_root *root)
 {
-	return (x < y)? y : x;
+	avl_node_post_insert_augmented(node, root, AVL_AUGMENT);
 }
 
-static inline void
-_avl_node_height_update(struct avl_node *node)
+void avl_node_erase(struct avl_node *node, struct avl_root *root)
 {
-	int h0 = AVL_LEFT_HEIGHT(node);
-	int h1 = AVL_RIGHT_HEIGHT(node);
-	node->height = AVL_MAX(h0, h1) + 1;
+	avl_node_erase_augmented(node, root, AVL_AUGMENT);
 }
 
-static inline struct avl_node *
-_avl_node_fix_l(struct avl_node *node, struct avl_root *root)
+/* a new leaf is the first node if linked left of the old first one */
+void avl_node_post_insert_cached(struct avl_node *node,
+		struct avl_root_cached *root)
 {
-	struct avl_node *right = node->right;
-	int rh0, rh1;
-	ASSERTION(right);
-	rh0 = AVL_LEFT_HEIGHT(right);
-	rh1 = AVL_RIGHT_HEIGHT(right);
-	if (rh0 > rh1) {
-		right = _avl_node_rotate_right(right, root);
-		_avl_node_height_update(right->right);
-		_avl_node_height_update(right);
-		/* _avl_node_height_update(node); */
-	}
-	node = _avl_node_rotate_left(node, root);
-	_avl_node_height_update(node->left);
-	_avl_node_height_update(node);
+	if (root->leftmost == NULL || root->leftmost->left == node)
+		root->leftmost = node;
+	if (root->rightmost == NULL || root->rightmost->right == node)
+		root->rightmost = node;
+	avl_node_post_insert(node, &root->root);
+}
+
+/* next of the first node is its right child or parent, so O(1) */
+void avl_node_erase_cached(struct avl_node *node,
+		struct avl_root_cached *root)
+{
+	if (root->leftmost == node)
+		root->leftmost = avl_node_next(node);
+	if (root->rightmost == node)
+		root->rightmost = avl_node_prev(node);
+	avl_node_erase(node, &root->root);
+}
+
+void avl_node_replace_cached(struct avl_node *victim,
+		struct avl_node *newnode, struct avl_root_cached *root)
+{
+	if (root->leftmost == victim) root->leftmost = newnode;
+	if (root->rightmost == victim) root->rightmost = newnode;
+	avl_node_replace(victim, newnode, &root->root);
+}
+
+struct avl_node *avl_node_pop_first(struct avl_root_cached *root)
+{
+	struct avl_node *node = root->leftmost;
+	if (node) avl_node_erase_cached(node, root);
 	return node;
 }
 
-static inline struct avl_node *
-_avl_node_fix_r(struct avl_node *node, struct avl_root *root)
+struct avl_node *avl_node_pop_last(struct avl_root_cached *root)
 {
-	struct avl_node *left = node->left;
-	int rh0, rh1;
-	ASSERTION(left);
-	rh0 = AVL_LEFT_HEIGHT(left);
-	rh1 = AVL_RIGHT_HEIGHT(left);
-	if (rh0 < rh1) {
-		left = _avl_node_rotate_left(left, root);
-		_avl_node_height_update(left->left);
-		_avl_node_height_update(left);
-		/* _avl_node_height_update(node); */
-	}
-	node = _avl_node_rotate_right(node, root);
-	_avl_node_height_update(node->right);
-	_avl_node_height_update(node);
+	struct avl_node *node = root->rightmost;
+	if (node) avl_node_erase_cached(node, root);
 	return node;
 }
 
+/* recompute augmented values from node up to stop (exclusive) */
 static inline void 
-_avl_node_rebalance(struct avl_node *node, struct avl_root *root)
+_avl_node_propagate(struct avl_node *node, struct avl_node *stop)
 {
-	while (node) {
-		int h0 = (int)AVL_LEFT_HEIGHT(node);
-		int h1 = (int)AVL_RIGHT_HEIGHT(node);
-		int diff = h0 - h1;
-		int height = AVL_MAX(h0, h1) + 1;
-		if (node->height != height) {
-			node->height = height;
-		}	
-		else if (diff >= -1 && diff <= 1) {
-			break;
-		}
-		/* printf("rebalance %d\n", avl_value(node)); */
-		if (diff <= -2) {
-			node = _avl_node_fix_l(node, root);
-		}
-		else if (diff >= 2) {
-			node = _avl_node_fix_r(node, root);
-		}
-		node = node->parent;
-		/* printf("parent %d\n", (!node)? -1 : avl_value(node)); */
+	const struct avl_augment *augment = AVL_AUGMENT;
+	if (augment) augment->propagate(node, stop);
+}
+
+#ifdef AVL_THREADED
+/* relink threads of a subtree after prev in order, returns its last node */
+static struct avl_node *
+_avl_node_thread(struct avl_node *node, struct avl_node *prev)
+{
+	for (; node; node = node->right) {
+		prev = _avl_node_thread(node->left, prev);
+		node->prev = prev;
+		if (prev) prev->next = node;
+		prev = node;
 	}
+	return prev;
 }
+#endif
 
-void avl_node_post_insert(struct avl_node *node, struct avl_root *root)
+/* rebuild threads of a whole tree in O(n) */
+static inline void _avl_node_rethread(struct avl_node *node)
 {
-	node->height = 1;
-#if 0
-	_avl_node_rebalance(node->parent, root);
+#ifdef AVL_THREADED
+	node = _avl_node_thread(node, NULL);
+	if (node) node->next = NULL;
 #else
-	for (node = node->parent; node; node = node->parent) {
-		int h0 = (int)AVL_LEFT_HEIGHT(node);
-		int h1 = (int)AVL_RIGHT_HEIGHT(node);
-		int height = AVL_MAX(h0, h1) + 1;
-		int diff = h0 - h1;
-		if (node->height == height) break;
-		node->height = height;
-		/* printf("rebalance %d\n", avl_value(node)); */
-		if (diff <= -2) {
-			node = _avl_node_fix_l(node, root);
-		}
-		else if (diff >= 2) {
-			node = _avl_node_fix_r(node, root);
-		}
-		/* printf("parent %d\n", (!node)? -1 : avl_value(node)); */
+	(void)node;
+#endif
+}
+
+
+/* link sorted items[0, count) into a subtree, returns its root */
+static struct avl_node *
+_avl_node_build(void **items, size_t count, size_t offset,
+		struct avl_node *parent)
+{
+	struct avl_node *node;
+	size_t mid = count >> 1;
+	if (count == 0) return NULL;
+	node = AVL_DATA2NODE(items[mid], offset);
+	AVL_SET_PARENT(node, parent);
+	node->left = _avl_node_build(items, mid, offset, node);
+	node->right = _avl_node_build(items + mid + 1, count - mid - 1,
+			offset, node);
+	_avl_node_height_update(node, NULL);
+	_avl_node_propagate(node, parent);
+	return node;
+}
+
+/* build a balanced tree from nodes already sorted in key order in O(n) */
+void avl_node_build(struct avl_root *root, struct avl_node **nodes,
+		size_t count)
+{
+	ASSERTION(root->node == NULL);
+	root->node = _avl_node_build((void**)nodes, count, 0, NULL);
+#ifdef AVL_THREADED
+	if (count > 0) {
+		size_t i;
+		nodes[0]->prev = NULL;
+		nodes[count - 1]->next = NULL;
+		for (i = 1; i < count; i++) {
+			nodes[i - 1]->next = nodes[i];
+			nodes[i]->prev = nodes[i - 1];
+		}
 	}
 #endif
 }
 
-void avl_node_erase(struct avl_node *node, struct avl_root *root)
+
+/* join two subtrees with a pivot in between, returns the new root */
+static struct avl_node *
+_avl_node_join(struct avl_node *left, struct avl_node *pivot,
+		struct avl_node *right)
 {
-	struct avl_node *child, *parent;
-	ASSERTION(node);
-	if (node->left && node->right) {
-		struct avl_node *old = node;
-		struct avl_node *left;
-		node = node->right;
-		while ((left = node->left) != NULL)
-			node = left;
-		child = node->right;
-		parent = node->parent;
-		if (child) {
-			child->parent = parent;
-		}
-		_avl_child_replace(node, child, parent, root);
-		if (node->parent == old)
+	struct avl_root root;
+	struct avl_node *parent = NULL, *node;
+	int hl = (left)? AVL_HEIGHT(left) : 0;
+	int hr = (right)? AVL_HEIGHT(right) : 0;
+	if (hl > hr + 1) {
+		/* walk down the right spine of the taller left tree */
+		for (node = left; node && AVL_HEIGHT(node) > hr + 1; ) {
 			parent = node;
-		node->left = old->left;
-		node->right = old->right;
-		node->parent = old->parent;
-		node->height = old->height;
-		_avl_child_replace(old, node, old->parent, root);
-		ASSERTION(old->left);
-		old->left->parent = node;
-		if (old->right) {
-			old->right->parent = node;
+			node = node->right;
 		}
+		pivot->left = node;
+		pivot->right = right;
+		parent->right = pivot;
+		root.node = left;
 	}
-	else {
-		if (node->left == NULL) 
-			child = node->right;
-		else
-			child = node->left;
-		parent = node->parent;
-		_avl_child_replace(node, child, parent, root);
-		if (child) {
-			child->parent = parent;
+	else if (hr > hl + 1) {
+		for (node = right; node && AVL_HEIGHT(node) > hl + 1; ) {
+			parent = node;
+			node = node->left;
 		}
+		pivot->left = left;
+		pivot->right = node;
+		parent->left = pivot;
+		root.node = right;
 	}
+	else {
+		pivot->left = left;
+		pivot->right = right;
+		root.node = pivot;
+	}
+	AVL_SET_PARENT(root.node, NULL);
+	AVL_SET_PARENT(pivot, parent);
+	if (pivot->left) AVL_SET_PARENT(pivot->left, pivot);
+	if (pivot->right) AVL_SET_PARENT(pivot->right, pivot);
+	_avl_node_height_update(pivot, &root);
+	_avl_node_propagate(pivot, NULL);
 	if (parent) {
-		_avl_node_rebalance(parent, root);
+		_avl_node_rebalance(parent, &root, AVL_AUGMENT);
+	}
+	return root.node;
+}
+
+/* split subtree by key, returns the detached node equal to key or NULL */
+static struct avl_node *
+_avl_node_split(struct avl_node *node, const void *key,
+		int (*compare)(const void*, const void*), size_t offset,
+		struct avl_node **left, struct avl_node **right)
+{
+	struct avl_node *match, *temp;
+	int hr;
+	if (node == NULL) {
+		left[0] = right[0] = NULL;
+		return NULL;
+	}
+	hr = compare(key, AVL_NODE2DATA(node, offset));
+	if (hr == 0) {
+		left[0] = node->left;
+		right[0] = node->right;
+		if (left[0]) AVL_SET_PARENT(left[0], NULL);
+		if (right[0]) AVL_SET_PARENT(right[0], NULL);
+		node->left = node->right = NULL;
+		return node;
+	}
+	else if (hr < 0) {
+		match = _avl_node_split(node->left, key, compare, offset, 
+				left, &temp);
+		right[0] = _avl_node_join(temp, node, node->right);
+	}
+	else {
+		match = _avl_node_split(node->right, key, compare, offset,
+				&temp, right);
+		left[0] = _avl_node_join(node->left, node, temp);
+	}
+	return match;
+}
+
+void avl_node_join(struct avl_root *root, struct avl_root *left,
+		struct avl_node *pivot, struct avl_root *right)
+{
+	struct avl_node *l = left->node;
+	struct avl_node *r = right->node;
+#ifdef AVL_THREADED
+	pivot->prev = avl_node_last(left);
+	pivot->next = avl_node_first(right);
+	if (pivot->prev) pivot->prev->next = pivot;
+	if (pivot->next) pivot->next->prev = pivot;
+#endif
+	left->node = NULL;
+	right->node = NULL;
+	root->node = _avl_node_join(l, pivot, r);
+}
+
+void avl_node_concat(struct avl_root *root, struct avl_root *left,
+		struct avl_root *right)
+{
+	struct avl_node *pivot = avl_node_first(right);
+	if (pivot == NULL) {
+		struct avl_node *l = left->node;
+		left->node = NULL;
+		root->node = l;
+	}	
+	else {
+		avl_node_erase(pivot, right);
+		avl_node_join(root, left, pivot, right);
+	}
+}
+
+void avl_node_split(struct avl_root *root, const void *key,
+		int (*compare)(const void*, const void*),
+		struct avl_root *left, struct avl_root *right)
+{
+	struct avl_node *node = root->node;
+	struct avl_node *l, *r, *match;
+	root->node = NULL;
+	match = _avl_node_split(node, key, compare, 0, &l, &r);
+	if (match) {
+		r = _avl_node_join(NULL, match, r);
 	}
+	left->node = l;
+	right->node = r;
+#ifdef AVL_THREADED
+	if (l) avl_node_last(left)->next = NULL;
+	if (r) avl_node_first(right)->prev = NULL;
+#endif
+}
+
+
+/* concatenate two subtrees, returns the new root */
+static struct avl_node *
+_avl_node_concat(struct avl_node *left, struct avl_node *right)
+{
+	struct avl_root root;
+	struct avl_node *pivot;
+	if (left == NULL) return right;
+	if (right == NULL) return left;
+	root.node = right;
+	AVL_SET_PARENT(right, NULL);
+	pivot = avl_node_first(&root);
+#ifdef AVL_THREADED
+	/* neighbours may be dropped already, threads are rebuilt later */
+	pivot->prev = pivot->next = NULL;
+#endif
+	avl_node_erase(pivot, &root);
+	return _avl_node_join(left, pivot, root.node);
+}
+
+/* reset and destroy a whole subtree, returns the number of nodes */
+static size_t
+_avl_node_drop(struct avl_node *node, size_t offset,
+		void (*destroy)(void *data))
+{
+	struct avl_root root;
+	struct avl_node *next = NULL;
+	size_t count = 0;
+	root.node = node;
+	if (node) AVL_SET_PARENT(node, NULL);
+	while (1) {
+		node = avl_node_tear(&root, &next);
+		if (node == NULL) break;
+		avl_node_init(node);
+		count++;
+		if (destroy) destroy(AVL_NODE2DATA(node, offset));
+	}
+	return count;
+}
+
+/* state of a set operation, shared by all of its steps */
+struct avl_setop
+{
+	int (*compare)(const void*, const void*);
+	size_t offset;
+	void (*destroy)(void *data);
+	const struct avl_fork *fork;
+};
+
+typedef struct avl_node *(*avl_setop_fn)(struct avl_node *t1,
+		struct avl_node *t2, const struct avl_setop *op, size_t *dropped);
+
+/* one half of a step, run by avl_fork.spawn on another thread */
+struct avl_setop_task
+{
+	avl_setop_fn fn;
+	struct avl_node *t1;
+	struct avl_node *t2;
+	const struct avl_setop *op;
+	size_t dropped;
+};
+
+static void _avl_setop_run(void *arg)
+{
+	struct avl_setop_task *task = (struct avl_setop_task*)arg;
+	task->t1 = task->fn(task->t1, task->t2, task->op, &task->dropped);
+}
+
+/* nodes in a subtree, estimated from its height without the counts */
+static inline size_t _avl_node_size(const struct avl_node *node)
+{
+	if (node == NULL) return 0;
+#ifdef AVL_ORDER_STATISTIC
+	return node->count;
+#else
+	return ((size_t)1) << (AVL_HEIGHT(node) - 1);
+#endif
+}
+
+/* l1 = fn(l1, l2) and r1 = fn(r1, r2), the two halves are disjoint
+ * subtrees: the left one is offered to fork if it is big enough */
+static void
+_avl_setop_halves(avl_setop_fn fn, const struct avl_setop *op,
+		struct avl_node **l1, struct avl_node *l2,
+		struct avl_node **r1, struct avl_node *r2, size_t *dropped)
+{
+	const struct avl_fork *fork = op->fork;
+	struct avl_setop_task task;
+	void *handle = NULL;
+	if (fork && _avl_node_size(l1[0]) + _avl_node_size(l2) >= fork->grain) {
+		task.fn = fn;
+		task.t1 = l1[0];
+		task.t2 = l2;
+		task.op = op;
+		task.dropped = 0;
+		handle = fork->spawn(_avl_setop_run, &task, fork->user);
+	}
+	if (handle == NULL) {
+		l1[0] = fn(l1[0], l2, op, dropped);
+	}
+	r1[0] = fn(r1[0], r2, op, dropped);
+	if (handle) {
+		fork->join(handle, fork->user);
+		l1[0] = task.t1;
+		dropped[0] += task.dropped;
+	}
+}
+
+static struct avl_node *
+_avl_node_union(struct avl_node *t1, struct avl_node *t2,
+		const struct avl_setop *op, size_t *dropped)
+{
+	struct avl_node *l1, *r1, *l2, *r2, *match;
+	if (t1 == NULL) return t2;
+	if (t2 == NULL) return t1;
+	l1 = t1->left;
+	r1 = t1->right;
+	match = _avl_node_split(t2, AVL_NODE2DATA(t1, op->offset), op->compare,
+			op->offset, &l2, &r2);
+	if (match) {
+		dropped[0] += _avl_node_drop(match, op->offset, op->destroy);
+	}
+	_avl_setop_halves(_avl_node_union, op, &l1, l2, &r1, r2, dropped);
+	return _avl_node_join(l1, t1, r1);
+}
+
+/* t2 is only read by intersect and difference */
+static struct avl_node *
+_avl_node_intersect(struct avl_node *t1, struct avl_node *t2,
+		const struct avl_setop *op, size_t *dropped)
+{
+	struct avl_node *l1, *r1, *match;
+	if (t1 == NULL) return NULL;
+	if (t2 == NULL) {
+		dropped[0] += _avl_node_drop(t1, op->offset, op->destroy);
+		return NULL;
+	}
+	match = _avl_node_split(t1, AVL_NODE2DATA(t2, op->offset), op->compare,
+			op->offset, &l1, &r1);
+	_avl_setop_halves(_avl_node_intersect, op, &l1, t2->left,
+			&r1, t2->right, dropped);
+	if (match == NULL) {
+		return _avl_node_concat(l1, r1);
+	}
+	return _avl_node_join(l1, match, r1);
+}
+
+static struct avl_node *
+_avl_node_difference(struct avl_node *t1, struct avl_node *t2,
+		const struct avl_setop *op, size_t *dropped)
+{
+	struct avl_node *l1, *r1, *match;
+	if (t1 == NULL) return NULL;
+	if (t2 == NULL) return t1;
+	match = _avl_node_split(t1, AVL_NODE2DATA(t2, op->offset), op->compare,
+			op->offset, &l1, &r1);
+	if (match) {
+		dropped[0] += _avl_node_drop(match, op->offset, op->destroy);
+	}
+	_avl_setop_halves(_avl_node_difference, op, &l1, t2->left,
+			&r1, t2->right, dropped);
+	return _avl_node_concat(l1, r1);
+}
+
+/* run which (AVL_UNION, ..) on two subtrees, the result is rethreaded */
+static struct avl_node *
+_avl_node_setop(struct avl_node *t1, struct avl_node *t2, int which,
+		int (*compare)(const void*, const void*), size_t offset,
+		void (*destroy)(void *data), const struct avl_fork *fork,
+		size_t *dropped)
+{
+	struct avl_setop op;
+	op.compare = compare;
+	op.offset = offset;
+	op.destroy = destroy;
+	op.fork = fork;
+	if (which == AVL_UNION)
+		t1 = _avl_node_union(t1, t2, &op, dropped);
+	else if (which == AVL_INTERSECT)
+		t1 = _avl_node_intersect(t1, t2, &op, dropped);
+	else
+		t1 = _avl_node_difference(t1, t2, &op, dropped);
+	_avl_node_rethread(t1);
+	return t1;
+}
+
+size_t avl_node_setop(struct avl_root *root, struct avl_root *other,
+		int which, int (*compare)(const void*, const void*),
+		void (*destroy)(void *node), const struct avl_fork *fork)
+{
+	struct avl_node *t2 = other->node;
+	size_t dropped = 0;
+	if (which == AVL_UNION) other->node = NULL;
+	root->node = _avl_node_setop(root->node, t2, which, compare, 0,
+			destroy, fork, &dropped);
+	return dropped;
+}
+
+size_t avl_node_union(struct avl_root *root, struct avl_root *other,
+		int (*compare)(const void*, const void*),
+		void (*destroy)(void *node))
+{
+	return avl_node_setop(root, other, AVL_UNION, compare, destroy, NULL);
+}
+
+size_t avl_node_intersect(struct avl_root *root, struct avl_root *other,
+		int (*compare)(const void*, const void*),
+		void (*destroy)(void *node))
+{
+	return avl_node_setop(root, other, AVL_INTERSECT, compare, destroy,
+			NULL);
+}
+
+size_t avl_node_difference(struct avl_root *root, struct avl_root *other,
+		int (*compare)(const void*, const void*),
+		void (*destroy)(void *node))
+{
+	return avl_node_setop(root, other, AVL_DIFFERENCE, compare, destroy,
+			NULL);
 }
 
 
@@ -285,14 +606,17 @@ struct avl_node* avl_node_tear(struct avl_root *root, struct avl_node **next)
 			return NULL;
 		node = root->node;
 	}
-	/* sink down to the leaf */
+	/* sink down to the leaf, the right subtree is torn next */
 	while (1) {
-		if (node->left) node = node->left;
+		if (node->left) {
+			if (node->right) AVL_PREFETCH(node->right);
+			node = node->left;
+		}
 		else if (node->right) node = node->right;
 		else break;
 	}
 	/* tear down one leaf */
-	parent = node->parent;
+	parent = AVL_PARENT(node);
 	if (parent == NULL) {
 		*next = NULL;
 		root->node = NULL;
@@ -303,12 +627,48 @@ struct avl_node* avl_node_tear(struct avl_root *root, struct avl_node **next)
 	}	else {
 		parent->right = NULL;
 	}
-	node->height = 0;
+	AVL_SET_HEIGHT(node, 0);
 	*next = parent;
 	return node;
 }
 
 
+#ifdef AVL_ORDER_STATISTIC
+
+/* zero based position of the node in key order, O(log n) */
+size_t avl_node_rank(const struct avl_node *node)
+{
+	size_t rank = AVL_LEFT_COUNT(node);
+	const struct avl_node *parent;
+	for (; (parent = AVL_PARENT(node)) != NULL; node = parent) {
+		if (parent->right == node) 
+			rank += AVL_LEFT_COUNT(parent) + 1;
+	}
+	return rank;
+}
+
+/* returns the node at zero based position, NULL if out of range */
+struct avl_node *avl_node_select(struct avl_root *root, size_t index)
+{
+	struct avl_node *node = root->node;
+	while (node) {
+		size_t lc = AVL_LEFT_COUNT(node);
+		if (index == lc) 
+			break;
+		else if (index < lc) {
+			node = node->left;
+		}
+		else {
+			index -= lc + 1;
+			node = node->right;
+		}
+	}
+	return node;
+}
+
+#endif
+
+
 /*====================================================================*/
 /* avl_tree - easy interface                                          */
 /*====================================================================*/
@@ -320,6 +680,7 @@ void avl_tree_init(struct avl_tree *tree,
 	tree->offset = offset;
 	tree->size = size;
 	tree->count = 0;
+	tree->stamp = 0;
 	tree->compare = compare;
 }
 
@@ -406,6 +767,81 @@ void *avl_tree_nearest(struct avl_tree *tree, const void *data)
 }
 
 
+void *avl_tree_lower_bound(struct avl_tree *tree, const void *data)
+{
+	struct avl_node *n = tree->root.node;
+	struct avl_node *p = NULL;
+	int (*compare)(const void*, const void*) = tree->compare;
+	int offset = tree->offset;
+	while (n) {
+		void *nd = AVL_NODE2DATA(n, offset);
+		int hr = compare(data, nd);
+		if (hr == 0) {
+			return nd;
+		}
+		else if (hr < 0) {
+			p = n;
+			n = n->left;
+		}
+		else {
+			n = n->right;
+		}
+	}
+	return (p)? AVL_NODE2DATA(p, offset) : NULL;
+}
+
+
+void *avl_tree_upper_bound(struct avl_tree *tree, const void *data)
+{
+	struct avl_node *n = tree->root.node;
+	struct avl_node *p = NULL;
+	int (*compare)(const void*, const void*) = tree->compare;
+	int offset = tree->offset;
+	while (n) {
+		void *nd = AVL_NODE2DATA(n, offset);
+		int hr = compare(data, nd);
+		if (hr < 0) {
+			p = n;
+			n = n->left;
+		}
+		else {
+			n = n->right;
+		}
+	}
+	return (p)? AVL_NODE2DATA(p, offset) : NULL;
+}
+
+
+void *avl_tree_floor(struct avl_tree *tree, const void *data)
+{
+	struct avl_node *n = tree->root.node;
+	struct avl_node *p = NULL;
+	int (*compare)(const void*, const void*) = tree->compare;
+	int offset = tree->offset;
+	while (n) {
+		void *nd = AVL_NODE2DATA(n, offset);
+		int hr = compare(data, nd);
+		if (hr == 0) {
+			return nd;
+		}
+		else if (hr < 0) {
+			n = n->left;
+		}
+		else {
+			p = n;
+			n = n->right;
+		}
+	}
+	return (p)? AVL_NODE2DATA(p, offset) : NULL;
+}
+
+
+void *avl_tree_ceiling(struct avl_tree *tree, const void *data)
+{
+	return avl_tree_lower_bound(tree, data);
+}
+
+
 /* returns NULL for success, otherwise returns conflict node with same key */
 void *avl_tree_add(struct avl_tree *tree, void *data)
 {
@@ -433,6 +869,82 @@ void *avl_tree_add(struct avl_tree *tree, void *data)
 	avl_node_link(node, parent, link);
 	avl_node_post_insert(node, &tree->root);
 	tree->count++;
+	tree->stamp++;
+	return NULL;
+}
+
+void *avl_tree_add_hint(struct avl_tree *tree, void *data, void *hint)
+{
+	struct avl_node **link = &tree->root.node;
+	struct avl_node *parent = NULL;
+	struct avl_node *node = AVL_DATA2NODE(data, tree->offset);
+	struct avl_node *near;
+	int (*compare)(const void*, const void*) = tree->compare;
+	int offset = tree->offset;
+	int hr, cmp;
+	if (hint == NULL) {
+		return avl_tree_add(tree, data);
+	}
+	hr = compare(data, hint);
+	if (hr == 0) {
+		return hint;
+	}
+	near = AVL_DATA2NODE(hint, offset);
+#ifdef AVL_THREADED
+	/* only the neighbour of hint towards data is compared */
+	{
+		struct avl_node *side = (hr > 0)?
+			avl_node_next(near) : avl_node_prev(near);
+		cmp = (side)? compare(data, AVL_NODE2DATA(side, offset)) : -hr;
+		if (cmp == 0) {
+			return AVL_NODE2DATA(side, offset);
+		}
+		if ((cmp > 0) != (hr > 0)) {
+			parent = near;
+			link = (hr > 0)? &(near->right) : &(near->left);
+			if (link[0]) {
+				parent = side;
+				link = (hr > 0)? &(side->left) : &(side->right);
+			}
+		}
+	}
+#else
+	/* climb until an ancestor on the far side of hint bounds data */
+	{
+		struct avl_node *x = near, *p;
+		while ((p = AVL_PARENT(x)) != NULL) {
+			if (((hr > 0)? p->left : p->right) == x) {
+				void *pd = AVL_NODE2DATA(p, offset);
+				cmp = compare(data, pd);
+				if (cmp == 0) return pd;
+				if ((cmp > 0) != (hr > 0)) break;
+				near = p;
+			}
+			x = p;
+		}
+		parent = near;
+		link = (hr > 0)? &(near->right) : &(near->left);
+	}
+#endif
+	while (link[0]) {
+		void *pd;
+		parent = link[0];
+		pd = AVL_NODE2DATA(parent, offset);
+		hr = compare(data, pd);
+		if (hr == 0) {
+			return pd;
+		}	
+		else if (hr < 0) {
+			link = &(parent->left);
+		}
+		else {
+			link = &(parent->right);
+		}
+	}
+	avl_node_link(node, parent, link);
+	avl_node_post_insert(node, &tree->root);
+	tree->count++;
+	tree->stamp++;
 	return NULL;
 }
 
@@ -442,8 +954,9 @@ void avl_tree_remove(struct avl_tree *tree, void *data)
 	struct avl_node *node = AVL_DATA2NODE(data, tree->offset);
 	if (!avl_node_empty(node)) {
 		avl_node_erase(node, &tree->root);
-		node->parent = node;
+		avl_node_init(node);
 		tree->count--;
+		tree->stamp++;
 	}
 }
 
@@ -453,7 +966,8 @@ void avl_tree_replace(struct avl_tree *tree, void *victim, void *newdata)
 	struct avl_node *vicnode = AVL_DATA2NODE(victim, tree->offset);
 	struct avl_node *newnode = AVL_DATA2NODE(newdata, tree->offset);
 	avl_node_replace(vicnode, newnode, &tree->root);
-	vicnode->parent = vicnode;
+	avl_node_init(vicnode);
+	tree->stamp++;
 }
 
 
@@ -466,14 +980,281 @@ void avl_tree_clear(struct avl_tree *tree, void (*destroy)(void *data))
 		node = avl_node_tear(&tree->root, &next);
 		if (node == NULL) break;
 		data = AVL_NODE2DATA(node, tree->offset);
-		node->parent = node;
+		avl_node_init(node);
 		tree->count--;
 		if (destroy) destroy(data);
 	}
 	ASSERTION(tree->count == 0);
+	tree->stamp++;
+}
+
+
+#ifdef AVL_ORDER_STATISTIC
+
+/* number of nodes less than data, which is not required to be in tree */
+size_t avl_tree_rank(struct avl_tree *tree, const void *data)
+{
+	struct avl_node *n = tree->root.node;
+	int (*compare)(const void*, const void*) = tree->compare;
+	size_t offset = tree->offset;
+	size_t rank = 0;
+	while (n) {
+		int hr = compare(data, AVL_NODE2DATA(n, offset));
+		if (hr == 0) {
+			return rank + AVL_LEFT_COUNT(n);
+		}
+		else if (hr < 0) {
+			n = n->left;
+		}
+		else {
+			rank += AVL_LEFT_COUNT(n) + 1;
+			n = n->right;
+		}
+	}
+	return rank;
+}
+
+
+/* returns the data at zero based position, NULL if out of range */
+void *avl_tree_select(struct avl_tree *tree, size_t index)
+{
+	struct avl_node *node = avl_node_select(&tree->root, index);
+	if (!node) return NULL;
+	return AVL_NODE2DATA(node, tree->offset);
+}
+
+#endif
+
+
+void avl_tree_setop(struct avl_tree *tree, struct avl_tree *other,
+		int which, void (*destroy)(void *data),
+		const struct avl_fork *fork)
+{
+	struct avl_node *t2 = other->root.node;
+	size_t dropped = 0;
+	ASSERTION(tree->offset == other->offset);
+	if (which == AVL_UNION) other->root.node = NULL;
+	tree->root.node = _avl_node_setop(tree->root.node, t2, which,
+			tree->compare, tree->offset, destroy, fork, &dropped);
+	if (which == AVL_UNION) {
+		tree->count += other->count;
+		other->count = 0;
+		other->stamp++;
+	}
+	tree->count -= dropped;
+	tree->stamp++;
+}
+
+
+void avl_tree_union(struct avl_tree *tree, struct avl_tree *other,
+		void (*destroy)(void *data))
+{
+	avl_tree_setop(tree, other, AVL_UNION, destroy, NULL);
+}
+
+
+void avl_tree_intersect(struct avl_tree *tree, struct avl_tree *other,
+		void (*destroy)(void *data))
+{
+	avl_tree_setop(tree, other, AVL_INTERSECT, destroy, NULL);
+}
+
+
+void avl_tree_difference(struct avl_tree *tree, struct avl_tree *other,
+		void (*destroy)(void *data))
+{
+	avl_tree_setop(tree, other, AVL_DIFFERENCE, destroy, NULL);
+}
+
+
+/* nodes in the left part of a split, walks the smaller part only */
+static size_t
+_avl_node_count_left(struct avl_node *l, struct avl_node *r, size_t total)
+{
+#ifdef AVL_ORDER_STATISTIC
+	(void)r;
+	(void)total;
+	return (l)? l->count : 0;
+#else
+	struct avl_root a, b;
+	struct avl_node *x, *y;
+	size_t n = 0;
+	a.node = l;
+	b.node = r;
+	x = avl_node_first(&a);
+	y = avl_node_first(&b);
+	for (; x && y; n++) {
+		x = avl_node_next(x);
+		y = avl_node_next(y);
+	}
+	return (x == NULL)? n : total - n;
+#endif
+}
+
+
+void avl_tree_split(struct avl_tree *tree, const void *data,
+		struct avl_tree *left, struct avl_tree *right)
+{
+	struct avl_node *node = tree->root.node;
+	struct avl_node *l, *r, *match;
+	size_t total = tree->count;
+	ASSERTION(tree->offset == left->offset);
+	ASSERTION(tree->offset == right->offset);
+	tree->root.node = NULL;
+	tree->count = 0;
+	tree->stamp++;
+	match = _avl_node_split(node, data, tree->compare, tree->offset,
+			&l, &r);
+	if (match) {
+		r = _avl_node_join(NULL, match, r);
+	}
+	left->root.node = l;
+	right->root.node = r;
+#ifdef AVL_THREADED
+	if (l) avl_node_last(&left->root)->next = NULL;
+	if (r) avl_node_first(&right->root)->prev = NULL;
+#endif
+	left->count = _avl_node_count_left(l, r, total);
+	right->count = total - left->count;
+	left->stamp++;
+	right->stamp++;
+}
+
+
+void avl_tree_concat(struct avl_tree *tree, struct avl_tree *left,
+		struct avl_tree *right)
+{
+	size_t count = left->count + right->count;
+	ASSERTION(tree->offset == left->offset);
+	ASSERTION(tree->offset == right->offset);
+	avl_node_concat(&tree->root, &left->root, &right->root);
+	left->count = 0;
+	right->count = 0;
+	left->stamp++;
+	right->stamp++;
+	tree->count = count;
+	tree->stamp++;
+}
+
+
+/* stable merge sort of data pointers, temp holds count pointers */
+static void _avl_data_sort(void **items, void **temp, size_t count,
+		int (*compare)(const void*, const void*))
+{
+	size_t mid = count >> 1, i = 0, j = mid, k = 0;
+	if (count < 2) return;
+	_avl_data_sort(items, temp, mid, compare);
+	_avl_data_sort(items + mid, temp, count - mid, compare);
+	/* already in order, common for ingest streams */
+	if (compare(items[mid - 1], items[mid]) <= 0) return;
+	while (i < mid && j < count) {
+		if (compare(items[j], items[i]) < 0) temp[k++] = items[j++];
+		else temp[k++] = items[i++];
+	}
+	while (i < mid) temp[k++] = items[i++];
+	while (j < count) temp[k++] = items[j++];
+	for (i = 0; i < count; i++) items[i] = temp[i];
 }
 
+/* first position in sorted items[0, count) not less than data */
+static size_t _avl_data_lower_bound(void **items, size_t count,
+		const void *data, int (*compare)(const void*, const void*))
+{
+	size_t lo = 0, hi = count;
+	while (lo < hi) {
+		size_t mid = (lo + hi) >> 1;
+		if (compare(items[mid], data) < 0) lo = mid + 1;
+		else hi = mid;
+	}
+	return lo;
+}
 
+/* merge sorted distinct items into a subtree, returns its new root. an
+ * item whose key is in the subtree is left out and gets that data */
+static struct avl_node *
+_avl_node_merge(struct avl_node *node, void **items, void **results,
+		size_t count, int (*compare)(const void*, const void*),
+		size_t offset, size_t *dups)
+{
+	struct avl_node *left, *right;
+	void *data;
+	size_t pos, next;
+	if (count == 0) return node;
+	if (node == NULL) return _avl_node_build(items, count, offset, NULL);
+	data = AVL_NODE2DATA(node, offset);
+	pos = next = _avl_data_lower_bound(items, count, data, compare);
+	if (pos < count && compare(items[pos], data) == 0) {
+		results[pos] = data;
+		dups[0]++;
+		next = pos + 1;
+	}
+	left = _avl_node_merge(node->left, items, results, pos, compare,
+			offset, dups);
+	right = _avl_node_merge(node->right, items + next, results + next,
+			count - next, compare, offset, dups);
+	return _avl_node_join(left, node, right);
+}
+
+
+size_t avl_tree_add_batch(struct avl_tree *tree, void **items,
+		size_t count, void **results)
+{
+	int (*compare)(const void*, const void*) = tree->compare;
+	size_t unique = 0, follow = 0, dups = 0, i;
+	if (count == 0) return 0;
+	_avl_data_sort(items, results, count, compare);
+	/* the first of equal keys stays, the others move behind */
+	for (i = 0; i < count; i++) {
+		if (unique > 0 && compare(items[i], items[unique - 1]) == 0)
+			results[follow++] = items[i];
+		else
+			items[unique++] = items[i];
+	}
+	for (i = 0; i < follow; i++) items[unique + i] = results[i];
+	for (i = 0; i < count; i++) results[i] = NULL;
+	tree->root.node = _avl_node_merge(tree->root.node, items, results,
+			unique, compare, tree->offset, &dups);
+	_avl_node_rethread(tree->root.node);
+	/* a later equal key meets the first one, or what that one met */
+	for (i = unique; i < count; i++) {
+		size_t pos = _avl_data_lower_bound(items, unique, items[i], compare);
+		results[i] = (results[pos])? results[pos] : items[pos];
+	}
+	tree->count += unique - dups;
+	tree->stamp++;
+	return unique - dups;
+}
 
 
+size_t avl_tree_remove_range(struct avl_tree *tree, const void *lo,
+		const void *hi, void (*destroy)(void *data))
+{
+	int (*compare)(const void*, const void*) = tree->compare;
+	struct avl_root left, mid, right;
+	struct avl_node *l, *m, *r, *match, *node, *next = NULL;
+	size_t count = 0;
+	match = _avl_node_split(tree->root.node, lo, compare, tree->offset,
+			&l, &m);
+	if (match) m = _avl_node_join(NULL, match, m);
+	match = _avl_node_split(m, hi, compare, tree->offset, &m, &r);
+	if (match) r = _avl_node_join(NULL, match, r);
+	left.node = l;
+	mid.node = m;
+	right.node = r;
+#ifdef AVL_THREADED
+	if (l) avl_node_last(&left)->next = NULL;
+	if (r) avl_node_first(&right)->prev = NULL;
+#endif
+	avl_node_concat(&tree->root, &left, &right);
+	while (1) {
+		node = avl_node_tear(&mid, &next);
+		if (node == NULL) break;
+		avl_node_init(node);
+		count++;
+		if (destroy) destroy(AVL_NODE2DATA(node, tree->offset));
+	}
+	tree->count -= count;
+	tree->stamp++;
+	return count;
+}
 
@@ -47,16 +47,44 @@
 #define ASSERTION(x) ((void)0)
 #endif
 
+#ifndef AVL_PREFETCH
+#if defined(__GNUC__)
+#define AVL_PREFETCH(addr) __builtin_prefetch(addr)
+#else
+#define AVL_PREFETCH(addr) ((void)0)
+#endif
+#endif
+
 
 /*====================================================================*/
 /* avl_node - avl binary search tree                                  */
 /*====================================================================*/
+
+/* AVL_COMPACT packs the height into the top 8 bits of the parent pointer,
+ * which shrinks avl_node from 32 to 24 bytes. it requires 64-bit size_t
+ * and user space addresses below 2^56 (x86-64, aarch64 without top byte
+ * tags: heap tagging of MTE or TBI is lost by the mask) */
+
+/* AVL_WAVL rebalances as a weak avl tree and height holds rank + 1: the
+ * same tree as avl while only inserting, at most two rotations for an
+ * erase, height bound by 2 log n after erases instead of 1.44 log n */
 struct avl_node
 {
 	struct avl_node *left;
 	struct avl_node *right;
+#ifndef AVL_COMPACT
 	struct avl_node *parent;    /* pointing to node itself for empty node */
 	int height;                 /* equals to 1 + max height in childs */
+#else
+	size_t parent_height;       /* parent pointer | (height << 56) */
+#endif
+#ifdef AVL_ORDER_STATISTIC
+	size_t count;               /* number of nodes in this subtree */
+#endif
+#ifdef AVL_THREADED
+	struct avl_node *next;      /* in-order successor, NULL for the last */
+	struct avl_node *prev;      /* in-order predecessor, NULL for the first */
+#endif
 };
 
 struct avl_root
@@ -64,6 +92,14 @@ struct avl_root
 	struct avl_node *node;		/* root node */
 };
 
+/* root caching the first and last node for O(1) access */
+struct avl_root_cached
+{
+	struct avl_root root;
+	struct avl_node *leftmost;      /* first node, NULL for empty */
+	struct avl_node *rightmost;     /* last node, NULL for empty */
+};
+
 
 /*--------------------------------------------------------------------*/
 /* NODE MACROS                                                        */
@@ -83,17 +119,57 @@ struct avl_root
 #define AVL_ENTRY(ptr, type, member) \
 	((type*)AVL_NODE2DATA(ptr, AVL_OFFSET(type, member)))
 
+#ifndef AVL_COMPACT
+#define AVL_PARENT(node) ((node)->parent)
+#define AVL_HEIGHT(node) ((node)->height)
+#define AVL_SET_PARENT(node, p) do { (node)->parent = (p); } while (0)
+#define AVL_SET_HEIGHT(node, h) do { (node)->height = (h); } while (0)
 #define avl_node_init(node) do { ((node)->parent) = (node); } while (0)
-#define avl_node_empty(node) ((node)->parent == (node))
+#else
+#if defined(__SIZEOF_SIZE_T__)
+#if __SIZEOF_SIZE_T__ != 8
+#error AVL_COMPACT requires a 64-bit size_t
+#endif
+#elif defined(_WIN32) && (!defined(_WIN64))
+#error AVL_COMPACT requires a 64-bit size_t
+#endif
+#define AVL_PARENT_MASK  ((((size_t)1) << 56) - 1)
+#define AVL_PARENT(node) \
+	((struct avl_node*)((node)->parent_height & AVL_PARENT_MASK))
+#define AVL_HEIGHT(node) ((int)((node)->parent_height >> 56))
+#define AVL_SET_PARENT(node, p) do { (node)->parent_height = \
+	((node)->parent_height & ~AVL_PARENT_MASK) | (size_t)(p); } while (0)
+#define AVL_SET_HEIGHT(node, h) do { (node)->parent_height = \
+	((node)->parent_height & AVL_PARENT_MASK) | ((size_t)(h) << 56); \
+	} while (0)
+#define avl_node_init(node) do { \
+	(node)->parent_height = (size_t)(node); } while (0)
+#endif
 
-#define AVL_LEFT_HEIGHT(node) (((node)->left)? ((node)->left)->height : 0)
-#define AVL_RIGHT_HEIGHT(node) (((node)->right)? ((node)->right)->height : 0)
+#define avl_node_empty(node) (AVL_PARENT(node) == (node))
+
+#define AVL_LEFT_HEIGHT(node) (((node)->left)? AVL_HEIGHT((node)->left) : 0)
+#define AVL_RIGHT_HEIGHT(node) (((node)->right)? AVL_HEIGHT((node)->right) : 0)
+
+#ifdef AVL_ORDER_STATISTIC
+#define AVL_LEFT_COUNT(node) (((node)->left)? ((node)->left)->count : 0)
+#define AVL_RIGHT_COUNT(node) (((node)->right)? ((node)->right)->count : 0)
+#endif
 
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+/* AVL_ROTATION_COUNT adds up single rotations of every tree into
+ * avl_rotation_count, for benchmarks: it is global and not atomic */
+#ifdef AVL_ROTATION_COUNT
+extern size_t avl_rotation_count;
+#define AVL_ROTATION_STEP() (avl_rotation_count++)
+#else
+#define AVL_ROTATION_STEP() ((void)0)
+#endif
+
 /*--------------------------------------------------------------------*/
 /* binary search tree - node manipulation                             */
 /*--------------------------------------------------------------------*/
@@ -108,12 +184,100 @@ void avl_node_replace(struct avl_node *victim, struct avl_node *newnode,
 
 static inline void avl_node_link(struct avl_node *node, struct avl_node *parent,
 		struct avl_node **avl_link) {
+#ifndef AVL_COMPACT
 	node->parent = parent;
 	node->height = 0;
+#else
+	node->parent_height = (size_t)parent;
+#endif
 	node->left = node->right = NULL;
 	avl_link[0] = node;
+#ifdef AVL_THREADED
+	if (parent == NULL) {
+		node->prev = node->next = NULL;
+	}
+	else if (avl_link == &parent->left) {
+		node->next = parent;
+		node->prev = parent->prev;
+		parent->prev = node;
+		if (node->prev) node->prev->next = node;
+	}
+	else {
+		node->prev = parent;
+		node->next = parent->next;
+		parent->next = node;
+		if (node->next) node->next->prev = node;
+	}
+#endif
 }
 
+/* build a balanced tree from nodes already sorted in key order in O(n),
+ * no comparison is made, root must be empty before building */
+void avl_node_build(struct avl_root *root, struct avl_node **nodes,
+		size_t count);
+
+/* join left, pivot and right into root in O(log n): keys in left must be
+ * less than pivot and keys in right greater than it, root may be the same
+ * as left or right, both of which are emptied */
+void avl_node_join(struct avl_root *root, struct avl_root *left,
+		struct avl_node *pivot, struct avl_root *right);
+
+/* concatenate left and right into root, keys in left must be less */
+void avl_node_concat(struct avl_root *root, struct avl_root *left,
+		struct avl_root *right);
+
+/* split root in O(log n) by calling compare(key, node): nodes less than key 
+ * go to left and the others go to right, root may be the same as either */
+void avl_node_split(struct avl_root *root, const void *key,
+		int (*compare)(const void*, const void*),
+		struct avl_root *left, struct avl_root *right);
+
+/* set operations in O(m log(n/m + 1)), nodes are relinked, not copied.
+ * compare(n1, n2) is called with two nodes, nodes dropped from the result
+ * are reset to empty and passed to destroy (may be NULL), returns the
+ * number of dropped nodes.
+ * union: move every node of other into root, drop those with a key
+ * already in root, other becomes empty.
+ * intersect: drop nodes of root whose key is not in other.
+ * difference: drop nodes of root whose key is in other.
+ * other is left unchanged by intersect and difference.
+ * with AVL_THREADED, the threads of the result are rebuilt in O(n). */
+size_t avl_node_union(struct avl_root *root, struct avl_root *other,
+		int (*compare)(const void*, const void*),
+		void (*destroy)(void *node));
+
+size_t avl_node_intersect(struct avl_root *root, struct avl_root *other,
+		int (*compare)(const void*, const void*),
+		void (*destroy)(void *node));
+
+size_t avl_node_difference(struct avl_root *root, struct avl_root *other,
+		int (*compare)(const void*, const void*),
+		void (*destroy)(void *node));
+
+/* optional fork of the set operations: each step splits its inputs in
+ * two disjoint halves, the left half is offered to spawn(run, arg, user)
+ * when the two inputs of it hold at least grain nodes (estimated from
+ * the height without AVL_ORDER_STATISTIC). spawn returns a handle after
+ * starting run(arg) on another thread, or NULL to run it inline, join
+ * (handle, user) waits for it. compare and destroy may then be called
+ * from several threads at once */
+struct avl_fork
+{
+	void *(*spawn)(void (*run)(void *arg), void *arg, void *user);
+	void (*join)(void *handle, void *user);
+	size_t grain;
+	void *user;
+};
+
+#define AVL_UNION         0
+#define AVL_INTERSECT     1
+#define AVL_DIFFERENCE    2
+
+/* the set operation which (AVL_UNION, ..) forked by fork (may be NULL) */
+size_t avl_node_setop(struct avl_root *root, struct avl_root *other,
+		int which, int (*compare)(const void*, const void*),
+		void (*destroy)(void *node), const struct avl_fork *fork);
+
 /* avl insert rebalance and erase */
 void avl_node_post_insert(struct avl_node *node, struct avl_root *root);
 void avl_node_erase(struct avl_node *node, struct avl_root *root);
@@ -121,6 +285,34 @@ void avl_node_erase(struct avl_node *node, struct avl_root *root);
 /* tear down the whole tree */
 struct avl_node* avl_node_tear(struct avl_root *root, struct avl_node **next);
 
+/* same as above on a cached root, keeping leftmost and rightmost */
+void avl_node_post_insert_cached(struct avl_node *node,
+		struct avl_root_cached *root);
+void avl_node_erase_cached(struct avl_node *node,
+		struct avl_root_cached *root);
+void avl_node_replace_cached(struct avl_node *victim,
+		struct avl_node *newnode, struct avl_root_cached *root);
+
+/* erase and return the first / last node, NULL for empty */
+struct avl_node *avl_node_pop_first(struct avl_root_cached *root);
+struct avl_node *avl_node_pop_last(struct avl_root_cached *root);
+
+#define avl_root_cached_init(r) do { \
+		(r)->root.node = NULL; \
+		(r)->leftmost = (r)->rightmost = NULL; \
+	}	while (0)
+
+#define avl_node_first_cached(r) ((r)->leftmost)
+#define avl_node_last_cached(r) ((r)->rightmost)
+
+#ifdef AVL_ORDER_STATISTIC
+/* zero based position of the node in key order, O(log n) */
+size_t avl_node_rank(const struct avl_node *node);
+
+/* returns the node at zero based position, NULL if out of range */
+struct avl_node *avl_node_select(struct avl_root *root, size_t index);
+#endif
+
 
 /*--------------------------------------------------------------------*/
 /* avl node templates                                                 */
@@ -138,6 +330,54 @@ struct avl_node* avl_node_tear(struct avl_root *root, struct avl_node **next);
 	}   while (0)
 
 
+/* searches stepping in lockstep inside avl_node_find_batch */
+#ifndef AVL_FIND_BATCH
+#define AVL_FIND_BATCH 16
+#endif
+
+/* find each of whats[0 .. count - 1] into results[], groups of
+ * AVL_FIND_BATCH searches descend one level at a time and prefetch the
+ * next node, so their cache misses overlap instead of queuing. a group
+ * of one key falls back to avl_node_find */
+#define avl_node_find_batch(root, whats, count, compare_fn, results) do { \
+		struct avl_node *__cur[AVL_FIND_BATCH]; \
+		size_t __base, __size = (size_t)(count); \
+		for (__base = 0; __base < __size; __base += AVL_FIND_BATCH) { \
+			size_t __n = __size - __base, __j; \
+			int __active = 1; \
+			if (__n > AVL_FIND_BATCH) __n = AVL_FIND_BATCH; \
+			if (__n == 1) { \
+				struct avl_node *__r; \
+				avl_node_find(root, (whats)[__base], compare_fn, __r); \
+				(results)[__base] = __r; \
+				continue; \
+			} \
+			for (__j = 0; __j < __n; __j++) { \
+				__cur[__j] = (root)->node; \
+				(results)[__base + __j] = NULL; \
+			} \
+			while (__active) { \
+				__active = 0; \
+				for (__j = 0; __j < __n; __j++) { \
+					struct avl_node *__x = __cur[__j]; \
+					int __hr; \
+					if (__x == NULL) continue; \
+					__hr = (compare_fn)((whats)[__base + __j], __x); \
+					if (__hr == 0) { \
+						(results)[__base + __j] = __x; \
+						__x = NULL; \
+					} \
+					else { \
+						__x = (__hr < 0)? __x->left : __x->right; \
+					} \
+					if (__x) { AVL_PREFETCH(__x); __active = 1; } \
+					__cur[__j] = __x; \
+				} \
+			} \
+		} \
+	}   while (0)
+
+
 #define avl_node_add(root, newnode, compare_fn, duplicate_node) do { \
 		struct avl_node **__link = &((root)->node); \
 		struct avl_node *__parent = NULL; \
@@ -158,6 +398,160 @@ struct avl_node* avl_node_tear(struct avl_root *root, struct avl_node **next);
 	}   while (0)
 
 
+#define avl_node_add_cached(cached, newnode, compare_fn, duplicate_node) \
+	do { \
+		struct avl_node **__link = &((cached)->root.node); \
+		struct avl_node *__parent = NULL; \
+		struct avl_node *__duplicate = NULL; \
+		int __hr = 1; \
+		while (__link[0]) { \
+			__parent = __link[0]; \
+			__hr = (compare_fn)(newnode, __parent); \
+			if (__hr == 0) { __duplicate = __parent; break; } \
+			else if (__hr < 0) { __link = &(__parent->left); } \
+			else { __link = &(__parent->right); } \
+		} \
+		(duplicate_node) = __duplicate; \
+		if (__duplicate == NULL) { \
+			avl_node_link(newnode, __parent, __link); \
+			avl_node_post_insert_cached(newnode, cached); \
+		} \
+	}   while (0)
+
+/* add next to hint, a node in root close to where newnode belongs (eg.
+ * the last one added), hint may be NULL. with AVL_THREADED only the
+ * in-order neighbour of hint on the side of newnode is compared, it is
+ * one load away: if newnode falls between the two it is linked below
+ * one of them, otherwise it descends from the root. without it, parent
+ * links are climbed from hint only until an ancestor bounds the key,
+ * comparing just the ancestors entered from the far side, then it
+ * descends below the nearest node. either way a sorted stream takes
+ * one compare per add */
+#ifdef AVL_THREADED
+#define avl_node_add_hint(root, newnode, hint, compare_fn, duplicate_node) \
+	do { \
+		struct avl_node *__near = (hint); \
+		struct avl_node **__link = &((root)->node); \
+		struct avl_node *__parent = NULL; \
+		struct avl_node *__duplicate = NULL; \
+		int __hr = (__near)? (compare_fn)(newnode, __near) : 1; \
+		if (__near && __hr == 0) __duplicate = __near; \
+		else if (__near) { \
+			struct avl_node *__side = (__hr > 0)? \
+				avl_node_next(__near) : avl_node_prev(__near); \
+			int __c = (__side)? (compare_fn)(newnode, __side) : -__hr; \
+			if (__c == 0) __duplicate = __side; \
+			else if ((__c > 0) != (__hr > 0)) { \
+				__link = (__hr > 0)? &(__near->right) : &(__near->left); \
+				__parent = __near; \
+				if (__link[0]) { \
+					__link = (__hr > 0)? &(__side->left) : &(__side->right); \
+					__parent = __side; \
+				} \
+			} \
+		} \
+		while (__duplicate == NULL && __link[0]) { \
+			__parent = __link[0]; \
+			__hr = (compare_fn)(newnode, __parent); \
+			if (__hr == 0) { __duplicate = __parent; break; } \
+			else if (__hr < 0) { __link = &(__parent->left); } \
+			else { __link = &(__parent->right); } \
+		} \
+		(duplicate_node) = __duplicate; \
+		if (__duplicate == NULL) { \
+			avl_node_link(newnode, __parent, __link); \
+			avl_node_post_insert(newnode, root); \
+		} \
+	}   while (0)
+#else
+#define avl_node_add_hint(root, newnode, hint, compare_fn, duplicate_node) \
+	do { \
+		struct avl_node *__near = (hint); \
+		struct avl_node *__x = __near; \
+		struct avl_node *__p; \
+		struct avl_node **__link = &((root)->node); \
+		struct avl_node *__parent = NULL; \
+		struct avl_node *__duplicate = NULL; \
+		int __hr = (__near)? (compare_fn)(newnode, __near) : 1; \
+		if (__near && __hr == 0) __duplicate = __near; \
+		else if (__near) { \
+			while ((__p = AVL_PARENT(__x)) != NULL) { \
+				if (((__hr > 0)? __p->left : __p->right) == __x) { \
+					int __c = (compare_fn)(newnode, __p); \
+					if (__c == 0) { __duplicate = __p; break; } \
+					if ((__c > 0) != (__hr > 0)) break; \
+					__near = __p; \
+				} \
+				__x = __p; \
+			} \
+			__parent = __near; \
+			__link = (__hr > 0)? &(__near->right) : &(__near->left); \
+		} \
+		while (__duplicate == NULL && __link[0]) { \
+			__parent = __link[0]; \
+			__hr = (compare_fn)(newnode, __parent); \
+			if (__hr == 0) { __duplicate = __parent; break; } \
+			else if (__hr < 0) { __link = &(__parent->left); } \
+			else { __link = &(__parent->right); } \
+		} \
+		(duplicate_node) = __duplicate; \
+		if (__duplicate == NULL) { \
+			avl_node_link(newnode, __parent, __link); \
+			avl_node_post_insert(newnode, root); \
+		} \
+	}   while (0)
+#endif
+
+/* first node not less than what (ceiling) */
+#define avl_node_lower_bound(root, what, compare_fn, res_node) do { \
+		struct avl_node *__n = (root)->node; \
+		(res_node) = NULL; \
+		while (__n) { \
+			int __hr = (compare_fn)(what, __n); \
+			if (__hr == 0) { (res_node) = __n; break; } \
+			else if (__hr < 0) { (res_node) = __n; __n = __n->left; } \
+			else { __n = __n->right; } \
+		} \
+	}   while (0)
+
+/* first node greater than what */
+#define avl_node_upper_bound(root, what, compare_fn, res_node) do { \
+		struct avl_node *__n = (root)->node; \
+		(res_node) = NULL; \
+		while (__n) { \
+			int __hr = (compare_fn)(what, __n); \
+			if (__hr < 0) { (res_node) = __n; __n = __n->left; } \
+			else { __n = __n->right; } \
+		} \
+	}   while (0)
+
+/* last node not greater than what */
+#define avl_node_floor(root, what, compare_fn, res_node) do { \
+		struct avl_node *__n = (root)->node; \
+		(res_node) = NULL; \
+		while (__n) { \
+			int __hr = (compare_fn)(what, __n); \
+			if (__hr == 0) { (res_node) = __n; break; } \
+			else if (__hr < 0) { __n = __n->left; } \
+			else { (res_node) = __n; __n = __n->right; } \
+		} \
+	}   while (0)
+
+static INLINE struct avl_node *
+_avl_node_lower_bound(struct avl_root *root, const void *what,
+		int (*compare_fn)(const void*, const void*)) {
+	struct avl_node *res;
+	avl_node_lower_bound(root, what, compare_fn, res);
+	return res;
+}
+
+/* iterate nodes in [lo, hi): descend once then stream in order */
+#define avl_node_range_foreach(node, root, lo, hi, compare_fn) \
+	for ((node) = _avl_node_lower_bound(root, lo, compare_fn); \
+		(node) != NULL && (compare_fn)(hi, node) > 0; \
+		(node) = avl_node_next(node))
+
+
 /*====================================================================*/
 /* avl_tree - easy interface                                          */
 /*====================================================================*/
@@ -168,6 +562,7 @@ struct avl_tree
 	size_t offset;				/* node offset in user data structure */
 	size_t size;                /* size of user data structure */
 	size_t count;				/* node count */
+	size_t stamp;				/* bumped by every avl_tree_* change */
 	/* returns 0 for equal, -1 for n1 < n2, 1 for n1 > n2 */
 	int (*compare)(const void *n1, const void *n2);
 };
@@ -191,14 +586,214 @@ void *avl_tree_prev(struct avl_tree *tree, void *data);
 void *avl_tree_find(struct avl_tree *tree, const void *data);
 void *avl_tree_nearest(struct avl_tree *tree, const void *data);
 
+/* first data not less than / greater than data, or NULL */
+void *avl_tree_lower_bound(struct avl_tree *tree, const void *data);
+void *avl_tree_upper_bound(struct avl_tree *tree, const void *data);
+
+/* last data not greater than / first data not less than data, or NULL */
+void *avl_tree_floor(struct avl_tree *tree, const void *data);
+void *avl_tree_ceiling(struct avl_tree *tree, const void *data);
+
+/* iterate data in [lo, hi): descend once then stream in order */
+#define avl_tree_range_foreach(data, tree, lo, hi) \
+	for ((data) = avl_tree_lower_bound(tree, lo); \
+		(data) != NULL && (tree)->compare(hi, data) > 0; \
+		(data) = avl_tree_next(tree, data))
+
 /* returns NULL for success, otherwise returns conflict node with same key */
 void *avl_tree_add(struct avl_tree *tree, void *data);
 
+/* add next to hint (data in tree or NULL), see avl_node_add_hint */
+void *avl_tree_add_hint(struct avl_tree *tree, void *data, void *hint);
+
+/* add count data at once in O(m log(n/m + 1)): items are reordered in
+ * place to the distinct keys in sorted order, each the earliest of its
+ * key, followed by the later duplicates in sorted order. results[i] then
+ * receives what avl_tree_add would return for the reordered items[i] if
+ * they were added one by one in their original order, NULL for added.
+ * returns the number added. results is also used as scratch by the
+ * sort, with AVL_THREADED the threads are rebuilt in O(n) */
+size_t avl_tree_add_batch(struct avl_tree *tree, void **items,
+		size_t count, void **results);
+
 void avl_tree_remove(struct avl_tree *tree, void *data);
 void avl_tree_replace(struct avl_tree *tree, void *victim, void *newdata);
 
 void avl_tree_clear(struct avl_tree *tree, void (*destroy)(void *data));
 
+/* remove data in [lo, hi) in O(log n + k): the range is split off, the
+ * rest joined again and the k data removed are reset and passed to
+ * destroy (may be NULL) as avl_tree_clear does, returns k */
+size_t avl_tree_remove_range(struct avl_tree *tree, const void *lo,
+		const void *hi, void (*destroy)(void *data));
+
+#ifdef AVL_ORDER_STATISTIC
+/* number of nodes less than data, which is not required to be in tree */
+size_t avl_tree_rank(struct avl_tree *tree, const void *data);
+
+/* returns the data at zero based position, NULL if out of range */
+void *avl_tree_select(struct avl_tree *tree, size_t index);
+#endif
+
+/* set operations between two trees with the same offset and compare, 
+ * see avl_node_union for details, destroy receives user data */
+void avl_tree_union(struct avl_tree *tree, struct avl_tree *other,
+		void (*destroy)(void *data));
+void avl_tree_intersect(struct avl_tree *tree, struct avl_tree *other,
+		void (*destroy)(void *data));
+void avl_tree_difference(struct avl_tree *tree, struct avl_tree *other,
+		void (*destroy)(void *data));
+void avl_tree_setop(struct avl_tree *tree, struct avl_tree *other,
+		int which, void (*destroy)(void *data),
+		const struct avl_fork *fork);
+
+/* split in O(log n) plus walking the smaller part for the counts: data
+ * less than data go to left and the others to right, tree may be the
+ * same as either, left and right need the same offset and compare */
+void avl_tree_split(struct avl_tree *tree, const void *data,
+		struct avl_tree *left, struct avl_tree *right);
+
+/* concatenate left and right into tree, data in left must be less,
+ * tree may be the same as either */
+void avl_tree_concat(struct avl_tree *tree, struct avl_tree *left,
+		struct avl_tree *right);
+
+
+/*====================================================================*/
+/* typed avl_tree - inlined comparator                                */
+/*====================================================================*/
+
+/* three way compare without branches, for integer keys */
+#define AVL_KEY_COMPARE(a, b) (((a) > (b)) - ((a) < (b)))
+
+/* instantiate a typed avl_tree interface for TYPE embedding avl_node as
+ * MEMBER, ordered by CMP(key1, key2) on its field KEY. the comparator is
+ * expanded inline instead of called through tree->compare, the tree is
+ * still an avl_tree and may be passed to every avl_tree_* function:
+ *
+ * struct mynode { struct avl_node node; int key; ... };
+ * AVL_DEFINE_TREE(mytree, struct mynode, node, key, AVL_KEY_COMPARE)
+ *
+ * mytree_init(&tree);
+ * mytree_add(&tree, x);     // same as avl_tree_add(&tree, x)
+ *
+ * PREFIX_init, _find, _nearest, _lower_bound, _upper_bound, _floor,
+ * _ceiling, _add, _remove, _first, _last, _next, _prev, _clear and
+ * PREFIX_compare for the generic path are defined. */
+#define AVL_DEFINE_TREE(PREFIX, TYPE, MEMBER, KEY, CMP) \
+static inline int PREFIX##_compare(const void *__d1, const void *__d2) { \
+	return CMP(((const TYPE*)__d1)->KEY, ((const TYPE*)__d2)->KEY); \
+} \
+static inline void PREFIX##_init(struct avl_tree *tree) { \
+	avl_tree_init(tree, PREFIX##_compare, sizeof(TYPE), \
+			AVL_OFFSET(TYPE, MEMBER)); \
+} \
+static inline TYPE *PREFIX##_entry(struct avl_node *node) { \
+	return (node)? AVL_ENTRY(node, TYPE, MEMBER) : NULL; \
+} \
+static inline TYPE *PREFIX##_find(struct avl_tree *tree, \
+		const TYPE *what) { \
+	struct avl_node *__n = tree->root.node; \
+	while (__n) { \
+		int __hr = CMP(what->KEY, AVL_ENTRY(__n, TYPE, MEMBER)->KEY); \
+		if (__hr == 0) return AVL_ENTRY(__n, TYPE, MEMBER); \
+		__n = (__hr < 0)? __n->left : __n->right; \
+	} \
+	return NULL; \
+} \
+static inline TYPE *PREFIX##_nearest(struct avl_tree *tree, \
+		const TYPE *what) { \
+	struct avl_node *__n = tree->root.node, *__p = NULL; \
+	while (__n) { \
+		int __hr = CMP(what->KEY, AVL_ENTRY(__n, TYPE, MEMBER)->KEY); \
+		__p = __n; \
+		if (__hr == 0) break; \
+		__n = (__hr < 0)? __n->left : __n->right; \
+	} \
+	return PREFIX##_entry(__p); \
+} \
+static inline TYPE *PREFIX##_lower_bound(struct avl_tree *tree, \
+		const TYPE *what) { \
+	struct avl_node *__n = tree->root.node, *__p = NULL; \
+	while (__n) { \
+		int __hr = CMP(what->KEY, AVL_ENTRY(__n, TYPE, MEMBER)->KEY); \
+		if (__hr == 0) return AVL_ENTRY(__n, TYPE, MEMBER); \
+		if (__hr < 0) __p = __n; \
+		__n = (__hr < 0)? __n->left : __n->right; \
+	} \
+	return PREFIX##_entry(__p); \
+} \
+static inline TYPE *PREFIX##_upper_bound(struct avl_tree *tree, \
+		const TYPE *what) { \
+	struct avl_node *__n = tree->root.node, *__p = NULL; \
+	while (__n) { \
+		int __hr = CMP(what->KEY, AVL_ENTRY(__n, TYPE, MEMBER)->KEY); \
+		if (__hr < 0) __p = __n; \
+		__n = (__hr < 0)? __n->left : __n->right; \
+	} \
+	return PREFIX##_entry(__p); \
+} \
+static inline TYPE *PREFIX##_floor(struct avl_tree *tree, \
+		const TYPE *what) { \
+	struct avl_node *__n = tree->root.node, *__p = NULL; \
+	while (__n) { \
+		int __hr = CMP(what->KEY, AVL_ENTRY(__n, TYPE, MEMBER)->KEY); \
+		if (__hr == 0) return AVL_ENTRY(__n, TYPE, MEMBER); \
+		if (__hr > 0) __p = __n; \
+		__n = (__hr < 0)? __n->left : __n->right; \
+	} \
+	return PREFIX##_entry(__p); \
+} \
+static inline TYPE *PREFIX##_ceiling(struct avl_tree *tree, \
+		const TYPE *what) { \
+	return PREFIX##_lower_bound(tree, what); \
+} \
+static inline TYPE *PREFIX##_add(struct avl_tree *tree, TYPE *data) { \
+	struct avl_node **__link = &tree->root.node, *__parent = NULL; \
+	while (__link[0]) { \
+		int __hr; \
+		__parent = __link[0]; \
+		__hr = CMP(data->KEY, AVL_ENTRY(__parent, TYPE, MEMBER)->KEY); \
+		if (__hr == 0) return AVL_ENTRY(__parent, TYPE, MEMBER); \
+		__link = (__hr < 0)? &(__parent->left) : &(__parent->right); \
+	} \
+	avl_node_link(&data->MEMBER, __parent, __link); \
+	avl_node_post_insert(&data->MEMBER, &tree->root); \
+	tree->count++; \
+	tree->stamp++; \
+	return NULL; \
+} \
+static inline void PREFIX##_remove(struct avl_tree *tree, TYPE *data) { \
+	if (!avl_node_empty(&data->MEMBER)) { \
+		avl_node_erase(&data->MEMBER, &tree->root); \
+		avl_node_init(&data->MEMBER); \
+		tree->count--; \
+		tree->stamp++; \
+	} \
+} \
+static inline TYPE *PREFIX##_first(struct avl_tree *tree) { \
+	return PREFIX##_entry(avl_node_first(&tree->root)); \
+} \
+static inline TYPE *PREFIX##_last(struct avl_tree *tree) { \
+	return PREFIX##_entry(avl_node_last(&tree->root)); \
+} \
+static inline TYPE *PREFIX##_next(TYPE *data) { \
+	return PREFIX##_entry(avl_node_next(&data->MEMBER)); \
+} \
+static inline TYPE *PREFIX##_prev(TYPE *data) { \
+	return PREFIX##_entry(avl_node_prev(&data->MEMBER)); \
+} \
+static inline void PREFIX##_clear(struct avl_tree *tree, \
+		void (*destroy)(TYPE *data)) { \
+	struct avl_node *__next = NULL, *__node; \
+	while ((__node = avl_node_tear(&tree->root, &__next)) != NULL) { \
+		avl_node_init(__node); \
+		tree->count--; \
+		if (destroy) destroy(AVL_ENTRY(__node, TYPE, MEMBER)); \
+	} \
+	tree->stamp++; \
+}
+
 
 
 
@@ -0,0 +1,864 @@
+//=====================================================================
+//
+// avlmini.hpp - avl::map / avl::set, std::map like containers
+//
+// NOTE:
+// header only templates over avlmini's avl_node: lookups descend with
+// the comparator inlined, insert and erase rebalance with avlmini.c,
+// which must be linked together with avlhash.c for the node pool.
+// requires c++11.
+//
+//     avl::map<int, std::string> m;
+//     m.try_emplace(1, "one");
+//     auto nh = m.extract(1);      // node handle, no allocation
+//     other.insert(std::move(nh));
+//
+// nodes come from avl::fastbin_allocator by default: a free list over
+// pages of avl_fastbin, owned by the container and released with it.
+// a node handle moves to another container without copying only if
+// their allocators are equal, eg. other was made with a.get_allocator(),
+// otherwise the value is moved into a new node. pass std::allocator as
+// Alloc to use the heap instead.
+//
+//=====================================================================
+#ifndef _AVLMINI_HPP__
+#define _AVLMINI_HPP__
+
+#include "avlmini.h"
+#include "avlhash.h"
+
+#include <stddef.h>
+#include <new>
+#include <memory>
+#include <utility>
+#include <iterator>
+#include <functional>
+#include <algorithm>
+#include <tuple>
+#include <stdexcept>
+#include <type_traits>
+#include <initializer_list>
+#include <vector>
+
+
+namespace avl {
+
+namespace detail {
+	struct fastbin_pool { struct avl_fastbin fb; size_t refs; };
+}
+
+//---------------------------------------------------------------------
+// fastbin_allocator: single objects come from an avl_fastbin pool made
+// on the first allocation. copies, also those rebound to another type,
+// share the pool and compare equal, the pages are freed with the last
+// of them. a moved-from allocator starts a new pool. the pool is not
+// locked, its sharers must stay in one thread
+//---------------------------------------------------------------------
+template <class T>
+class fastbin_allocator
+{
+	template <class U> friend class fastbin_allocator;
+
+public:
+	typedef T value_type;
+	typedef std::true_type propagate_on_container_move_assignment;
+	typedef std::true_type propagate_on_container_swap;
+
+	fastbin_allocator() noexcept: pool(NULL) {}
+	fastbin_allocator(const fastbin_allocator &a) noexcept: pool(a.pool) {
+		if (pool) pool->refs++;
+	}
+	fastbin_allocator(fastbin_allocator &&a) noexcept: pool(a.pool) {
+		a.pool = NULL;
+	}
+	template <class U>
+	fastbin_allocator(const fastbin_allocator<U> &a) noexcept: pool(a.pool) {
+		if (pool) pool->refs++;
+	}
+	~fastbin_allocator() { release(); }
+
+	fastbin_allocator &operator=(const fastbin_allocator &a) noexcept {
+		if (a.pool) a.pool->refs++;
+		release();
+		pool = a.pool;
+		return *this;
+	}
+	fastbin_allocator &operator=(fastbin_allocator &&a) noexcept {
+		if (this != &a) {
+			release();
+			pool = a.pool;
+			a.pool = NULL;
+		}
+		return *this;
+	}
+
+	// a copied container gets a pool of its own
+	fastbin_allocator select_on_container_copy_construction() const {
+		return fastbin_allocator();
+	}
+
+	T *allocate(size_t n) {
+		if (pool == NULL && n == 1) {
+			pool = new Pool;
+			avl_fastbin_init(&pool->fb, sizeof(T));
+			pool->refs = 1;
+		}
+		if (!pooled(n)) {
+			return static_cast<T*>(::operator new(n * sizeof(T)));
+		}
+		void *ptr = avl_fastbin_new(&pool->fb);
+		if (ptr == NULL) throw std::bad_alloc();
+		return static_cast<T*>(ptr);
+	}
+
+	void deallocate(T *ptr, size_t n) noexcept {
+		if (pooled(n)) avl_fastbin_del(&pool->fb, ptr);
+		else ::operator delete(ptr);
+	}
+
+	template <class U>
+	bool operator==(const fastbin_allocator<U> &a) const noexcept {
+		return pool == a.pool;
+	}
+	template <class U>
+	bool operator!=(const fastbin_allocator<U> &a) const noexcept {
+		return pool != a.pool;
+	}
+
+private:
+	typedef detail::fastbin_pool Pool;
+	Pool *pool;
+
+	// the pool is sized by the type allocating first, pages are
+	// aligned to 16 and objects to a pointer
+	bool pooled(size_t n) const noexcept {
+		return n == 1 && pool != NULL && sizeof(T) <= pool->fb.obj_size &&
+			alignof(T) <= sizeof(void*);
+	}
+
+	void release() noexcept {
+		if (pool && --pool->refs == 0) {
+			avl_fastbin_destroy(&pool->fb);
+			delete pool;
+		}
+		pool = NULL;
+	}
+};
+
+
+namespace detail {
+
+//---------------------------------------------------------------------
+// node: avl_node first, so node and avl_node pointers convert
+//---------------------------------------------------------------------
+template <class V>
+struct node
+{
+	struct avl_node avl;
+	alignas(V) unsigned char storage[sizeof(V)];
+
+	V &value() { return *reinterpret_cast<V*>(storage); }
+	static node *cast(struct avl_node *n) {
+		return reinterpret_cast<node*>(n);
+	}
+};
+
+template <class K, class V>
+struct key_of_pair {
+	static const K &get(const V &v) { return v.first; }
+};
+
+template <class K>
+struct key_of_self {
+	static const K &get(const K &v) { return v; }
+};
+
+
+//---------------------------------------------------------------------
+// bidirectional iterator, decrementing end() needs the root
+//---------------------------------------------------------------------
+template <class V, bool CONST>
+class iterator
+{
+public:
+	typedef std::bidirectional_iterator_tag iterator_category;
+	typedef V value_type;
+	typedef ptrdiff_t difference_type;
+	typedef typename std::conditional<CONST, const V*, V*>::type pointer;
+	typedef typename std::conditional<CONST, const V&, V&>::type reference;
+
+	iterator(): n(NULL), root(NULL) {}
+	iterator(struct avl_node *n, struct avl_root *root): n(n), root(root) {}
+	template <bool C, class = typename std::enable_if<CONST && !C>::type>
+	iterator(const iterator<V, C> &it): n(it.n), root(it.root) {}
+
+	reference operator*() const { return node<V>::cast(n)->value(); }
+	pointer operator->() const { return &node<V>::cast(n)->value(); }
+
+	iterator &operator++() { n = avl_node_next(n); return *this; }
+	iterator &operator--() {
+		n = (n)? avl_node_prev(n) : avl_node_last(root);
+		return *this;
+	}
+	iterator operator++(int) { iterator it = *this; ++*this; return it; }
+	iterator operator--(int) { iterator it = *this; --*this; return it; }
+
+	template <bool C>
+	bool operator==(const iterator<V, C> &it) const { return n == it.n; }
+	template <bool C>
+	bool operator!=(const iterator<V, C> &it) const { return n != it.n; }
+
+	struct avl_node *n;
+	struct avl_root *root;
+};
+
+
+//---------------------------------------------------------------------
+// node handle, as std::map::node_type: key() and mapped() for maps,
+// value() for sets
+//---------------------------------------------------------------------
+template <class V, class NodeAlloc>
+class node_handle
+{
+public:
+	typedef V value_type;
+	typedef NodeAlloc allocator_type;
+
+	node_handle() noexcept: ptr(NULL) {}
+	node_handle(node_handle &&nh) noexcept:
+		ptr(nh.ptr), alloc(std::move(nh.alloc)) { nh.ptr = NULL; }
+	~node_handle() { reset(); }
+
+	node_handle &operator=(node_handle &&nh) noexcept {
+		if (this != &nh) {
+			reset();
+			ptr = nh.ptr;
+			alloc = std::move(nh.alloc);
+			nh.ptr = NULL;
+		}
+		return *this;
+	}
+
+	bool empty() const noexcept { return ptr == NULL; }
+	explicit operator bool() const noexcept { return ptr != NULL; }
+	allocator_type get_allocator() const { return alloc; }
+
+	value_type &value() const { return ptr->value(); }
+
+	template <class U = V>
+	typename std::remove_const<typename U::first_type>::type &key() const {
+		typedef typename std::remove_const<typename U::first_type>::type K;
+		return const_cast<K&>(ptr->value().first);
+	}
+
+	template <class U = V>
+	typename U::second_type &mapped() const { return ptr->value().second; }
+
+	void swap(node_handle &nh) noexcept {
+		std::swap(ptr, nh.ptr);
+		std::swap(alloc, nh.alloc);
+	}
+
+	// used by the containers only
+	node_handle(node<V> *ptr, const NodeAlloc &alloc):
+		ptr(ptr), alloc(alloc) {}
+	node<V> *release() noexcept { node<V> *p = ptr; ptr = NULL; return p; }
+
+private:
+	node<V> *ptr;
+	NodeAlloc alloc;
+
+	void reset() noexcept {
+		if (ptr) {
+			ptr->value().~V();
+			std::allocator_traits<NodeAlloc>::deallocate(alloc, ptr, 1);
+			ptr = NULL;
+		}
+	}
+};
+
+template <class It, class NH>
+struct insert_return
+{
+	It position;
+	bool inserted;
+	NH node;
+};
+
+
+//---------------------------------------------------------------------
+// tree: everything avl::map and avl::set have in common, iterators
+// of a set are all const
+//---------------------------------------------------------------------
+template <class K, class V, class KeyOf, class Compare, class Alloc,
+	bool CONST>
+class tree
+{
+protected:
+	typedef node<V> node_t;
+	typedef typename std::allocator_traits<Alloc>::template
+		rebind_alloc<node_t> node_allocator;
+	typedef std::allocator_traits<node_allocator> node_traits;
+
+public:
+	typedef K key_type;
+	typedef V value_type;
+	typedef size_t size_type;
+	typedef ptrdiff_t difference_type;
+	typedef Compare key_compare;
+	typedef Alloc allocator_type;
+	typedef V &reference;
+	typedef const V &const_reference;
+	typedef V *pointer;
+	typedef const V *const_pointer;
+	typedef detail::iterator<V, CONST> iterator;
+	typedef detail::iterator<V, true> const_iterator;
+	typedef std::reverse_iterator<iterator> reverse_iterator;
+	typedef std::reverse_iterator<const_iterator> const_reverse_iterator;
+	typedef node_handle<V, node_allocator> node_type;
+	typedef insert_return<iterator, node_type> insert_return_type;
+
+	tree(): _count(0) { _root.node = NULL; }
+	explicit tree(const Compare &comp, const Alloc &alloc = Alloc()):
+		_count(0), _comp(comp), _alloc(alloc) { _root.node = NULL; }
+	explicit tree(const Alloc &alloc): _count(0), _alloc(alloc) {
+		_root.node = NULL;
+	}
+	template <class It>
+	tree(It first, It last, const Compare &comp = Compare(),
+			const Alloc &alloc = Alloc()): tree(comp, alloc) {
+		insert(first, last);
+	}
+	tree(std::initializer_list<V> init, const Compare &comp = Compare(),
+			const Alloc &alloc = Alloc()): tree(comp, alloc) {
+		insert(init.begin(), init.end());
+	}
+	tree(const tree &t): _count(0), _comp(t._comp),
+		_alloc(node_traits::select_on_container_copy_construction(t._alloc)) {
+		_root.node = NULL;
+		copy_from(t);
+	}
+	tree(tree &&t) noexcept: _root(t._root), _count(t._count),
+		_comp(std::move(t._comp)), _alloc(std::move(t._alloc)) {
+		t._root.node = NULL;
+		t._count = 0;
+	}
+	~tree() { clear(); }
+
+	tree &operator=(const tree &t) {
+		if (this != &t) {
+			clear();
+			_comp = t._comp;
+			copy_from(t);
+		}
+		return *this;
+	}
+	tree &operator=(tree &&t) noexcept {
+		if (this != &t) {
+			clear();
+			_root = t._root;
+			_count = t._count;
+			_comp = std::move(t._comp);
+			_alloc = std::move(t._alloc);
+			t._root.node = NULL;
+			t._count = 0;
+		}
+		return *this;
+	}
+	tree &operator=(std::initializer_list<V> init) {
+		clear();
+		insert(init.begin(), init.end());
+		return *this;
+	}
+
+	allocator_type get_allocator() const { return allocator_type(_alloc); }
+	key_compare key_comp() const { return _comp; }
+
+	iterator begin() noexcept { return make(avl_node_first(&_root)); }
+	iterator end() noexcept { return make(NULL); }
+	const_iterator begin() const noexcept {
+		return cmake(avl_node_first(root()));
+	}
+	const_iterator end() const noexcept { return cmake(NULL); }
+	const_iterator cbegin() const noexcept { return begin(); }
+	const_iterator cend() const noexcept { return end(); }
+	reverse_iterator rbegin() noexcept { return reverse_iterator(end()); }
+	reverse_iterator rend() noexcept { return reverse_iterator(begin()); }
+	const_reverse_iterator rbegin() const noexcept {
+		return const_reverse_iterator(end());
+	}
+	const_reverse_iterator rend() const noexcept {
+		return const_reverse_iterator(begin());
+	}
+	const_reverse_iterator crbegin() const noexcept { return rbegin(); }
+	const_reverse_iterator crend() const noexcept { return rend(); }
+
+	bool empty() const noexcept { return _count == 0; }
+	size_type size() const noexcept { return _count; }
+	size_type max_size() const noexcept {
+		return node_traits::max_size(_alloc);
+	}
+
+	// O(n), nodes are torn down without rebalancing
+	void clear() noexcept {
+		struct avl_node *next = NULL, *n;
+		while ((n = avl_node_tear(&_root, &next)) != NULL) {
+			destroy(node_t::cast(n));
+		}
+		_count = 0;
+	}
+
+	std::pair<iterator, bool> insert(const V &v) { return emplace(v); }
+	std::pair<iterator, bool> insert(V &&v) { return emplace(std::move(v)); }
+	iterator insert(const_iterator hint, const V &v) {
+		return emplace_hint(hint, v);
+	}
+	iterator insert(const_iterator hint, V &&v) {
+		return emplace_hint(hint, std::move(v));
+	}
+	template <class It>
+	void insert(It first, It last) {
+		for (; first != last; ++first) emplace_hint(end(), *first);
+	}
+	void insert(std::initializer_list<V> init) {
+		insert(init.begin(), init.end());
+	}
+
+	insert_return_type insert(node_type &&nh) {
+		insert_return_type r;
+		r.inserted = false;
+		if (nh.empty()) {
+			r.position = end();
+			return r;
+		}
+		struct avl_node *parent, **link;
+		struct avl_node *dup = locate(KeyOf::get(nh.value()), parent, link);
+		if (dup) {
+			r.position = make(dup);
+			r.node = std::move(nh);
+		}	else {
+			r.position = make(link_node(adopt(nh), parent, link));
+			r.inserted = true;
+		}
+		return r;
+	}
+	iterator insert(const_iterator hint, node_type &&nh) {
+		if (nh.empty()) return end();
+		struct avl_node *parent, **link;
+		const K &k = KeyOf::get(nh.value());
+		struct avl_node *dup = locate_hint(k, hint.n, parent, link);
+		if (dup) return make(dup);
+		return make(link_node(adopt(nh), parent, link));
+	}
+
+	template <class... Args>
+	std::pair<iterator, bool> emplace(Args&&... args) {
+		node_t *n = create(std::forward<Args>(args)...);
+		struct avl_node *parent, **link;
+		struct avl_node *dup = locate(KeyOf::get(n->value()), parent, link);
+		if (dup) {
+			destroy(n);
+			return std::pair<iterator, bool>(make(dup), false);
+		}
+		return std::pair<iterator, bool>(make(link_node(n, parent, link)),
+				true);
+	}
+
+	template <class... Args>
+	iterator emplace_hint(const_iterator hint, Args&&... args) {
+		node_t *n = create(std::forward<Args>(args)...);
+		struct avl_node *parent, **link;
+		const K &k = KeyOf::get(n->value());
+		struct avl_node *dup = locate_hint(k, hint.n, parent, link);
+		if (dup) {
+			destroy(n);
+			return make(dup);
+		}
+		return make(link_node(n, parent, link));
+	}
+
+	iterator erase(const_iterator pos) {
+		iterator next = make(avl_node_next(pos.n));
+		unlink(pos.n);
+		destroy(node_t::cast(pos.n));
+		return next;
+	}
+	iterator erase(const_iterator first, const_iterator last) {
+		while (first != last) first = erase(first);
+		return make(last.n);
+	}
+	size_type erase(const K &k) {
+		struct avl_node *n = find_node(k);
+		if (n == NULL) return 0;
+		erase(cmake(n));
+		return 1;
+	}
+
+	// unlink without freeing, the node goes with the handle
+	node_type extract(const_iterator pos) {
+		unlink(pos.n);
+		return node_type(node_t::cast(pos.n), _alloc);
+	}
+	node_type extract(const K &k) {
+		struct avl_node *n = find_node(k);
+		if (n == NULL) return node_type();
+		return extract(cmake(n));
+	}
+
+	void swap(tree &t) noexcept {
+		std::swap(_root, t._root);
+		std::swap(_count, t._count);
+		std::swap(_comp, t._comp);
+		std::swap(_alloc, t._alloc);
+	}
+
+	iterator find(const K &k) { return make(find_node(k)); }
+	const_iterator find(const K &k) const { return cmake(find_node(k)); }
+	size_type count(const K &k) const { return find_node(k)? 1 : 0; }
+	bool contains(const K &k) const { return find_node(k) != NULL; }
+
+	iterator lower_bound(const K &k) { return make(lower_node(k)); }
+	const_iterator lower_bound(const K &k) const {
+		return cmake(lower_node(k));
+	}
+	iterator upper_bound(const K &k) { return make(upper_node(k)); }
+	const_iterator upper_bound(const K &k) const {
+		return cmake(upper_node(k));
+	}
+	std::pair<iterator, iterator> equal_range(const K &k) {
+		return std::pair<iterator, iterator>(lower_bound(k), upper_bound(k));
+	}
+	std::pair<const_iterator, const_iterator> equal_range(const K &k) const {
+		return std::pair<const_iterator, const_iterator>(
+				lower_bound(k), upper_bound(k));
+	}
+
+protected:
+	struct avl_root _root;
+	size_t _count;
+	Compare _comp;
+	node_allocator _alloc;
+
+	struct avl_root *root() const {
+		return const_cast<struct avl_root*>(&_root);
+	}
+	iterator make(struct avl_node *n) { return iterator(n, &_root); }
+	const_iterator cmake(struct avl_node *n) const {
+		return const_iterator(n, root());
+	}
+	static const K &key(struct avl_node *n) {
+		return KeyOf::get(node_t::cast(n)->value());
+	}
+
+	template <class... Args>
+	node_t *create(Args&&... args) {
+		node_t *n = node_traits::allocate(_alloc, 1);
+		try {
+			::new (static_cast<void*>(n->storage))
+				V(std::forward<Args>(args)...);
+		}
+		catch (...) {
+			node_traits::deallocate(_alloc, n, 1);
+			throw;
+		}
+		return n;
+	}
+
+	void destroy(node_t *n) noexcept {
+		n->value().~V();
+		node_traits::deallocate(_alloc, n, 1);
+	}
+
+	// a node from another allocator is freed by the handle
+	node_t *adopt(node_type &nh) {
+		if (nh.get_allocator() == _alloc) return nh.release();
+		node_t *n = create(std::move(nh.value()));
+		nh = node_type();
+		return n;
+	}
+
+	struct avl_node *link_node(node_t *n, struct avl_node *parent,
+			struct avl_node **link) {
+		avl_node_link(&n->avl, parent, link);
+		avl_node_post_insert(&n->avl, &_root);
+		_count++;
+		return &n->avl;
+	}
+
+	void unlink(struct avl_node *n) {
+		avl_node_erase(n, &_root);
+		_count--;
+	}
+
+	// the child is picked by masking rather than by a branch, which is
+	// mispredicted half of the time on random keys
+	template <class P>
+	static P pick(bool c, P x, P y) {
+		size_t mask = (size_t)0 - (size_t)c;
+		return (P)(((size_t)x & mask) | ((size_t)y & ~mask));
+	}
+
+	// one compare per level: remember the last node not greater than k,
+	// it is the only one that can be equal
+	struct avl_node *locate(const K &k, struct avl_node *&parent,
+			struct avl_node **&link) {
+		struct avl_node *cand = NULL;
+		parent = NULL;
+		link = &_root.node;
+		while (link[0]) {
+			parent = link[0];
+			bool less = _comp(k, key(parent));
+			cand = pick(less, cand, parent);
+			link = pick(less, &parent->left, &parent->right);
+		}
+		return (cand && !_comp(key(cand), k))? cand : NULL;
+	}
+
+	// link next to hint when k falls between hint and its neighbour,
+	// otherwise search from the root
+	struct avl_node *locate_hint(const K &k, struct avl_node *hint,
+			struct avl_node *&parent, struct avl_node **&link) {
+		if (hint == NULL) {
+			struct avl_node *last = avl_node_last(&_root);
+			if (last && _comp(key(last), k)) {
+				parent = last;
+				link = &last->right;
+				return NULL;
+			}
+		}
+		else if (_comp(k, key(hint))) {
+			struct avl_node *prev = avl_node_prev(hint);
+			if (prev == NULL || _comp(key(prev), k)) {
+				if (hint->left == NULL) {
+					parent = hint;
+					link = &hint->left;
+				}	else {
+					parent = prev;
+					link = &prev->right;
+				}
+				return NULL;
+			}
+		}
+		else if (_comp(key(hint), k)) {
+			struct avl_node *next = avl_node_next(hint);
+			if (next == NULL || _comp(k, key(next))) {
+				if (hint->right == NULL) {
+					parent = hint;
+					link = &hint->right;
+				}	else {
+					parent = next;
+					link = &next->left;
+				}
+				return NULL;
+			}
+		}
+		else {
+			return hint;
+		}
+		return locate(k, parent, link);
+	}
+
+	struct avl_node *find_node(const K &k) const {
+		struct avl_node *n = _root.node;
+		while (n) {
+			bool less = _comp(k, key(n));
+			struct avl_node *next = pick(less, n->left, n->right);
+			if (!less && !_comp(key(n), k)) break;
+			n = next;
+		}
+		return n;
+	}
+
+	struct avl_node *lower_node(const K &k) const {
+		struct avl_node *n = _root.node, *res = NULL;
+		while (n) {
+			bool less = _comp(key(n), k);
+			res = pick(less, res, n);
+			n = pick(less, n->right, n->left);
+		}
+		return res;
+	}
+
+	struct avl_node *upper_node(const K &k) const {
+		struct avl_node *n = _root.node, *res = NULL;
+		while (n) {
+			bool less = _comp(k, key(n));
+			res = pick(less, n, res);
+			n = pick(less, n->left, n->right);
+		}
+		return res;
+	}
+
+	// clone in order then build the shape in O(n), no compare made
+	void copy_from(const tree &t) {
+		std::vector<struct avl_node*> nodes;
+		nodes.reserve(t._count);
+		try {
+			for (const_iterator it = t.begin(); it != t.end(); ++it) {
+				nodes.push_back(&create(*it)->avl);
+			}
+		}
+		catch (...) {
+			for (size_t i = 0; i < nodes.size(); i++) {
+				destroy(node_t::cast(nodes[i]));
+			}
+			throw;
+		}
+		if (!nodes.empty()) {
+			avl_node_build(&_root, &nodes[0], nodes.size());
+		}
+		_count = nodes.size();
+	}
+};
+
+template <class K, class V, class KeyOf, class C, class A, bool T>
+bool operator==(const tree<K, V, KeyOf, C, A, T> &x,
+		const tree<K, V, KeyOf, C, A, T> &y) {
+	return x.size() == y.size() && std::equal(x.begin(), x.end(), y.begin());
+}
+
+template <class K, class V, class KeyOf, class C, class A, bool T>
+bool operator!=(const tree<K, V, KeyOf, C, A, T> &x,
+		const tree<K, V, KeyOf, C, A, T> &y) {
+	return !(x == y);
+}
+
+template <class K, class V, class KeyOf, class C, class A, bool T>
+bool operator<(const tree<K, V, KeyOf, C, A, T> &x,
+		const tree<K, V, KeyOf, C, A, T> &y) {
+	return std::lexicographical_compare(x.begin(), x.end(),
+			y.begin(), y.end());
+}
+
+}	// namespace detail
+
+
+//---------------------------------------------------------------------
+// avl::map
+//---------------------------------------------------------------------
+template <class K, class V, class Compare = std::less<K>,
+	class Alloc = fastbin_allocator<std::pair<const K, V> > >
+class map: public detail::tree<K, std::pair<const K, V>,
+	detail::key_of_pair<K, std::pair<const K, V> >, Compare, Alloc, false>
+{
+	typedef detail::tree<K, std::pair<const K, V>,
+		detail::key_of_pair<K, std::pair<const K, V> >, Compare, Alloc,
+		false> base;
+
+public:
+	typedef V mapped_type;
+	typedef typename base::iterator iterator;
+	typedef typename base::const_iterator const_iterator;
+
+	using base::base;
+	map() {}
+
+	map &operator=(std::initializer_list<typename base::value_type> init) {
+		base::operator=(init);
+		return *this;
+	}
+
+	V &at(const K &k) {
+		iterator it = this->find(k);
+		if (it == this->end()) throw std::out_of_range("avl::map::at");
+		return it->second;
+	}
+	const V &at(const K &k) const {
+		const_iterator it = this->find(k);
+		if (it == this->end()) throw std::out_of_range("avl::map::at");
+		return it->second;
+	}
+
+	V &operator[](const K &k) { return try_emplace(k).first->second; }
+	V &operator[](K &&k) { return try_emplace(std::move(k)).first->second; }
+
+	// nothing is constructed if k is already there
+	template <class... Args>
+	std::pair<iterator, bool> try_emplace(const K &k, Args&&... args) {
+		return try_emplace_key(k, std::forward<Args>(args)...);
+	}
+	template <class... Args>
+	std::pair<iterator, bool> try_emplace(K &&k, Args&&... args) {
+		return try_emplace_key(std::move(k), std::forward<Args>(args)...);
+	}
+	template <class... Args>
+	iterator try_emplace(const_iterator hint, const K &k, Args&&... args) {
+		(void)hint;
+		return try_emplace(k, std::forward<Args>(args)...).first;
+	}
+	template <class... Args>
+	iterator try_emplace(const_iterator hint, K &&k, Args&&... args) {
+		(void)hint;
+		return try_emplace(std::move(k), std::forward<Args>(args)...).first;
+	}
+
+	template <class M>
+	std::pair<iterator, bool> insert_or_assign(const K &k, M &&obj) {
+		std::pair<iterator, bool> r = try_emplace(k, std::forward<M>(obj));
+		if (!r.second) r.first->second = std::forward<M>(obj);
+		return r;
+	}
+	template <class M>
+	std::pair<iterator, bool> insert_or_assign(K &&k, M &&obj) {
+		std::pair<iterator, bool> r = try_emplace(std::move(k),
+				std::forward<M>(obj));
+		if (!r.second) r.first->second = std::forward<M>(obj);
+		return r;
+	}
+
+	using base::insert;
+	template <class P, class = typename std::enable_if<
+		std::is_constructible<typename base::value_type, P&&>::value>::type>
+	std::pair<iterator, bool> insert(P &&v) {
+		return this->emplace(std::forward<P>(v));
+	}
+
+private:
+	template <class KK, class... Args>
+	std::pair<iterator, bool> try_emplace_key(KK &&k, Args&&... args) {
+		struct avl_node *parent, **link;
+		struct avl_node *dup = this->locate(k, parent, link);
+		if (dup) return std::pair<iterator, bool>(this->make(dup), false);
+		typename base::node_t *n = this->create(std::piecewise_construct,
+				std::forward_as_tuple(std::forward<KK>(k)),
+				std::forward_as_tuple(std::forward<Args>(args)...));
+		return std::pair<iterator, bool>(
+				this->make(this->link_node(n, parent, link)), true);
+	}
+};
+
+
+//---------------------------------------------------------------------
+// avl::set
+//---------------------------------------------------------------------
+template <class K, class Compare = std::less<K>,
+	class Alloc = fastbin_allocator<K> >
+class set: public detail::tree<K, K, detail::key_of_self<K>,
+	Compare, Alloc, true>
+{
+	typedef detail::tree<K, K, detail::key_of_self<K>, Compare,
+		Alloc, true> base;
+
+public:
+	using base::base;
+	set() {}
+
+	set &operator=(std::initializer_list<K> init) {
+		base::operator=(init);
+		return *this;
+	}
+};
+
+
+template <class K, class V, class C, class A>
+void swap(map<K, V, C, A> &x, map<K, V, C, A> &y) noexcept { x.swap(y); }
+
+template <class K, class C, class A>
+void swap(set<K, C, A> &x, set<K, C, A> &y) noexcept { x.swap(y); }
+
+}	// namespace avl
+
+
+#endif
+
+
@@ -0,0 +1,330 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "avlpersist.h"
+
+
+/*====================================================================*/
+/* node references                                                    */
+/*====================================================================*/
+#define AVL_PHEIGHT(node) ((node)? (node)->height : 0)
+#define AVL_PMAX(x, y) (((x) > (y))? (x) : (y))
+
+/* spare nodes kept by the writer after an old version is freed */
+#define AVL_PSPARE_MAX 1024
+
+/* an update allocates at most one node per level for the path and two
+ * more for a double rotation, so reserve them before touching anything
+ * and an out of memory leaves the tree as it was */
+static int _avl_ptree_reserve(struct avl_ptree *tree)
+{
+	size_t need = 3 * (size_t)(AVL_PHEIGHT(tree->root) + 2);
+	while (tree->nspare < need) {
+		struct avl_pnode *node = (struct avl_pnode*)
+			malloc(sizeof(struct avl_pnode) + tree->data_size);
+		if (node == NULL) return -1;
+		node->left = tree->spare;
+		tree->spare = node;
+		tree->nspare++;
+	}
+	return 0;
+}
+
+static struct avl_pnode *_avl_pnode_alloc(struct avl_ptree *tree)
+{
+	struct avl_pnode *node = tree->spare;
+	tree->spare = node->left;
+	tree->nspare--;
+	tree->copies++;
+	node->refcnt = 1;
+	return node;
+}
+
+static inline struct avl_pnode *_avl_pnode_ref(struct avl_pnode *node)
+{
+	if (node) avl_atomic_inc(&node->refcnt);
+	return node;
+}
+
+/* drop a reference, tree is NULL when called outside of the writer */
+static void _avl_pnode_release(struct avl_ptree *tree, struct avl_pnode *node)
+{
+	while (node && avl_atomic_dec(&node->refcnt) == 0) {
+		struct avl_pnode *right = node->right;
+		_avl_pnode_release(tree, node->left);
+		if (tree && tree->nspare < AVL_PSPARE_MAX) {
+			node->left = tree->spare;
+			tree->spare = node;
+			tree->nspare++;
+		}	else {
+			free(node);
+		}
+		node = right;
+	}
+}
+
+static inline void _avl_pnode_fix(struct avl_pnode *node)
+{
+	int h0 = AVL_PHEIGHT(node->left);
+	int h1 = AVL_PHEIGHT(node->right);
+	node->height = AVL_PMAX(h0, h1) + 1;
+}
+
+/* new node owning left and right, with a copy of data */
+static struct avl_pnode *_avl_pnode_make(struct avl_ptree *tree,
+		struct avl_pnode *left, struct avl_pnode *right, const void *data)
+{
+	struct avl_pnode *node = _avl_pnode_alloc(tree);
+	node->left = left;
+	node->right = right;
+	_avl_pnode_fix(node);
+	memcpy(AVL_PNODE_DATA(node), data, tree->data_size);
+	return node;
+}
+
+/* turn an owned reference into a node we may change: only the writer
+ * can hold the single reference of a node, otherwise it is copied. the
+ * acquire pairs with a snapshot dropping the other reference, so its
+ * reads are over before the node changes */
+static struct avl_pnode *_avl_pnode_own(struct avl_ptree *tree,
+		struct avl_pnode *node)
+{
+	struct avl_pnode *copy;
+	if (avl_atomic_load(&node->refcnt) == 1) return node;
+	copy = _avl_pnode_make(tree, _avl_pnode_ref(node->left),
+			_avl_pnode_ref(node->right), AVL_PNODE_DATA(node));
+	_avl_pnode_release(tree, node);
+	return copy;
+}
+
+
+/*====================================================================*/
+/* path copying                                                       */
+/*====================================================================*/
+
+/* join left, data and right into a balanced node, the same single and
+ * double rotations as avl_node_post_insert, done on owned nodes */
+static struct avl_pnode *_avl_pnode_balance(struct avl_ptree *tree,
+		struct avl_pnode *left, struct avl_pnode *right, const void *data)
+{
+	int h0 = AVL_PHEIGHT(left);
+	int h1 = AVL_PHEIGHT(right);
+	struct avl_pnode *x;
+	if (h0 > h1 + 1) {
+		left = _avl_pnode_own(tree, left);
+		if (AVL_PHEIGHT(left->left) >= AVL_PHEIGHT(left->right)) {
+			left->right = _avl_pnode_make(tree, left->right, right, data);
+			_avl_pnode_fix(left);
+			return left;
+		}
+		x = _avl_pnode_own(tree, left->right);
+		left->right = x->left;
+		_avl_pnode_fix(left);
+		x->left = left;
+		x->right = _avl_pnode_make(tree, x->right, right, data);
+		_avl_pnode_fix(x);
+		return x;
+	}
+	if (h1 > h0 + 1) {
+		right = _avl_pnode_own(tree, right);
+		if (AVL_PHEIGHT(right->right) >= AVL_PHEIGHT(right->left)) {
+			right->left = _avl_pnode_make(tree, left, right->left, data);
+			_avl_pnode_fix(right);
+			return right;
+		}
+		x = _avl_pnode_own(tree, right->left);
+		right->left = x->right;
+		_avl_pnode_fix(right);
+		x->right = right;
+		x->left = _avl_pnode_make(tree, left, x->left, data);
+		_avl_pnode_fix(x);
+		return x;
+	}
+	return _avl_pnode_make(tree, left, right, data);
+}
+
+static struct avl_pnode *_avl_pnode_set(struct avl_ptree *tree,
+		struct avl_pnode *node, const void *data, int *found)
+{
+	int hr;
+	if (node == NULL) return _avl_pnode_make(tree, NULL, NULL, data);
+	hr = tree->compare(data, AVL_PNODE_DATA(node));
+	if (hr == 0) {
+		*found = 1;
+		return _avl_pnode_make(tree, _avl_pnode_ref(node->left),
+				_avl_pnode_ref(node->right), data);
+	}
+	else if (hr < 0) {
+		struct avl_pnode *left = _avl_pnode_set(tree, node->left, data, found);
+		return _avl_pnode_balance(tree, left, _avl_pnode_ref(node->right),
+				AVL_PNODE_DATA(node));
+	}
+	else {
+		struct avl_pnode *right = _avl_pnode_set(tree, node->right, data, found);
+		return _avl_pnode_balance(tree, _avl_pnode_ref(node->left), right,
+				AVL_PNODE_DATA(node));
+	}
+}
+
+/* remove the first node, min points to its data in the old version */
+static struct avl_pnode *_avl_pnode_pop_first(struct avl_ptree *tree,
+		struct avl_pnode *node, const void **min)
+{
+	struct avl_pnode *left;
+	if (node->left == NULL) {
+		*min = AVL_PNODE_DATA(node);
+		return _avl_pnode_ref(node->right);
+	}
+	left = _avl_pnode_pop_first(tree, node->left, min);
+	return _avl_pnode_balance(tree, left, _avl_pnode_ref(node->right),
+			AVL_PNODE_DATA(node));
+}
+
+/* key must be present */
+static struct avl_pnode *_avl_pnode_remove(struct avl_ptree *tree,
+		struct avl_pnode *node, const void *key)
+{
+	int hr = tree->compare(key, AVL_PNODE_DATA(node));
+	if (hr < 0) {
+		struct avl_pnode *left = _avl_pnode_remove(tree, node->left, key);
+		return _avl_pnode_balance(tree, left, _avl_pnode_ref(node->right),
+				AVL_PNODE_DATA(node));
+	}
+	else if (hr > 0) {
+		struct avl_pnode *right = _avl_pnode_remove(tree, node->right, key);
+		return _avl_pnode_balance(tree, _avl_pnode_ref(node->left), right,
+				AVL_PNODE_DATA(node));
+	}
+	else if (node->left == NULL) {
+		return _avl_pnode_ref(node->right);
+	}
+	else if (node->right == NULL) {
+		return _avl_pnode_ref(node->left);
+	}
+	else {
+		const void *min;
+		struct avl_pnode *right = _avl_pnode_pop_first(tree, node->right, &min);
+		return _avl_pnode_balance(tree, _avl_pnode_ref(node->left), right, min);
+	}
+}
+
+/* swap in the new version, the old one lives on in snapshots */
+static void _avl_ptree_publish(struct avl_ptree *tree,
+		struct avl_pnode *root, size_t count)
+{
+	struct avl_pnode *old;
+	avl_mutex_lock(&tree->lock);
+	old = tree->root;
+	tree->root = root;
+	tree->count = count;
+	avl_mutex_unlock(&tree->lock);
+	_avl_pnode_release(tree, old);
+}
+
+
+/*====================================================================*/
+/* tree interface                                                     */
+/*====================================================================*/
+
+void avl_ptree_init(struct avl_ptree *tree,
+		int (*compare)(const void*, const void*), size_t data_size)
+{
+	tree->root = NULL;
+	tree->count = 0;
+	tree->data_size = data_size;
+	tree->copies = 0;
+	tree->spare = NULL;
+	tree->nspare = 0;
+	tree->compare = compare;
+	avl_mutex_init(&tree->lock);
+}
+
+void avl_ptree_destroy(struct avl_ptree *tree)
+{
+	_avl_pnode_release(NULL, tree->root);
+	tree->root = NULL;
+	tree->count = 0;
+	while (tree->spare) {
+		struct avl_pnode *node = tree->spare;
+		tree->spare = node->left;
+		free(node);
+	}
+	tree->nspare = 0;
+	avl_mutex_destroy(&tree->lock);
+}
+
+int avl_ptree_set(struct avl_ptree *tree, const void *data)
+{
+	struct avl_pnode *root;
+	int found = 0;
+	if (_avl_ptree_reserve(tree) != 0) return -1;
+	root = _avl_pnode_set(tree, tree->root, data, &found);
+	_avl_ptree_publish(tree, root, tree->count + (found? 0 : 1));
+	return found;
+}
+
+int avl_ptree_remove(struct avl_ptree *tree, const void *key)
+{
+	struct avl_pnode *root;
+	if (avl_ptree_find(tree, key) == NULL) return 1;
+	if (_avl_ptree_reserve(tree) != 0) return -1;
+	root = _avl_pnode_remove(tree, tree->root, key);
+	_avl_ptree_publish(tree, root, tree->count - 1);
+	return 0;
+}
+
+static const void *_avl_pnode_find(const struct avl_pnode *node,
+		const void *key, int (*compare)(const void*, const void*))
+{
+	while (node) {
+		const void *data = AVL_PNODE_DATA(node);
+		int hr = compare(key, data);
+		if (hr == 0) return data;
+		node = (hr < 0)? node->left : node->right;
+	}
+	return NULL;
+}
+
+const void *avl_ptree_find(const struct avl_ptree *tree, const void *key)
+{
+	return _avl_pnode_find(tree->root, key, tree->compare);
+}
+
+void avl_ptree_snapshot(struct avl_ptree *tree, struct avl_psnap *snap)
+{
+	avl_mutex_lock(&tree->lock);
+	snap->root = _avl_pnode_ref(tree->root);
+	snap->count = tree->count;
+	avl_mutex_unlock(&tree->lock);
+	snap->compare = tree->compare;
+}
+
+void avl_psnap_release(struct avl_psnap *snap)
+{
+	_avl_pnode_release(NULL, snap->root);
+	snap->root = NULL;
+	snap->count = 0;
+}
+
+const void *avl_psnap_find(const struct avl_psnap *snap, const void *key)
+{
+	return _avl_pnode_find(snap->root, key, snap->compare);
+}
+
+static void _avl_pnode_walk(const struct avl_pnode *node,
+		void (*visit)(const void *data, void *user), void *user)
+{
+	while (node) {
+		_avl_pnode_walk(node->left, visit, user);
+		visit(AVL_PNODE_DATA(node), user);
+		node = node->right;
+	}
+}
+
+void avl_psnap_walk(const struct avl_psnap *snap,
+		void (*visit)(const void *data, void *user), void *user)
+{
+	_avl_pnode_walk(snap->root, visit, user);
+}
+
+
@@ -0,0 +1,95 @@
+/*********************************************************************
+ *
+ * avlpersist.h - persistent avl tree with O(1) snapshots
+ *
+ * NOTE:
+ * a version is never changed once published: an update copies the
+ * nodes on its path and shares the rest with older versions. nodes are
+ * reference counted, so a snapshot is one increment of the root and
+ * readers of a snapshot never block the writer or each other.
+ * data of data_size bytes is stored in the node and copied with it,
+ * keep a pointer in it for large records. one writer at a time.
+ *
+ *********************************************************************/
+#ifndef _AVLPERSIST_H__
+#define _AVLPERSIST_H__
+
+#include "avlsync.h"
+
+
+/*====================================================================*/
+/* persistent tree                                                    */
+/*====================================================================*/
+struct avl_pnode
+{
+	struct avl_pnode *left;
+	struct avl_pnode *right;
+	int height;
+	int refcnt;                 /* parents and snapshots holding it */
+};
+
+/* data stored right after the node */
+#define AVL_PNODE_DATA(node) ((void*)((node) + 1))
+
+struct avl_ptree
+{
+	struct avl_pnode *root;     /* current version */
+	size_t count;               /* number of data in current version */
+	size_t data_size;           /* size of data in each node */
+	size_t copies;              /* nodes allocated by updates so far */
+	struct avl_pnode *spare;    /* nodes reserved for the next update */
+	size_t nspare;
+	avl_mutex_t lock;           /* guards publishing and taking root */
+	/* compare two data: returns 0 for equal, < 0 or > 0 */
+	int (*compare)(const void *d1, const void *d2);
+};
+
+/* a point-in-time version, valid until released */
+struct avl_psnap
+{
+	struct avl_pnode *root;
+	size_t count;
+	int (*compare)(const void *d1, const void *d2);
+};
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void avl_ptree_init(struct avl_ptree *tree,
+		int (*compare)(const void*, const void*), size_t data_size);
+
+/* release the current version, snapshots stay valid */
+void avl_ptree_destroy(struct avl_ptree *tree);
+
+/* insert or overwrite data with the same key, returns 0 for inserted,
+ * 1 for overwritten and -1 for out of memory (tree is unchanged) */
+int avl_ptree_set(struct avl_ptree *tree, const void *data);
+
+/* returns 0 for removed, 1 for not found, -1 for out of memory */
+int avl_ptree_remove(struct avl_ptree *tree, const void *key);
+
+/* lookup in the current version, for the writer thread only */
+const void *avl_ptree_find(const struct avl_ptree *tree, const void *key);
+
+/* take the current version in O(1), from any thread */
+void avl_ptree_snapshot(struct avl_ptree *tree, struct avl_psnap *snap);
+
+void avl_psnap_release(struct avl_psnap *snap);
+
+/* lookup in a snapshot, the result lives as long as the snapshot */
+const void *avl_psnap_find(const struct avl_psnap *snap, const void *key);
+
+/* call visit on every data in key order */
+void avl_psnap_walk(const struct avl_psnap *snap,
+		void (*visit)(const void *data, void *user), void *user);
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif
+
+
@@ -0,0 +1,231 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "avlrcu.h"
+
+
+/*====================================================================*/
+/* epoch based reclamation                                            */
+/*====================================================================*/
+
+/* erased data collected before trying to reclaim */
+#define AVL_RCU_BATCH     64
+
+/* a descent longer than this has crossed a rotation in progress */
+#define AVL_RCU_MAX_STEPS 128
+
+/* data erased in epoch e can go once every reader inside a read lock
+ * entered after e, readers entering later cannot reach it */
+static long _avl_rcu_oldest(struct avl_rcu_tree *tree)
+{
+	long oldest = 0, count = avl_atomic_load(&tree->nreaders);
+	long i;
+	if (count > tree->maxreaders) count = tree->maxreaders;
+	avl_atomic_fence();
+	for (i = 0; i < count; i++) {
+		long epoch = avl_atomic_load(&tree->slots[i].epoch);
+		if (epoch != 0 && (oldest == 0 || epoch < oldest)) oldest = epoch;
+	}
+	return oldest;
+}
+
+static void _avl_rcu_reclaim(struct avl_rcu_tree *tree)
+{
+	long oldest = _avl_rcu_oldest(tree);
+	size_t i, keep = 0;
+	for (i = 0; i < tree->nretired; i++) {
+		struct avl_rcu_retired *r = &tree->retired[i];
+		if (oldest == 0 || r->epoch < oldest) {
+			if (tree->reclaim) tree->reclaim(r->data);
+		}	else {
+			tree->retired[keep++] = *r;
+		}
+	}
+	tree->nretired = keep;
+}
+
+/* wait for the readers inside a read lock entered in epoch or before */
+static void _avl_rcu_wait(struct avl_rcu_tree *tree, long epoch)
+{
+	while (1) {
+		long oldest = _avl_rcu_oldest(tree);
+		if (oldest == 0 || oldest > epoch) break;
+		avl_thread_yield();
+	}
+}
+
+/* called with the writer lock held, after the data is unlinked: returns
+ * 0 if it is deferred, or the epoch it was erased in when there is no
+ * room, the caller must wait for the readers after the write ends */
+static long _avl_rcu_retire(struct avl_rcu_tree *tree, void *data)
+{
+	long epoch = tree->epoch;
+	avl_atomic_store(&tree->epoch, epoch + 1);
+	if (tree->nretired >= tree->capacity) {
+		size_t capacity = (tree->capacity)? tree->capacity * 2 : AVL_RCU_BATCH;
+		struct avl_rcu_retired *retired = (struct avl_rcu_retired*)
+			realloc(tree->retired, sizeof(struct avl_rcu_retired) * capacity);
+		if (retired == NULL) return epoch;
+		tree->retired = retired;
+		tree->capacity = capacity;
+	}
+	tree->retired[tree->nretired].data = data;
+	tree->retired[tree->nretired].epoch = epoch;
+	tree->nretired++;
+	if (tree->nretired >= AVL_RCU_BATCH && 
+			(tree->nretired & (AVL_RCU_BATCH - 1)) == 0) {
+		_avl_rcu_reclaim(tree);
+	}
+	return 0;
+}
+
+
+/*====================================================================*/
+/* writers                                                            */
+/*====================================================================*/
+
+static inline void _avl_rcu_write_begin(struct avl_rcu_tree *tree)
+{
+	avl_mutex_lock(&tree->lock);
+	avl_atomic_store(&tree->seq, tree->seq + 1);
+	avl_atomic_fence();
+}
+
+static inline void _avl_rcu_write_end(struct avl_rcu_tree *tree)
+{
+	avl_atomic_store(&tree->seq, tree->seq + 1);
+	avl_mutex_unlock(&tree->lock);
+}
+
+int avl_rcu_init(struct avl_rcu_tree *tree,
+		int (*compare)(const void*, const void*), size_t size,
+		size_t offset, int maxreaders, void (*reclaim)(void *data))
+{
+	size_t bytes = sizeof(struct avl_rcu_slot) * (size_t)maxreaders;
+	char *buffer = (char*)malloc(bytes + 64);
+	if (buffer == NULL) return -1;
+	memset(buffer, 0, bytes + 64);
+	avl_tree_init(&tree->tree, compare, size, offset);
+	avl_mutex_init(&tree->lock);
+	tree->seq = 0;
+	tree->epoch = 1;
+	tree->nreaders = 0;
+	tree->maxreaders = maxreaders;
+	tree->buffer = buffer;
+	tree->slots = (struct avl_rcu_slot*)(((size_t)buffer + 63) &
+			~((size_t)63));
+	tree->retired = NULL;
+	tree->nretired = 0;
+	tree->capacity = 0;
+	tree->reclaim = reclaim;
+	return 0;
+}
+
+void avl_rcu_destroy(struct avl_rcu_tree *tree)
+{
+	avl_rcu_synchronize(tree);
+	if (tree->retired) free(tree->retired);
+	free(tree->buffer);
+	tree->retired = NULL;
+	tree->slots = NULL;
+	tree->buffer = NULL;
+	avl_mutex_destroy(&tree->lock);
+}
+
+void *avl_rcu_add(struct avl_rcu_tree *tree, void *data)
+{
+	struct avl_node *node = AVL_DATA2NODE(data, tree->tree.offset);
+	void *dup;
+	/* a reader may meet the node as soon as it is linked */
+	node->left = node->right = NULL;
+	_avl_rcu_write_begin(tree);
+	dup = avl_tree_add(&tree->tree, data);
+	_avl_rcu_write_end(tree);
+	return dup;
+}
+
+void avl_rcu_remove(struct avl_rcu_tree *tree, void *data)
+{
+	struct avl_node *node = AVL_DATA2NODE(data, tree->tree.offset);
+	long epoch = 0;
+	_avl_rcu_write_begin(tree);
+	if (!avl_node_empty(node)) {
+		avl_tree_remove(&tree->tree, data);
+		epoch = _avl_rcu_retire(tree, data);
+	}
+	_avl_rcu_write_end(tree);
+	/* no room to defer: readers wait while seq is odd, so they are
+	 * only waited for once the write has ended */
+	if (epoch != 0) {
+		_avl_rcu_wait(tree, epoch);
+		if (tree->reclaim) tree->reclaim(data);
+	}
+}
+
+void avl_rcu_synchronize(struct avl_rcu_tree *tree)
+{
+	avl_mutex_lock(&tree->lock);
+	while (tree->nretired > 0) {
+		_avl_rcu_reclaim(tree);
+		if (tree->nretired > 0) avl_thread_yield();
+	}
+	avl_mutex_unlock(&tree->lock);
+}
+
+
+/*====================================================================*/
+/* readers                                                            */
+/*====================================================================*/
+
+int avl_rcu_reader(struct avl_rcu_tree *tree)
+{
+	long id = avl_atomic_inc(&tree->nreaders) - 1;
+	return (id < tree->maxreaders)? (int)id : -1;
+}
+
+void avl_rcu_read_lock(struct avl_rcu_tree *tree, int reader)
+{
+	avl_atomic_store(&tree->slots[reader].epoch,
+			avl_atomic_load(&tree->epoch));
+	avl_atomic_fence();
+}
+
+void avl_rcu_read_unlock(struct avl_rcu_tree *tree, int reader)
+{
+	avl_atomic_store(&tree->slots[reader].epoch, 0);
+}
+
+void *avl_rcu_find(struct avl_rcu_tree *tree, const void *key)
+{
+	int (*compare)(const void*, const void*) = tree->tree.compare;
+	size_t offset = tree->tree.offset;
+	int spins = 0;
+	while (1) {
+		long seq = avl_atomic_load(&tree->seq);
+		struct avl_node *node;
+		void *found = NULL;
+		int steps = 0;
+		if (seq & 1) {
+			/* the writer may have been preempted, let it run */
+			if ((++spins & 63) == 0) avl_thread_yield();
+			else avl_cpu_relax();
+			continue;
+		}
+		node = (struct avl_node*)avl_atomic_load_ptr(&tree->tree.root.node);
+		while (node && steps++ < AVL_RCU_MAX_STEPS) {
+			void *data = AVL_NODE2DATA(node, offset);
+			int hr = compare(key, data);
+			if (hr == 0) {
+				found = data;
+				break;
+			}
+			node = (struct avl_node*)((hr < 0)?
+				avl_atomic_load_ptr(&node->left) :
+				avl_atomic_load_ptr(&node->right));
+		}
+		avl_atomic_fence();
+		if (avl_atomic_load(&tree->seq) == seq) return found;
+	}
+}
+
+
@@ -0,0 +1,95 @@
+/*********************************************************************
+ *
+ * avlrcu.h - avl_tree with one writer and readers taking no lock
+ *
+ * NOTE:
+ * readers take no lock: a search reads a sequence counter, descends
+ * and checks the counter again, retrying if a writer ran meanwhile.
+ * this is a seqlock, not lock-free: readers wait while a writer is
+ * changing the tree, so a writer preempted in the middle of a change
+ * stalls every search until it runs again. avl_tree rotates with plain
+ * stores, a search crossing a rotation is only kept from looping and
+ * retries. writers are serialized by a mutex and publish new nodes
+ * after a fence. erased data is handed to reclaim only after every
+ * reader inside avl_rcu_read_lock when it was erased has left.
+ *
+ *********************************************************************/
+#ifndef _AVLRCU_H__
+#define _AVLRCU_H__
+
+#include "avlsync.h"
+
+
+/*====================================================================*/
+/* read-mostly tree                                                   */
+/*====================================================================*/
+struct avl_rcu_slot
+{
+	long epoch;                 /* epoch when entered, 0 for outside */
+	char padding[64 - sizeof(long)];
+};
+
+struct avl_rcu_retired
+{
+	void *data;
+	long epoch;                 /* epoch when erased */
+};
+
+struct avl_rcu_tree
+{
+	struct avl_tree tree;
+	avl_mutex_t lock;           /* serializes writers */
+	long seq;                   /* odd while a writer changes the tree */
+	long epoch;                 /* bumped by every erase */
+	long nreaders;              /* registered readers */
+	int maxreaders;
+	struct avl_rcu_slot *slots;     /* one cache line per reader */
+	void *buffer;                   /* memory block of slots */
+	struct avl_rcu_retired *retired;
+	size_t nretired;
+	size_t capacity;
+	void (*reclaim)(void *data);
+};
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* reclaim is called with erased data once no reader can see it,
+ * returns zero for success, -1 for out of memory */
+int avl_rcu_init(struct avl_rcu_tree *tree,
+		int (*compare)(const void*, const void*), size_t size,
+		size_t offset, int maxreaders, void (*reclaim)(void *data));
+
+/* waits for readers and reclaims every erased data */
+void avl_rcu_destroy(struct avl_rcu_tree *tree);
+
+/* returns a reader id for the calling thread, -1 if all are taken */
+int avl_rcu_reader(struct avl_rcu_tree *tree);
+
+/* data found inside a read lock stays valid until the unlock */
+void avl_rcu_read_lock(struct avl_rcu_tree *tree, int reader);
+void avl_rcu_read_unlock(struct avl_rcu_tree *tree, int reader);
+
+/* lookup, must be called inside a read lock, waits while a writer is
+ * changing the tree */
+void *avl_rcu_find(struct avl_rcu_tree *tree, const void *key);
+
+/* writers: returns NULL for success, otherwise the data with same key */
+void *avl_rcu_add(struct avl_rcu_tree *tree, void *data);
+
+/* data is passed to reclaim later */
+void avl_rcu_remove(struct avl_rcu_tree *tree, void *data);
+
+/* wait until every erased data can be reclaimed and reclaim it */
+void avl_rcu_synchronize(struct avl_rcu_tree *tree);
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif
+
+
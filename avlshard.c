@@ -0,0 +1,291 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "avlshard.h"
+
+
+/*====================================================================*/
+/* routing                                                            */
+/*====================================================================*/
+
+/* shard whose range contains data: bounds are rewritten in place and
+ * the search is retried if one changed meanwhile */
+static int _avl_shard_route(struct avl_shard_tree *st, const void *data)
+{
+	while (1) {
+		long seq = avl_atomic_load(&st->seq);
+		int lo = 0, hi = st->nshards - 1;
+		if (seq & 1) {
+			avl_cpu_relax();
+			continue;
+		}
+		while (lo < hi) {
+			int mid = (lo + hi) >> 1;
+			void *bound = avl_atomic_load_ptr(&st->bounds[mid]);
+			if (bound == NULL || st->compare(data, bound) < 0) hi = mid;
+			else lo = mid + 1;
+		}
+		avl_atomic_rmb();
+		if (avl_atomic_load(&st->seq) == seq) return lo;
+	}
+}
+
+/* bounds of a shard only change while it is locked */
+static int _avl_shard_owns(struct avl_shard_tree *st, int index,
+		const void *data)
+{
+	if (index > 0) {
+		void *lower = st->bounds[index - 1];
+		if (lower == NULL || st->compare(data, lower) < 0) return 0;
+	}
+	if (index < st->nshards - 1) {
+		void *upper = st->bounds[index];
+		if (upper != NULL && st->compare(data, upper) >= 0) return 0;
+	}
+	return 1;
+}
+
+static struct avl_shard *_avl_shard_lock(struct avl_shard_tree *st,
+		const void *data)
+{
+	while (1) {
+		int index = _avl_shard_route(st, data);
+		struct avl_shard *shard = avl_shard_at(st, index);
+		avl_mutex_lock(&shard->lock);
+		if (_avl_shard_owns(st, index, data)) {
+			avl_atomic_inc(&shard->ops);
+			return shard;
+		}
+		avl_mutex_unlock(&shard->lock);
+	}
+}
+
+/* copy data into the slot of bound index, shards index and index + 1
+ * locked. st->lock keeps writers of different bounds apart */
+static void _avl_shard_bound_set(struct avl_shard_tree *st, int index,
+		const void *data)
+{
+	void *slot = st->slots + (size_t)index * st->size;
+	avl_mutex_lock(&st->lock);
+	avl_atomic_store(&st->seq, st->seq + 1);
+	avl_atomic_wmb();
+	memcpy(slot, data, st->size);
+	avl_atomic_store(&st->seq, st->seq + 1);
+	avl_mutex_unlock(&st->lock);
+	avl_atomic_store_ptr(&st->bounds[index], slot);
+}
+
+
+/*====================================================================*/
+/* sharded tree                                                       */
+/*====================================================================*/
+
+int avl_shard_init(struct avl_shard_tree *st,
+		int (*compare)(const void*, const void*), size_t size,
+		size_t offset, int nshards, void **bounds)
+{
+	size_t stride = (sizeof(struct avl_shard) + 63) & ~((size_t)63);
+	int i;
+	st->nshards = nshards;
+	st->stride = stride;
+	st->seq = 0;
+	st->size = size;
+	st->offset = offset;
+	st->compare = compare;
+	st->buffer = malloc(stride * nshards + 64);
+	st->bounds = (void**)malloc(sizeof(void*) * nshards);
+	st->slots = (char*)malloc(size * ((nshards > 1)? nshards - 1 : 1));
+	if (st->buffer == NULL || st->bounds == NULL || st->slots == NULL) {
+		free(st->buffer);
+		free(st->bounds);
+		free(st->slots);
+		return -1;
+	}
+	st->shards = (char*)(((size_t)st->buffer + 63) & ~((size_t)63));
+	avl_mutex_init(&st->lock);
+	for (i = 0; i < nshards; i++) {
+		struct avl_shard *shard = avl_shard_at(st, i);
+		avl_mutex_init(&shard->lock);
+		avl_tree_init(&shard->tree, compare, size, offset);
+		shard->ops = 0;
+		st->bounds[i] = NULL;
+	}
+	for (i = 0; bounds != NULL && i < nshards - 1; i++) {
+		_avl_shard_bound_set(st, i, bounds[i]);
+	}
+	return 0;
+}
+
+void avl_shard_destroy(struct avl_shard_tree *st, void (*destroy)(void*))
+{
+	int i;
+	for (i = 0; i < st->nshards; i++) {
+		struct avl_shard *shard = avl_shard_at(st, i);
+		avl_tree_clear(&shard->tree, destroy);
+		avl_mutex_destroy(&shard->lock);
+	}
+	avl_mutex_destroy(&st->lock);
+	free(st->slots);
+	free(st->bounds);
+	free(st->buffer);
+	st->slots = NULL;
+	st->bounds = NULL;
+	st->buffer = NULL;
+	st->shards = NULL;
+}
+
+void *avl_shard_find(struct avl_shard_tree *st, const void *data)
+{
+	struct avl_shard *shard = _avl_shard_lock(st, data);
+	void *found = avl_tree_find(&shard->tree, data);
+	avl_mutex_unlock(&shard->lock);
+	return found;
+}
+
+void *avl_shard_add(struct avl_shard_tree *st, void *data)
+{
+	struct avl_shard *shard = _avl_shard_lock(st, data);
+	void *dup = avl_tree_add(&shard->tree, data);
+	avl_mutex_unlock(&shard->lock);
+	return dup;
+}
+
+void *avl_shard_remove(struct avl_shard_tree *st, const void *key)
+{
+	struct avl_shard *shard = _avl_shard_lock(st, key);
+	void *found = avl_tree_find(&shard->tree, key);
+	if (found) avl_tree_remove(&shard->tree, found);
+	avl_mutex_unlock(&shard->lock);
+	return found;
+}
+
+void avl_shard_walk(struct avl_shard_tree *st,
+		void (*visit)(void *data, void *user), void *user)
+{
+	struct avl_shard *prev = NULL;
+	int i;
+	for (i = 0; i < st->nshards; i++) {
+		struct avl_shard *shard = avl_shard_at(st, i);
+		void *data;
+		avl_mutex_lock(&shard->lock);
+		if (prev) avl_mutex_unlock(&prev->lock);
+		for (data = avl_tree_first(&shard->tree); data != NULL;
+				data = avl_tree_next(&shard->tree, data)) {
+			visit(data, user);
+		}
+		prev = shard;
+	}
+	if (prev) avl_mutex_unlock(&prev->lock);
+}
+
+size_t avl_shard_count(struct avl_shard_tree *st)
+{
+	size_t count = 0;
+	int i;
+	for (i = 0; i < st->nshards; i++) {
+		count += avl_shard_at(st, i)->tree.count;
+	}
+	return count;
+}
+
+
+/*====================================================================*/
+/* moving bounds                                                      */
+/*====================================================================*/
+
+/* shards index and index + 1 locked, data within their ranges */
+static long _avl_shard_shift(struct avl_shard_tree *st, int index,
+		const void *data)
+{
+	struct avl_shard *a = avl_shard_at(st, index);
+	struct avl_shard *b = avl_shard_at(st, index + 1);
+	void *old = st->bounds[index];
+	int down = (old == NULL || st->compare(data, old) < 0);
+	struct avl_tree part;
+	long moved;
+	/* routing waits on the locks held here until the data is moved */
+	_avl_shard_bound_set(st, index, data);
+	data = st->bounds[index];
+	avl_tree_init(&part, st->compare, st->size, st->offset);
+	if (down) {
+		avl_tree_split(&a->tree, data, &a->tree, &part);
+		moved = (long)part.count;
+		avl_tree_concat(&b->tree, &part, &b->tree);
+	}	else {
+		avl_tree_split(&b->tree, data, &part, &b->tree);
+		moved = (long)part.count;
+		avl_tree_concat(&a->tree, &a->tree, &part);
+	}
+	return moved;
+}
+
+long avl_shard_move(struct avl_shard_tree *st, int index, const void *data)
+{
+	struct avl_shard *a = avl_shard_at(st, index);
+	struct avl_shard *b = avl_shard_at(st, index + 1);
+	long moved = -1;
+	avl_mutex_lock(&a->lock);
+	avl_mutex_lock(&b->lock);
+	/* the outer bounds need locks of a or b to change */
+	if (_avl_shard_owns(st, index, data) ||
+			_avl_shard_owns(st, index + 1, data)) {
+		moved = _avl_shard_shift(st, index, data);
+	}
+	avl_mutex_unlock(&b->lock);
+	avl_mutex_unlock(&a->lock);
+	return moved;
+}
+
+long avl_shard_shrink(struct avl_shard_tree *st, int index)
+{
+	struct avl_shard *shard = avl_shard_at(st, index);
+	int lo = (index > 0)? index - 1 : index;
+	int hi = (index < st->nshards - 1)? index + 1 : index;
+	long moved = 0;
+	size_t count, part, i;
+	void *lower = NULL, *upper = NULL;
+	int k;
+	for (k = lo; k <= hi; k++) {
+		avl_mutex_lock(&avl_shard_at(st, k)->lock);
+	}
+	count = shard->tree.count;
+	part = (lo < index && index < hi)? count / 4 : count / 2;
+	if (part > 0 && lo < index) {
+		lower = avl_tree_first(&shard->tree);
+		for (i = 0; i < part; i++) lower = avl_tree_next(&shard->tree, lower);
+	}
+	if (part > 0 && index < hi) {
+		upper = avl_tree_last(&shard->tree);
+		for (i = 1; i < part; i++) upper = avl_tree_prev(&shard->tree, upper);
+	}
+	/* take both pivots first, the first shift unlinks nothing else */
+	if (lower) {
+		moved += _avl_shard_shift(st, index - 1, lower);
+	}
+	if (upper) {
+		moved += _avl_shard_shift(st, index, upper);
+	}
+	for (k = hi; k >= lo; k--) {
+		avl_mutex_unlock(&avl_shard_at(st, k)->lock);
+	}
+	return moved;
+}
+
+int avl_shard_hottest(struct avl_shard_tree *st, double *share)
+{
+	size_t total = 0, most = 0;
+	int i, hottest = 0;
+	for (i = 0; i < st->nshards; i++) {
+		struct avl_shard *shard = avl_shard_at(st, i);
+		size_t ops = (size_t)avl_atomic_xchg(&shard->ops, 0);
+		total += ops;
+		if (ops > most) {
+			most = ops;
+			hottest = i;
+		}
+	}
+	if (share) share[0] = (total > 0)? (double)most / total : 0.0;
+	return hottest;
+}
+
+
@@ -0,0 +1,113 @@
+/*********************************************************************
+ *
+ * avlshard.h - avl_tree split by key range into locked shards
+ *
+ * NOTE:
+ * the key space is cut by K - 1 bounds into K shards, each an avl_tree
+ * with its own lock on its own cache lines. a point operation locks one
+ * shard only. bounds can be moved online, the data between the old and
+ * the new bound is moved by split and concat while the two neighbours
+ * are locked: O(log n) with AVL_ORDER_STATISTIC, otherwise O(log n +
+ * moved) as avl_tree_split walks the smaller part to count it. a walk
+ * locks shard by shard in key order and keeps the previous one locked
+ * until the next is, so data being moved between shards is never seen
+ * twice or missed.
+ *
+ * each bound is a copy of data in a fixed slot, rewritten in place
+ * under a seqlock when moved, so moving allocates nothing. the copy is
+ * shallow and routing may compare against a half written one before it
+ * retries: compare must only read values stored in data itself, never
+ * follow its pointers.
+ *
+ *********************************************************************/
+#ifndef _AVLSHARD_H__
+#define _AVLSHARD_H__
+
+#include "avlsync.h"
+
+
+/*====================================================================*/
+/* sharded tree                                                       */
+/*====================================================================*/
+struct avl_shard
+{
+	avl_mutex_t lock;
+	struct avl_tree tree;
+	long ops;                   /* point operations, see avl_shard_hottest */
+};
+
+struct avl_shard_tree
+{
+	int nshards;
+	size_t stride;              /* bytes between shards, lines apart */
+	char *shards;
+	void *buffer;               /* memory block of shards */
+	void **bounds;              /* lowest key of shard i + 1, NULL for none */
+	char *slots;                /* nshards - 1 copies bounds point to */
+	long seq;                   /* odd while a copy is rewritten */
+	avl_mutex_t lock;           /* serializes writers of the copies */
+	size_t size;
+	size_t offset;
+	int (*compare)(const void *d1, const void *d2);
+};
+
+#define avl_shard_at(st, i) \
+	((struct avl_shard*)((st)->shards + (size_t)(i) * (st)->stride))
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* bounds are nshards - 1 data in increasing order, copied by value, or
+ * NULL to start with every data in shard 0. returns zero for success and
+ * -1 for out of memory */
+int avl_shard_init(struct avl_shard_tree *st,
+		int (*compare)(const void*, const void*), size_t size,
+		size_t offset, int nshards, void **bounds);
+
+/* no other thread may use the tree any more, destroy may be NULL */
+void avl_shard_destroy(struct avl_shard_tree *st, void (*destroy)(void*));
+
+/* point operations: the result of find stays valid only as long as no
+ * other thread removes it */
+void *avl_shard_find(struct avl_shard_tree *st, const void *data);
+
+/* returns NULL for success, otherwise the data with the same key */
+void *avl_shard_add(struct avl_shard_tree *st, void *data);
+
+/* returns the data removed, or NULL if key is absent */
+void *avl_shard_remove(struct avl_shard_tree *st, const void *key);
+
+/* call visit on every data in key order, visit runs with a shard
+ * locked and must not use st */
+void avl_shard_walk(struct avl_shard_tree *st,
+		void (*visit)(void *data, void *user), void *user);
+
+/* number of data, exact only without concurrent writers */
+size_t avl_shard_count(struct avl_shard_tree *st);
+
+/* move the bound between shard index and index + 1 to the key of data,
+ * returns the number of data moved, -1 if the key is not between the
+ * bounds of the two shards. both shards stay locked for O(log n + moved)
+ * without AVL_ORDER_STATISTIC */
+long avl_shard_move(struct avl_shard_tree *st, int index, const void *data);
+
+/* narrow a hot shard: a quarter of its data goes to each neighbour,
+ * returns the number of data moved */
+long avl_shard_shrink(struct avl_shard_tree *st, int index);
+
+/* shard with most point operations since the last call, which resets
+ * the counters, share receives its part of every operation (may be
+ * NULL). counters are taken atomically without locks, so a shard
+ * counted while another is reset is only approximate */
+int avl_shard_hottest(struct avl_shard_tree *st, double *share);
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif
+
+
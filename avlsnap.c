@@ -0,0 +1,286 @@
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+
+#include "avlsnap.h"
+
+
+/*====================================================================*/
+/* freeze                                                             */
+/*====================================================================*/
+
+/* fill slot k and its descendants in order, returns the next node */
+static struct avl_node *
+_avl_snap_fill(struct avl_snap *snap, struct avl_node *node, size_t k,
+		size_t offset, size_t key_offset)
+{
+	char *data;
+	if (k > snap->count) return node;
+	node = _avl_snap_fill(snap, node, k * 2, offset, key_offset);
+	data = (char*)AVL_NODE2DATA(node, offset);
+	memcpy(avl_snap_key(snap, k), data + key_offset, snap->key_size);
+	snap->items[k] = data;
+	node = avl_node_next(node);
+	return _avl_snap_fill(snap, node, k * 2 + 1, offset, key_offset);
+}
+
+int avl_tree_freeze(struct avl_tree *tree, struct avl_snap *snap,
+		size_t key_offset, size_t key_size,
+		int (*compare)(const void *key1, const void *key2))
+{
+	size_t slots = tree->count + 1;
+	size_t keys_size = (slots * key_size + 63) & ~((size_t)63);
+	char *buffer;
+	/* keys are aligned to 64 bytes, so the 16 descendants four levels
+	 * below a slot share one cache line for 4-byte keys */
+	buffer = (char*)malloc(keys_size + slots * sizeof(void*) + 64);
+	if (buffer == NULL) return -1;
+	snap->buffer = buffer;
+	snap->keys = (char*)(((size_t)buffer + 63) & ~((size_t)63));
+	snap->items = (void**)(snap->keys + keys_size);
+	snap->count = tree->count;
+	snap->key_size = key_size;
+	snap->stamp = tree->stamp;
+	snap->tree = tree;
+	snap->compare = compare;
+	snap->items[0] = NULL;
+	_avl_snap_fill(snap, avl_node_first(&tree->root), 1, tree->offset,
+			key_offset);
+	return 0;
+}
+
+void avl_snap_destroy(struct avl_snap *snap)
+{
+	if (snap->buffer) free(snap->buffer);
+	snap->buffer = NULL;
+	snap->keys = NULL;
+	snap->items = NULL;
+	snap->count = 0;
+	snap->tree = NULL;
+}
+
+
+/*====================================================================*/
+/* search                                                             */
+/*====================================================================*/
+
+void *avl_snap_lower_bound(const struct avl_snap *snap, const void *key)
+{
+	int (*compare)(const void*, const void*) = snap->compare;
+	size_t slot;
+	avl_snap_search(snap, key, compare, slot);
+	return snap->items[slot];
+}
+
+void *avl_snap_find(const struct avl_snap *snap, const void *key)
+{
+	int (*compare)(const void*, const void*) = snap->compare;
+	size_t slot;
+	avl_snap_search(snap, key, compare, slot);
+	if (slot == 0 || compare(key, avl_snap_key(snap, slot)) != 0)
+		return NULL;
+	return snap->items[slot];
+}
+
+
+/*====================================================================*/
+/* static b-tree of int keys                                          */
+/*====================================================================*/
+#if defined(AVL_KARY_SCALAR)
+#define AVL_KARY_X86 0
+#elif defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define AVL_KARY_X86 1
+#define AVL_KARY_TARGET_SSE2 __attribute__((target("sse2")))
+#define AVL_KARY_TARGET_AVX2 __attribute__((target("avx2")))
+#include <immintrin.h>
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#define AVL_KARY_X86 1
+#define AVL_KARY_TARGET_SSE2
+#define AVL_KARY_TARGET_AVX2
+#include <intrin.h>
+#else
+#define AVL_KARY_X86 0
+#endif
+
+#define AVL_KARY_CHILD(k, i) ((k) * (AVL_KARY_B + 1) + (i) + 1)
+
+/* descent shared by all instruction sets, RANK(p, key, i) sets i to the
+ * number of keys less than key in the sorted block p */
+#define AVL_KARY_SEARCH_BODY(RANK) { \
+		size_t k = 0, slot = (size_t)-1; \
+		while (k < blocks) { \
+			const int *p = keys + k * AVL_KARY_B; \
+			unsigned int i; \
+			RANK(p, key, i); \
+			slot = (i < AVL_KARY_B)? k * AVL_KARY_B + i : slot; \
+			k = AVL_KARY_CHILD(k, i); \
+		} \
+		return slot; \
+	}
+
+#define AVL_KARY_RANK_SCALAR(p, key, i) do { \
+		int __j; \
+		for (i = 0, __j = 0; __j < AVL_KARY_B; __j++) \
+			i += ((p)[__j] < (key)); \
+	}	while (0)
+
+static size_t _avl_kary_search_scalar(const int *keys, size_t blocks,
+		int key)
+AVL_KARY_SEARCH_BODY(AVL_KARY_RANK_SCALAR)
+
+#if AVL_KARY_X86
+
+/* keys in a block are sorted, so the mask is a run of low bits */
+static inline unsigned int _avl_kary_ctz1(unsigned int mask)
+{
+#if defined(__GNUC__)
+	return (unsigned int)__builtin_ctz(~mask);
+#else
+	unsigned long index;
+	_BitScanForward(&index, ~mask);
+	return (unsigned int)index;
+#endif
+}
+
+#define AVL_KARY_RANK_SSE2(p, key, i) do { \
+		__m128i __x = _mm_set1_epi32(key); \
+		const __m128i *__p = (const __m128i*)(p); \
+		__m128i __a = _mm_cmpgt_epi32(__x, _mm_load_si128(__p + 0)); \
+		__m128i __b = _mm_cmpgt_epi32(__x, _mm_load_si128(__p + 1)); \
+		__m128i __c = _mm_cmpgt_epi32(__x, _mm_load_si128(__p + 2)); \
+		__m128i __d = _mm_cmpgt_epi32(__x, _mm_load_si128(__p + 3)); \
+		unsigned int __m = _mm_movemask_epi8( \
+			_mm_packs_epi16(_mm_packs_epi32(__a, __b), \
+				_mm_packs_epi32(__c, __d))); \
+		i = _avl_kary_ctz1(__m); \
+	}	while (0)
+
+#define AVL_KARY_RANK_AVX2(p, key, i) do { \
+		__m256i __x = _mm256_set1_epi32(key); \
+		const __m256i *__p = (const __m256i*)(p); \
+		__m256i __a = _mm256_cmpgt_epi32(__x, _mm256_load_si256(__p + 0)); \
+		__m256i __b = _mm256_cmpgt_epi32(__x, _mm256_load_si256(__p + 1)); \
+		unsigned int __m = (unsigned int) \
+			_mm256_movemask_ps(_mm256_castsi256_ps(__a)) | ((unsigned int) \
+			_mm256_movemask_ps(_mm256_castsi256_ps(__b)) << 8); \
+		i = _avl_kary_ctz1(__m); \
+	}	while (0)
+
+static AVL_KARY_TARGET_SSE2 size_t
+_avl_kary_search_sse2(const int *keys, size_t blocks, int key)
+AVL_KARY_SEARCH_BODY(AVL_KARY_RANK_SSE2)
+
+static AVL_KARY_TARGET_AVX2 size_t
+_avl_kary_search_avx2(const int *keys, size_t blocks, int key)
+AVL_KARY_SEARCH_BODY(AVL_KARY_RANK_AVX2)
+
+/* highest instruction set usable: 2 for avx2, 1 for sse2, 0 for none */
+static int _avl_kary_cpu(void)
+{
+#if defined(__GNUC__)
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2")) return 2;
+	if (__builtin_cpu_supports("sse2")) return 1;
+	return 0;
+#else
+	int info[4];
+	int simd = 0;
+	__cpuid(info, 1);
+	if (info[3] & (1 << 26)) simd = 1;
+	/* avx needs osxsave and the os saving xmm/ymm state */
+	if ((info[2] & (1 << 27)) && (info[2] & (1 << 28)) &&
+			(_xgetbv(0) & 6) == 6) {
+		__cpuidex(info, 7, 0);
+		if (info[1] & (1 << 5)) simd = 2;
+	}
+	return simd;
+#endif
+}
+
+#else
+
+static int _avl_kary_cpu(void)
+{
+	return 0;
+}
+
+#endif
+
+/* fill block k and its descendants in order, pads with INT_MAX once
+ * nodes run out, returns the next node */
+static struct avl_node *
+_avl_kary_fill(struct avl_kary *kt, struct avl_node *node, size_t k,
+		size_t offset, size_t key_offset)
+{
+	size_t i;
+	if (k >= kt->blocks) return node;
+	for (i = 0; i < AVL_KARY_B; i++) {
+		size_t slot = k * AVL_KARY_B + i;
+		node = _avl_kary_fill(kt, node, AVL_KARY_CHILD(k, i), offset,
+				key_offset);
+		if (node) {
+			char *data = (char*)AVL_NODE2DATA(node, offset);
+			kt->keys[slot] = *(int*)(data + key_offset);
+			kt->items[slot] = data;
+			node = avl_node_next(node);
+		}	else {
+			kt->keys[slot] = INT_MAX;
+			kt->items[slot] = NULL;
+		}
+	}
+	return _avl_kary_fill(kt, node, AVL_KARY_CHILD(k, AVL_KARY_B), offset,
+			key_offset);
+}
+
+int avl_kary_build(struct avl_kary *kt, struct avl_root *root,
+		size_t offset, size_t key_offset, int simd)
+{
+	struct avl_node *node;
+	size_t count = 0, slots;
+	int cpu;
+	char *buffer;
+	for (node = avl_node_first(root); node; node = avl_node_next(node))
+		count++;
+	kt->count = count;
+	kt->blocks = (count + AVL_KARY_B - 1) / AVL_KARY_B;
+	slots = kt->blocks * AVL_KARY_B;
+	buffer = (char*)malloc(slots * (sizeof(int) + sizeof(void*)) + 64);
+	if (buffer == NULL) return -1;
+	kt->buffer = buffer;
+	kt->keys = (int*)(((size_t)buffer + 63) & ~((size_t)63));
+	kt->items = (void**)(kt->keys + slots);
+	_avl_kary_fill(kt, avl_node_first(root), 0, offset, key_offset);
+	cpu = _avl_kary_cpu();
+	kt->simd = (simd < 0 || simd > cpu)? cpu : simd;
+	kt->search = _avl_kary_search_scalar;
+#if AVL_KARY_X86
+	if (kt->simd == 2) kt->search = _avl_kary_search_avx2;
+	else if (kt->simd == 1) kt->search = _avl_kary_search_sse2;
+#endif
+	return 0;
+}
+
+void avl_kary_destroy(struct avl_kary *kt)
+{
+	if (kt->buffer) free(kt->buffer);
+	kt->buffer = NULL;
+	kt->keys = NULL;
+	kt->items = NULL;
+	kt->count = 0;
+	kt->blocks = 0;
+}
+
+void *avl_kary_lower_bound(const struct avl_kary *kt, int key)
+{
+	size_t slot = kt->search(kt->keys, kt->blocks, key);
+	return (slot == (size_t)-1)? NULL : kt->items[slot];
+}
+
+void *avl_kary_find(const struct avl_kary *kt, int key)
+{
+	size_t slot = kt->search(kt->keys, kt->blocks, key);
+	if (slot == (size_t)-1 || kt->keys[slot] != key) return NULL;
+	return kt->items[slot];
+}
+
+
@@ -0,0 +1,131 @@
+/*********************************************************************
+ *
+ * avlsnap.h - read-only snapshot of avl_tree in Eytzinger layout
+ *
+ * NOTE:
+ * keys are copied out of the tree in BFS order (children of slot k are
+ * 2k and 2k + 1), so the top levels share a few cache lines and the
+ * descent can prefetch four levels ahead without any branch on the
+ * result of compare. a snapshot stays valid until the tree changes
+ * through any avl_tree_* function, see avl_snap_valid.
+ * avl_kary is a second format for int keys, searched with sse2/avx2
+ * compare + movemask selected at runtime, or scalar code.
+ *
+ *********************************************************************/
+#ifndef _AVLSNAP_H__
+#define _AVLSNAP_H__
+
+#include "avlmini.h"
+
+
+/*====================================================================*/
+/* frozen snapshot                                                    */
+/*====================================================================*/
+struct avl_snap
+{
+	char *keys;                 /* key_size bytes per slot, slot 0 unused */
+	void **items;               /* user data per slot, slot 0 unused */
+	size_t count;               /* number of keys */
+	size_t key_size;            /* size of a key */
+	size_t stamp;               /* tree->stamp when frozen */
+	const struct avl_tree *tree;
+	void *buffer;               /* memory block of keys and items */
+	/* compare two keys: returns 0 for equal, < 0 or > 0 */
+	int (*compare)(const void *key1, const void *key2);
+};
+
+/* static b-tree of int keys, 16 keys (one cache line) per block, the
+ * block k has children k * 17 + i + 1 for i in [0, 16] */
+#define AVL_KARY_B    16
+
+struct avl_kary
+{
+	int *keys;                  /* AVL_KARY_B keys per block, 64 aligned */
+	void **items;               /* user data per key slot, NULL for pads */
+	size_t count;               /* number of keys */
+	size_t blocks;              /* number of blocks */
+	int simd;                   /* 0: scalar, 1: sse2, 2: avx2 */
+	void *buffer;               /* memory block of keys and items */
+	/* returns the slot of the first key not less than key, or -1 */
+	size_t (*search)(const int *keys, size_t blocks, int key);
+};
+
+#define avl_snap_key(snap, slot) ((snap)->keys + (slot) * (snap)->key_size)
+#define avl_snap_item(snap, slot) ((snap)->items[slot])
+
+/* non-zero if the tree has not been changed since frozen */
+#define avl_snap_valid(snap) \
+	((snap)->tree != NULL && (snap)->tree->stamp == (snap)->stamp)
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* copy key_size bytes at key_offset of each data in the tree, returns
+ * zero for success, -1 for out of memory. compare takes two keys */
+int avl_tree_freeze(struct avl_tree *tree, struct avl_snap *snap,
+		size_t key_offset, size_t key_size,
+		int (*compare)(const void *key1, const void *key2));
+
+void avl_snap_destroy(struct avl_snap *snap);
+
+/* returns data with the key, or NULL */
+void *avl_snap_find(const struct avl_snap *snap, const void *key);
+
+/* returns the first data not less than key, or NULL */
+void *avl_snap_lower_bound(const struct avl_snap *snap, const void *key);
+
+/* build from nodes of root in order, offset is the avl_node offset and
+ * key_offset the int key offset in user data, simd selects the highest
+ * instruction set supported by cpu when set to -1, or limits it. returns
+ * zero for success, -1 for out of memory. the snapshot does not track
+ * later changes of root */
+int avl_kary_build(struct avl_kary *kt, struct avl_root *root,
+		size_t offset, size_t key_offset, int simd);
+
+void avl_kary_destroy(struct avl_kary *kt);
+
+/* returns data with the key, or NULL */
+void *avl_kary_find(const struct avl_kary *kt, int key);
+
+/* returns the first data not less than key, or NULL */
+void *avl_kary_lower_bound(const struct avl_kary *kt, int key);
+
+/* number of trailing one bits */
+static inline int _avl_snap_ctz1(size_t x) {
+#if defined(__GNUC__)
+	return __builtin_ctzll((unsigned long long)~x);
+#else
+	int n = 0;
+	for (; x & 1; x >>= 1) n++;
+	return n;
+#endif
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+
+/*--------------------------------------------------------------------*/
+/* snapshot templates                                                 */
+/*--------------------------------------------------------------------*/
+
+/* slot of the first key not less than key, 0 if none */
+#define avl_snap_search(snap, key, compare_fn, res_slot) do { \
+		const char *__keys = (snap)->keys; \
+		size_t __n = (snap)->count; \
+		size_t __size = (snap)->key_size; \
+		size_t __k = 1; \
+		while (__k <= __n) { \
+			AVL_PREFETCH(__keys + __k * 16 * __size); \
+			__k = 2 * __k + ((compare_fn)(key, __keys + __k * __size) > 0); \
+		} \
+		(res_slot) = __k >> (_avl_snap_ctz1(__k) + 1); \
+	}   while (0)
+
+
+#endif
+
+
@@ -0,0 +1,136 @@
+/*********************************************************************
+ *
+ * avlsync.h - mutex, atomics and threads for the concurrent modules
+ *
+ * NOTE:
+ * a thin layer over win32 or pthread and gcc atomic builtins, only
+ * what avlpersist and friends need, nothing more
+ *
+ *********************************************************************/
+#ifndef _AVLSYNC_H__
+#define _AVLSYNC_H__
+
+#include "avlmini.h"
+
+#if (defined(_WIN32) || defined(WIN32))
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+
+/*====================================================================*/
+/* mutex                                                              */
+/*====================================================================*/
+#if (defined(_WIN32) || defined(WIN32))
+typedef CRITICAL_SECTION avl_mutex_t;
+#define avl_mutex_init(m) InitializeCriticalSection(m)
+#define avl_mutex_destroy(m) DeleteCriticalSection(m)
+#define avl_mutex_lock(m) EnterCriticalSection(m)
+#define avl_mutex_unlock(m) LeaveCriticalSection(m)
+#else
+typedef pthread_mutex_t avl_mutex_t;
+#define avl_mutex_init(m) pthread_mutex_init(m, NULL)
+#define avl_mutex_destroy(m) pthread_mutex_destroy(m)
+#define avl_mutex_lock(m) pthread_mutex_lock(m)
+#define avl_mutex_unlock(m) pthread_mutex_unlock(m)
+#endif
+
+
+/* reader writer lock */
+#if (defined(_WIN32) || defined(WIN32))
+typedef SRWLOCK avl_rwlock_t;
+#define avl_rwlock_init(l) InitializeSRWLock(l)
+#define avl_rwlock_destroy(l) ((void)(l))
+#define avl_rwlock_rdlock(l) AcquireSRWLockShared(l)
+#define avl_rwlock_rdunlock(l) ReleaseSRWLockShared(l)
+#define avl_rwlock_wrlock(l) AcquireSRWLockExclusive(l)
+#define avl_rwlock_wrunlock(l) ReleaseSRWLockExclusive(l)
+#else
+typedef pthread_rwlock_t avl_rwlock_t;
+#define avl_rwlock_init(l) pthread_rwlock_init(l, NULL)
+#define avl_rwlock_destroy(l) pthread_rwlock_destroy(l)
+#define avl_rwlock_rdlock(l) pthread_rwlock_rdlock(l)
+#define avl_rwlock_rdunlock(l) pthread_rwlock_unlock(l)
+#define avl_rwlock_wrlock(l) pthread_rwlock_wrlock(l)
+#define avl_rwlock_wrunlock(l) pthread_rwlock_unlock(l)
+#endif
+
+
+/*====================================================================*/
+/* atomics on int and pointers                                        */
+/*====================================================================*/
+#if defined(_MSC_VER)
+#define avl_atomic_inc(p) InterlockedIncrement((volatile LONG*)(p))
+#define avl_atomic_dec(p) InterlockedDecrement((volatile LONG*)(p))
+#define avl_atomic_load(p) (_ReadWriteBarrier(), *(volatile long*)(p))
+#define avl_atomic_store(p, v) do { _ReadWriteBarrier(); \
+		*(volatile long*)(p) = (v); } while (0)
+#define avl_atomic_load_ptr(p) \
+	(_ReadWriteBarrier(), (void*)*(void* volatile*)(p))
+#define avl_atomic_store_ptr(p, v) do { _ReadWriteBarrier(); \
+		*(void* volatile*)(p) = (void*)(v); } while (0)
+#define avl_atomic_cas(p, o, n) \
+	(InterlockedCompareExchange((volatile LONG*)(p), (n), (o)) == (o))
+#define avl_atomic_xchg(p, v) InterlockedExchange((volatile LONG*)(p), (v))
+#define avl_atomic_fence() MemoryBarrier()
+#define avl_atomic_rmb() _ReadWriteBarrier()
+#define avl_atomic_wmb() _ReadWriteBarrier()
+#define avl_cpu_relax() YieldProcessor()
+#elif defined(__GNUC__)
+#define avl_atomic_inc(p) __sync_add_and_fetch((p), 1)
+#define avl_atomic_dec(p) __sync_sub_and_fetch((p), 1)
+#define avl_atomic_load(p) __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define avl_atomic_store(p, v) __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+#define avl_atomic_load_ptr(p) avl_atomic_load(p)
+#define avl_atomic_store_ptr(p, v) avl_atomic_store(p, v)
+#define avl_atomic_cas(p, o, n) __sync_bool_compare_and_swap((p), (o), (n))
+#define avl_atomic_xchg(p, v) __atomic_exchange_n((p), (v), __ATOMIC_ACQ_REL)
+#define avl_atomic_fence() __atomic_thread_fence(__ATOMIC_SEQ_CST)
+#define avl_atomic_rmb() __atomic_thread_fence(__ATOMIC_ACQUIRE)
+#define avl_atomic_wmb() __atomic_thread_fence(__ATOMIC_RELEASE)
+#if defined(__x86_64__) || defined(__i386__)
+#define avl_cpu_relax() __asm__ __volatile__("pause")
+#else
+#define avl_cpu_relax() ((void)0)
+#endif
+#else
+#error atomics are not available for this compiler
+#endif
+
+
+/*====================================================================*/
+/* threads                                                            */
+/*====================================================================*/
+#if (defined(_WIN32) || defined(WIN32))
+typedef HANDLE avl_thread_t;
+#define avl_thread_create(t, fn, arg) \
+	(((*(t)) = CreateThread(NULL, 0, (LPTHREAD_START_ROUTINE)(fn), \
+		(arg), 0, NULL)) == NULL)
+#define avl_thread_join(t) do { WaitForSingleObject(t, INFINITE); \
+		CloseHandle(t); } while (0)
+#define avl_thread_yield() SwitchToThread()
+#else
+typedef pthread_t avl_thread_t;
+#define avl_thread_create(t, fn, arg) \
+	pthread_create((t), NULL, (void*(*)(void*))(fn), (arg))
+#define avl_thread_join(t) pthread_join(t, NULL)
+#define avl_thread_yield() sched_yield()
+#endif
+
+/* spin lock on a long, yields now and then for oversubscribed cpus */
+#define avl_spin_lock(l) do { \
+		int __spins = 0; \
+		while (!avl_atomic_cas((l), 0, 1)) { \
+			if ((++__spins & 63) == 0) avl_thread_yield(); \
+			else avl_cpu_relax(); \
+		} \
+	}	while (0)
+
+#define avl_spin_unlock(l) avl_atomic_store((l), 0)
+
+
+#endif
+
+
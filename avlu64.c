@@ -0,0 +1,123 @@
+#include "avlu64.h"
+
+
+/*====================================================================*/
+/* rebalancing core for integer keyed nodes                           */
+/*====================================================================*/
+#define AVL_T_NAME(x)               _avl_u64##x
+#define AVL_T_HANDLE                struct avl_u64 *
+#define AVL_T_ROOT                  struct avl_u64_root
+#define AVL_T_CTX                   const void *
+#define AVL_T_NIL                   NULL
+#define AVL_T_LEFT(r, n)            ((n)->child[AVL_LEFT])
+#define AVL_T_RIGHT(r, n)           ((n)->child[AVL_RIGHT])
+#define AVL_T_PARENT(r, n)          ((n)->parent)
+#define AVL_T_SET_PARENT(r, n, p)   do { (n)->parent = (p); } while (0)
+#define AVL_T_HEIGHT(r, n)          ((n)->height)
+#define AVL_T_SET_HEIGHT(r, n, h)   do { (n)->height = (h); } while (0)
+#define AVL_T_ROOTNODE(r)           ((r)->node)
+#define AVL_T_ROTATE(c, o, n)       ((void)(c))
+#define AVL_T_COPY(c, o, n)         ((void)(c))
+#define AVL_T_PROPAGATE(c, n)       ((void)(c))
+#define AVL_T_UNLINK(r, n)          ((void)0)
+#define AVL_T_SUBST(r, o, n)        ((void)0)
+
+#include "avlcore.h"
+
+
+/*====================================================================*/
+/* integer keyed node manipulation                                    */
+/*====================================================================*/
+
+struct avl_u64 *avl_u64_first(struct avl_u64_root *root)
+{
+	struct avl_u64 *node = root->node;
+	if (node == NULL) return NULL;
+	while (node->child[AVL_LEFT])
+		node = node->child[AVL_LEFT];
+	return node;
+}
+
+struct avl_u64 *avl_u64_last(struct avl_u64_root *root)
+{
+	struct avl_u64 *node = root->node;
+	if (node == NULL) return NULL;
+	while (node->child[AVL_RIGHT])
+		node = node->child[AVL_RIGHT];
+	return node;
+}
+
+/* dir is AVL_RIGHT for the successor and AVL_LEFT for the predecessor */
+static struct avl_u64 *_avl_u64_step(struct avl_u64 *node, int dir)
+{
+	if (node == NULL) return NULL;
+	if (node->child[dir]) {
+		node = node->child[dir];
+		while (node->child[!dir])
+			node = node->child[!dir];
+	}
+	else {
+		while (1) {
+			struct avl_u64 *last = node;
+			node = node->parent;
+			if (node == NULL) break;
+			if (node->child[!dir] == last) break;
+		}
+	}
+	return node;
+}
+
+struct avl_u64 *avl_u64_next(struct avl_u64 *node)
+{
+	return _avl_u64_step(node, AVL_RIGHT);
+}
+
+struct avl_u64 *avl_u64_prev(struct avl_u64 *node)
+{
+	return _avl_u64_step(node, AVL_LEFT);
+}
+
+void avl_u64_post_insert(struct avl_u64 *node, struct avl_u64_root *root)
+{
+	_avl_u64_post_insert(node, root, NULL);
+}
+
+void avl_u64_erase(struct avl_u64 *node, struct avl_u64_root *root)
+{
+	_avl_u64_erase(node, root, NULL);
+}
+
+void avl_u64_replace(struct avl_u64 *victim, struct avl_u64 *newnode,
+		struct avl_u64_root *root)
+{
+	_avl_u64_replace(victim, newnode, root, NULL);
+}
+
+struct avl_u64 *avl_u64_tear(struct avl_u64_root *root, struct avl_u64 **next)
+{
+	struct avl_u64 *node = *next;
+	struct avl_u64 *parent;
+	if (node == NULL) {
+		if (root->node == NULL) 
+			return NULL;
+		node = root->node;
+	}
+	/* sink down to the leaf, the right subtree is torn next */
+	while (1) {
+		if (node->child[AVL_LEFT]) node = node->child[AVL_LEFT];
+		else if (node->child[AVL_RIGHT]) node = node->child[AVL_RIGHT];
+		else break;
+	}
+	parent = node->parent;
+	if (parent == NULL) {
+		*next = NULL;
+		root->node = NULL;
+		return node;
+	}
+	parent->child[parent->child[AVL_RIGHT] == node] = NULL;
+	node->height = 0;
+	*next = parent;
+	return node;
+}
+
+
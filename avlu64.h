@@ -0,0 +1,147 @@
+/*********************************************************************
+ *
+ * avlu64.h - avl tree of integer keys stored in the node
+ *
+ * NOTE:
+ * the key sits in the node next to the links and the two children are
+ * an array, so the descent indexes child[key > node->key] without a
+ * branch or a compare callback. the balancing code is shared with
+ * avl_node through avlcore.h:
+ *
+ * struct item { struct avl_u64 node; ... } *x;
+ * x->node.key = 42;
+ * dup = avl_u64_add(&root, &x->node);
+ *
+ *********************************************************************/
+#ifndef _AVLU64_H__
+#define _AVLU64_H__
+
+#include "avlmini.h"
+
+
+/*====================================================================*/
+/* avl_u64 - integer keyed avl node                                   */
+/*====================================================================*/
+
+/* you can change this by config.h or predefined macro */
+#ifndef AVL_U64_KEY
+#define AVL_U64_KEY    unsigned long long
+#endif
+
+/* key and children lead, a descent reads the first 24 bytes only */
+struct avl_u64
+{
+	AVL_U64_KEY key;
+	struct avl_u64 *child[2];   /* AVL_LEFT and AVL_RIGHT */
+	struct avl_u64 *parent;     /* pointing to node itself for empty node */
+	int height;                 /* equals to 1 + max height in childs */
+};
+
+struct avl_u64_root
+{
+	struct avl_u64 *node;       /* root node */
+};
+
+#define avl_u64_init(node) do { ((node)->parent) = (node); } while (0)
+#define avl_u64_empty(node) ((node)->parent == (node))
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct avl_u64 *avl_u64_first(struct avl_u64_root *root);
+struct avl_u64 *avl_u64_last(struct avl_u64_root *root);
+struct avl_u64 *avl_u64_next(struct avl_u64 *node);
+struct avl_u64 *avl_u64_prev(struct avl_u64 *node);
+
+static inline void avl_u64_link(struct avl_u64 *node, struct avl_u64 *parent,
+		struct avl_u64 **avl_link) {
+	node->parent = parent;
+	node->height = 0;
+	node->child[AVL_LEFT] = node->child[AVL_RIGHT] = NULL;
+	avl_link[0] = node;
+}
+
+/* avl insert rebalance and erase */
+void avl_u64_post_insert(struct avl_u64 *node, struct avl_u64_root *root);
+void avl_u64_erase(struct avl_u64 *node, struct avl_u64_root *root);
+
+/* newnode must have the same key as victim */
+void avl_u64_replace(struct avl_u64 *victim, struct avl_u64 *newnode,
+		struct avl_u64_root *root);
+
+/* tear down the whole tree, see avl_node_tear */
+struct avl_u64 *avl_u64_tear(struct avl_u64_root *root, struct avl_u64 **next);
+
+
+/*--------------------------------------------------------------------*/
+/* inline search, the child index is the result of one compare        */
+/*--------------------------------------------------------------------*/
+
+/* the index is taken before the equality test and a match returns from
+ * inside the loop: testing first, or breaking out, made gcc emit a
+ * branch per level or a longer chain and the search twice as slow */
+static inline struct avl_u64 *
+avl_u64_find(struct avl_u64_root *root, AVL_U64_KEY key) {
+	struct avl_u64 *n = root->node;
+	while (n) {
+		int right = (n->key < key);
+		if (n->key == key) return n;
+		n = n->child[right];
+	}
+	return NULL;
+}
+
+/* first node not less than key */
+static inline struct avl_u64 *
+avl_u64_lower_bound(struct avl_u64_root *root, AVL_U64_KEY key) {
+	struct avl_u64 *n = root->node;
+	struct avl_u64 *res = NULL;
+	while (n) {
+		int right = (n->key < key);
+		if (n->key == key) return n;
+		res = (right)? res : n;
+		n = n->child[right];
+	}
+	return res;
+}
+
+/* first node greater than key */
+static inline struct avl_u64 *
+avl_u64_upper_bound(struct avl_u64_root *root, AVL_U64_KEY key) {
+	struct avl_u64 *n = root->node;
+	struct avl_u64 *res = NULL;
+	while (n) {
+		int right = (n->key <= key);
+		res = (right)? res : n;
+		n = n->child[right];
+	}
+	return res;
+}
+
+/* returns NULL for success, otherwise the node with the same key */
+static inline struct avl_u64 *
+avl_u64_add(struct avl_u64_root *root, struct avl_u64 *node) {
+	struct avl_u64 **link = &root->node;
+	struct avl_u64 *parent = NULL;
+	AVL_U64_KEY key = node->key;
+	while (link[0]) {
+		int right;
+		parent = link[0];
+		right = (parent->key < key);
+		if (parent->key == key) return parent;
+		link = &parent->child[right];
+	}
+	avl_u64_link(node, parent, link);
+	avl_u64_post_insert(node, root);
+	return NULL;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
+
@@ -26,6 +26,9 @@ static void __rb_rotate_left(struct rb_node *node, struct rb_root *root)
 {
 	struct rb_node *right = node->rb_right;
 
+#ifdef AVL_ROTATION_COUNT
+	avl_rotation_count++;
+#endif
 	if ((node->rb_right = right->rb_left))
 		right->rb_left->rb_parent = node;
 	right->rb_left = node;
@@ -46,6 +49,9 @@ static void __rb_rotate_right(struct rb_node *node, struct rb_root *root)
 {
 	struct rb_node *left = node->rb_left;
 
+#ifdef AVL_ROTATION_COUNT
+	avl_rotation_count++;
+#endif
 	if ((node->rb_left = left->rb_right))
 		left->rb_right->rb_parent = node;
 	left->rb_right = node;
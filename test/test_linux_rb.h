@@ -74,15 +74,30 @@ static inline int rb_node_compare(const void *n1, const void *n2)
 static inline int _int_max(int x, int y) { return (x > y)? x : y;  }
 
 
-static int rb_tree_height(struct rb_node *node)
+/* walks parent links without recursion, so it can be inlined */
+static inline int rb_tree_height(struct rb_node *node)
 {
-	if (node == NULL) 
-		return 0;
-	else if (node->rb_left == NULL && node->rb_right == NULL) 
-		return 1;
-	else
-		return _int_max(rb_tree_height(node->rb_left),
-				rb_tree_height(node->rb_right)) + 1;
+	struct rb_node *top = (node)? node->rb_parent : NULL;
+	struct rb_node *prev = top, *next;
+	int depth = 0, height = 0;
+	while (node != top) {
+		if (prev == node->rb_parent) {
+			depth++;
+			if (depth > height) height = depth;
+			next = (node->rb_left)? node->rb_left : node->rb_right;
+			if (next == NULL) next = node->rb_parent;
+		}
+		else if (prev == node->rb_left && node->rb_right) {
+			next = node->rb_right;
+		}
+		else {
+			next = node->rb_parent;
+		}
+		if (next == node->rb_parent) depth--;
+		prev = node;
+		node = next;
+	}
+	return height;
 }
 
 static inline struct RbNode *rb_search(struct rb_root *root, int key)
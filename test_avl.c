@@ -4,6 +4,18 @@
 
 
 
+//---------------------------------------------------------------------
+// rotations, compile with -DAVL_ROTATION_COUNT
+//---------------------------------------------------------------------
+#ifdef AVL_ROTATION_COUNT
+#define rotation_reset() do { avl_rotation_count = 0; } while (0)
+#define rotation_print() printf(", rotations=%d", (int)avl_rotation_count)
+#else
+#define rotation_reset() do { } while (0)
+#define rotation_print() do { } while (0)
+#endif
+
+
 //---------------------------------------------------------------------
 // random 
 //---------------------------------------------------------------------
@@ -37,6 +49,7 @@ static void benchmark(const char *text, int mode, int count)
 	printf("%s with %d nodes:\n", text, count);
 
 	sleepms(400);
+	rotation_reset();
 	ts = gettime();
 
 	// test insert
@@ -61,6 +74,7 @@ static void benchmark(const char *text, int mode, int count)
 	ts = gettime() - ts;
 	total += ts;
 	printf("insert time: %dms", (int)ts);
+	rotation_print();
 
 	if (mode == 0) {
 		printf(", height=%d\n", avl_tree_height(avl_root.node));
@@ -107,6 +121,7 @@ static void benchmark(const char *text, int mode, int count)
 	printf("search time: %dms error=%d\n", (int)ts, missing);
 
 	sleepms(200);
+	rotation_reset();
 	ts = gettime();
 
 	if (mode == 0) {
@@ -128,7 +143,9 @@ static void benchmark(const char *text, int mode, int count)
 
 	ts = gettime() - ts;
 	total += ts;
-	printf("delete time: %dms\n", (int)ts);
+	printf("delete time: %dms", (int)ts);
+	rotation_print();
+	printf("\n");
 
 	if (avl_nodes) {
 		for (i = 0; i < count; i++) 
@@ -146,6 +163,1364 @@ static void benchmark(const char *text, int mode, int count)
 	printf("\n");
 }
 
+//---------------------------------------------------------------------
+// bulk build vs incremental insert with sorted nodes
+//---------------------------------------------------------------------
+static void benchmark_build(int count)
+{
+	struct avl_node **nodes;
+	struct avl_root avl_root;
+	unsigned int ts;
+	int i, mode;
+
+	nodes = (struct avl_node**)malloc(sizeof(void*) * count);
+	for (i = 0; i < count; i++) {
+		nodes[i] = (struct avl_node*)avl_node_new(i);
+	}
+
+	printf("sorted build with %d nodes:\n", count);
+
+	for (mode = 0; mode < 2; mode++) {
+		avl_root.node = NULL;
+		sleepms(200);
+		ts = gettime();
+		if (mode == 0) {
+			for (i = 0; i < count; i++) {
+				struct avl_node *dup;
+				avl_node_add(&avl_root, nodes[i], avl_node_compare, dup);
+				assert(dup == NULL);
+			}
+		}
+		else {
+			avl_node_build(&avl_root, nodes, count);
+		}
+		ts = gettime() - ts;
+		printf("%s time: %dms, height=%d\n", 
+				(mode == 0)? "insert" : "build", (int)ts,
+				avl_tree_height(avl_root.node));
+		avl_test_validate(&avl_root);
+	}
+
+	for (i = 0; i < count; i++) 
+		free(nodes[i]);
+	free(nodes);
+	printf("\n");
+}
+
+//---------------------------------------------------------------------
+// union vs naive loop of avl_node_next + avl_node_add
+//---------------------------------------------------------------------
+static void benchmark_union(int count, int other)
+{
+	struct MyNode *a1, *a2, *b1, *b2, *c1;
+	struct avl_root r1, r2, t1, t2;
+	struct avl_node *node;
+	unsigned int ts;
+	int *keys, i, dups = 0;
+
+	a1 = (struct MyNode*)malloc(sizeof(struct MyNode) * count);
+	a2 = (struct MyNode*)malloc(sizeof(struct MyNode) * count);
+	b1 = (struct MyNode*)malloc(sizeof(struct MyNode) * other);
+	b2 = (struct MyNode*)malloc(sizeof(struct MyNode) * other);
+	c1 = (struct MyNode*)malloc(sizeof(struct MyNode) * other);
+	keys = (int*)malloc(sizeof(int) * count * 2);
+	random_keys(keys, count * 2, 0x11223344);
+	r1.node = r2.node = t1.node = t2.node = NULL;
+
+	for (i = 0; i < count; i++) {
+		struct avl_node *dup;
+		a1[i].key = a2[i].key = i * 2;
+		avl_node_add(&r1, &a1[i].node, avl_node_compare, dup);
+		avl_node_add(&r2, &a2[i].node, avl_node_compare, dup);
+		assert(dup == NULL);
+	}
+	for (i = 0; i < other; i++) {
+		struct avl_node *dup;
+		b1[i].key = b2[i].key = c1[i].key = keys[i];
+		avl_node_add(&t1, &b1[i].node, avl_node_compare, dup);
+		avl_node_add(&t2, &b2[i].node, avl_node_compare, dup);
+		assert(dup == NULL);
+	}
+
+	printf("union %d nodes with %d nodes:\n", count, other);
+	sleepms(200);
+	ts = gettime();
+	for (node = avl_node_first(&t1); node; node = avl_node_next(node)) {
+		struct MyNode *src = AVL_ENTRY(node, struct MyNode, node);
+		struct avl_node *dup;
+		avl_node_add(&r1, &(c1[src - b1].node), avl_node_compare, dup);
+		if (dup) dups++;
+	}
+	ts = gettime() - ts;
+	printf("naive time: %dms, dups=%d\n", (int)ts, dups);
+	avl_test_validate(&r1);
+
+	sleepms(200);
+	ts = gettime();
+	dups = (int)avl_node_union(&r2, &t2, avl_node_compare, NULL);
+	ts = gettime() - ts;
+	printf("union time: %dms, dups=%d\n", (int)ts, dups);
+	avl_test_validate(&r2);
+
+	free(a1);
+	free(a2);
+	free(b1);
+	free(b2);
+	free(c1);
+	free(keys);
+	printf("\n");
+}
+
+//---------------------------------------------------------------------
+// full scans: parent climbing vs avl_node_next/prev (threaded or not)
+//---------------------------------------------------------------------
+static struct avl_node *climb_next(struct avl_node *node)
+{
+	if (node->right) {
+		node = node->right;
+		while (node->left) node = node->left;
+		return node;
+	}
+	while (AVL_PARENT(node) && AVL_PARENT(node)->right == node) 
+		node = AVL_PARENT(node);
+	return AVL_PARENT(node);
+}
+
+static struct avl_node *climb_prev(struct avl_node *node)
+{
+	if (node->left) {
+		node = node->left;
+		while (node->right) node = node->right;
+		return node;
+	}
+	while (AVL_PARENT(node) && AVL_PARENT(node)->left == node) 
+		node = AVL_PARENT(node);
+	return AVL_PARENT(node);
+}
+
+static void benchmark_scan(int count, int times)
+{
+	struct avl_root avl_root;
+	struct avl_node **nodes;
+	struct avl_node *node;
+	unsigned int ts, total = 0;
+	int *keys, i, k, mode;
+
+	keys = (int*)malloc(sizeof(int) * count);
+	nodes = (struct avl_node**)malloc(sizeof(void*) * count);
+	random_keys(keys, count, 0x11223344);
+	avl_root.node = NULL;
+	for (i = 0; i < count; i++) {
+		struct avl_node *dup;
+		nodes[i] = (struct avl_node*)avl_node_new(keys[i]);
+		avl_node_add(&avl_root, nodes[i], avl_node_compare, dup);
+		assert(dup == NULL);
+	}
+
+	printf("scan %d nodes %d times (%s):\n", count, times,
+#ifdef AVL_THREADED
+			"threaded"
+#else
+			"not threaded"
+#endif
+			);
+
+	for (mode = 0; mode < 4; mode++) {
+		sleepms(200);
+		ts = gettime();
+		for (k = 0; k < times; k++) {
+			switch (mode) {
+			case 0:
+				node = avl_node_first(&avl_root);
+				for (; node; node = climb_next(node)) total += avl_key(node);
+				break;
+			case 1:
+				node = avl_node_last(&avl_root);
+				for (; node; node = climb_prev(node)) total += avl_key(node);
+				break;
+			case 2:
+				node = avl_node_first(&avl_root);
+				for (; node; node = avl_node_next(node)) total += avl_key(node);
+				break;
+			default:
+				node = avl_node_last(&avl_root);
+				for (; node; node = avl_node_prev(node)) total += avl_key(node);
+				break;
+			}
+		}
+		ts = gettime() - ts;
+		printf("%s %s time: %dms\n", (mode < 2)? "climbing" : "avl_node",
+				(mode & 1)? "descending" : "ascending", (int)ts);
+	}
+	printf("checksum=%u\n", total);
+
+	for (i = 0; i < count; i++) 
+		free(nodes[i]);
+	free(nodes);
+	free(keys);
+	printf("\n");
+}
+
+//---------------------------------------------------------------------
+// nearly sorted keys: avl_node_add vs avl_node_add_hint
+//---------------------------------------------------------------------
+static void benchmark_hint(int count, int window)
+{
+	struct avl_root avl_root;
+	struct MyNode *nodes;
+	unsigned int ts;
+	int *keys, i, mode;
+
+	keys = (int*)malloc(sizeof(int) * count);
+	nodes = (struct MyNode*)malloc(sizeof(struct MyNode) * count);
+	for (i = 0; i < count; i++) keys[i] = i;
+	for (i = 0; window > 1 && i < count; i++) {
+		int j = i + RANDOM(window);
+		int t = keys[i];
+		if (j >= count) continue;
+		keys[i] = keys[j];
+		keys[j] = t;
+	}
+
+	printf("add %d keys shuffled in a window of %d:\n", count, window);
+
+	for (mode = 0; mode < 2; mode++) {
+		struct avl_node *hint = NULL;
+		for (i = 0; i < count; i++) nodes[i].key = keys[i];
+		avl_root.node = NULL;
+		sleepms(200);
+		ts = gettime();
+		for (i = 0; i < count; i++) {
+			struct avl_node *dup;
+			if (mode == 0) {
+				avl_node_add(&avl_root, &nodes[i].node, avl_node_compare, dup);
+			}	else {
+				avl_node_add_hint(&avl_root, &nodes[i].node, hint,
+						avl_node_compare, dup);
+				hint = &nodes[i].node;
+			}
+			assert(dup == NULL);
+		}
+		ts = gettime() - ts;
+		printf("%s time: %dms\n", (mode == 0)? "avl_node_add" :
+				"avl_node_add_hint", (int)ts);
+		avl_test_validate(&avl_root);
+	}
+
+	free(nodes);
+	free(keys);
+	printf("\n");
+}
+
+//---------------------------------------------------------------------
+// delete min: avl_node_first + erase vs avl_node_pop_first
+//---------------------------------------------------------------------
+static void benchmark_cached(int count)
+{
+	struct avl_root_cached cached;
+	struct MyNode *nodes;
+	unsigned int ts, total;
+	int *keys, i, mode;
+
+	keys = (int*)malloc(sizeof(int) * count);
+	nodes = (struct MyNode*)malloc(sizeof(struct MyNode) * count);
+	random_keys(keys, count, 0x11223344);
+
+	printf("delete min of %d nodes:\n", count);
+
+	for (mode = 0; mode < 2; mode++) {
+		avl_root_cached_init(&cached);
+		for (i = 0; i < count; i++) {
+			struct avl_node *dup;
+			nodes[i].key = keys[i];
+			avl_node_add_cached(&cached, &nodes[i].node, avl_node_compare, dup);
+			assert(dup == NULL);
+		}
+		total = 0;
+		sleepms(200);
+		ts = gettime();
+		for (i = 0; i < count; i++) {
+			struct avl_node *node;
+			if (mode == 0) {
+				node = avl_node_first(&cached.root);
+				avl_node_erase(node, &cached.root);
+			}	else {
+				node = avl_node_pop_first(&cached);
+			}
+			total += avl_key(node);
+		}
+		ts = gettime() - ts;
+		assert(cached.root.node == NULL);
+		printf("%s time: %dms checksum=%u\n", (mode == 0)?
+				"avl_node_first" : "avl_node_pop_first", (int)ts, total);
+	}
+
+	free(nodes);
+	free(keys);
+	printf("\n");
+}
+
+//---------------------------------------------------------------------
+// cached ends checked after each add, erase, replace and pop
+//---------------------------------------------------------------------
+
+/* key k lives in a[k] or its replacement b[k], in[k] says which one (0
+ * for none). pops are one step in pop_rate per mille */
+static void check_cached(int range, int steps, int pop_rate)
+{
+	struct MyNode *a, *b, *n;
+	struct avl_root_cached cached;
+	struct avl_node *node, *dup;
+	char *in;
+	int i, k, op, size = 0;
+
+	a = (struct MyNode*)malloc(sizeof(struct MyNode) * range);
+	b = (struct MyNode*)malloc(sizeof(struct MyNode) * range);
+	in = (char*)malloc(range);
+	for (k = 0; k < range; k++) {
+		a[k].key = b[k].key = k;
+		in[k] = 0;
+	}
+	avl_root_cached_init(&cached);
+
+	for (i = 0; i < steps; i++) {
+		k = RANDOM(range);
+		n = (in[k] == 1)? &a[k] : &b[k];
+		op = ((int)RANDOM(1000) < pop_rate)? 3 + RANDOM(2) : RANDOM(3);
+		if (op == 0 || (op < 3 && in[k] == 0)) {
+			avl_node_add_cached(&cached, &a[k].node, avl_node_compare, dup);
+			if (in[k] == 0) {
+				assert(dup == NULL);
+				in[k] = 1;
+				size++;
+			}	else {
+				assert(dup == &n->node);
+			}
+		}
+		else if (op == 1) {
+			avl_node_erase_cached(&n->node, &cached);
+			in[k] = 0;
+			size--;
+		}
+		else if (op == 2) {
+			struct MyNode *x = (in[k] == 1)? &b[k] : &a[k];
+			avl_node_replace_cached(&n->node, &x->node, &cached);
+			in[k] = (in[k] == 1)? 2 : 1;
+		}
+		else {
+			int want = (op == 3)? 0 : range - 1, step = (op == 3)? 1 : -1;
+			while (size > 0 && in[want] == 0) want += step;
+			node = (op == 3)? avl_node_pop_first(&cached) :
+				avl_node_pop_last(&cached);
+			if (size == 0) {
+				assert(node == NULL);
+			}	else {
+				assert(node == ((in[want] == 1)? &a[want].node :
+						&b[want].node));
+				in[want] = 0;
+				size--;
+			}
+		}
+		assert(cached.leftmost == avl_node_first(&cached.root));
+		assert(cached.rightmost == avl_node_last(&cached.root));
+		if ((i & 63) == 0 || range < 64) {
+			assert(avl_test_validate(&cached.root) == 0);
+		}
+	}
+
+	for (k = 0, node = avl_node_first(&cached.root); k < range; k++) {
+		if (in[k] == 0) continue;
+		assert(node == ((in[k] == 1)? &a[k].node : &b[k].node));
+		node = avl_node_next(node);
+	}
+	assert(node == NULL);
+	printf("cached ends in %d keys, %d steps, %d%% pops: ok\n",
+			range, steps, pop_rate / 10);
+
+	free(in);
+	free(b);
+	free(a);
+}
+
+static void check_cacheds(void)
+{
+	check_cached(1, 1000, 300);
+	check_cached(4, 10000, 300);
+	check_cached(64, 100000, 100);
+	check_cached(1000, 100000, 300);
+	check_cached(100000, 1000000, 20);
+	printf("\n");
+}
+
+//---------------------------------------------------------------------
+// batch insert: avl_tree_add loop vs avl_tree_add_batch
+//---------------------------------------------------------------------
+static void benchmark_batch(int count, int batch)
+{
+	struct avl_tree tree;
+	struct MyNode *nodes;
+	void **items, **results;
+	unsigned int ts;
+	int *keys, i, mode, added;
+
+	keys = (int*)malloc(sizeof(int) * (count + batch));
+	nodes = (struct MyNode*)malloc(sizeof(struct MyNode) * (count + batch));
+	items = (void**)malloc(sizeof(void*) * batch);
+	results = (void**)malloc(sizeof(void*) * batch);
+	random_keys(keys, count + batch, 0x11223344);
+	/* one in ten of the batch repeats a key already in the tree */
+	for (i = 0; i < batch; i += 10) keys[count + i] = keys[i];
+
+	printf("add %d nodes to %d nodes:\n", batch, count);
+
+	for (mode = 0; mode < 2; mode++) {
+		avl_tree_init(&tree, avl_node_compare, sizeof(struct MyNode), 0);
+		for (i = 0; i < count + batch; i++) {
+			nodes[i].key = keys[i];
+			avl_node_init(&nodes[i].node);
+		}
+		for (i = 0; i < count; i++) {
+			avl_tree_add(&tree, &nodes[i]);
+		}
+		for (i = 0; i < batch; i++) {
+			items[i] = &nodes[count + i];
+		}
+		added = 0;
+		sleepms(200);
+		ts = gettime();
+		if (mode == 0) {
+			for (i = 0; i < batch; i++) {
+				if (avl_tree_add(&tree, items[i]) == NULL) added++;
+			}
+		}	else {
+			added = (int)avl_tree_add_batch(&tree, items, batch, results);
+		}
+		ts = gettime() - ts;
+		avl_test_validate(&tree.root);
+		printf("%s time: %dms added=%d\n", (mode == 0)?
+				"avl_tree_add" : "avl_tree_add_batch", (int)ts, added);
+	}
+
+	free(results);
+	free(items);
+	free(nodes);
+	free(keys);
+	printf("\n");
+}
+
+//---------------------------------------------------------------------
+// batch insert checked against an avl_tree_add loop
+//---------------------------------------------------------------------
+
+/* batch keys drawn from [0, range) repeat each other and keys of the
+ * tree (each one there by rate per mille), a copy of everything gets
+ * the batch one by one: results[] and counts must match */
+static void check_batch(int range, int batch, int rate)
+{
+	struct MyNode *a, *b;
+	struct avl_tree ta, tb;
+	void **items, **results, *x, *y;
+	int *want, *seen, *first, i, added = 0, unique = 0, distinct = 0;
+
+	a = (struct MyNode*)malloc(sizeof(struct MyNode) * (range + batch));
+	b = (struct MyNode*)malloc(sizeof(struct MyNode) * (range + batch));
+	items = (void**)malloc(sizeof(void*) * batch);
+	results = (void**)malloc(sizeof(void*) * batch);
+	want = (int*)malloc(sizeof(int) * batch);
+	seen = (int*)malloc(sizeof(int) * batch);
+	first = (int*)malloc(sizeof(int) * range);
+	avl_tree_init(&ta, avl_node_compare, sizeof(struct MyNode), 0);
+	avl_tree_init(&tb, avl_node_compare, sizeof(struct MyNode), 0);
+	for (i = 0; i < range; i++) {
+		a[i].key = b[i].key = i;
+		first[i] = -1;
+		if ((int)RANDOM(1000) < rate) {
+			avl_tree_add(&ta, &a[i]);
+			avl_tree_add(&tb, &b[i]);
+		}
+	}
+	for (i = 0; i < batch; i++) {
+		a[range + i].key = b[range + i].key = RANDOM(range);
+		items[i] = &a[range + i];
+		seen[i] = 0;
+		if (first[a[range + i].key] < 0) {
+			first[a[range + i].key] = i;
+			distinct++;
+		}
+	}
+
+	/* want[i] is the index of what avl_tree_add returned, -1 for NULL */
+	for (i = 0; i < batch; i++) {
+		struct MyNode *r = (struct MyNode*)avl_tree_add(&tb, &b[range + i]);
+		want[i] = (r)? (int)(r - b) : -1;
+		if (r == NULL) added++;
+	}
+	assert((int)avl_tree_add_batch(&ta, items, batch, results) == added);
+	assert(ta.count == tb.count);
+
+	for (i = 0; i < batch; i++) {
+		struct MyNode *n = (struct MyNode*)items[i];
+		struct MyNode *r = (struct MyNode*)results[i];
+		int k = (int)(n - a) - range;
+		assert(k >= 0 && k < batch && seen[k] == 0);
+		seen[k] = 1;
+		assert(((r)? (int)(r - a) : -1) == want[k]);
+	}
+
+	/* distinct keys first, each the earliest of its key, then repeats
+	 * in key order and in their original order within a key */
+	while (unique < batch && (unique == 0 ||
+			avl_key(items[unique - 1]) < avl_key(items[unique]))) {
+		struct MyNode *n = (struct MyNode*)items[unique];
+		assert(first[n->key] == (int)(n - a) - range);
+		unique++;
+	}
+	assert(unique == distinct);
+	for (i = unique; i < batch; i++) {
+		struct MyNode *n = (struct MyNode*)items[i];
+		assert(avl_tree_find(&ta, n) != NULL);
+		if (i > unique) {
+			struct MyNode *p = (struct MyNode*)items[i - 1];
+			assert(p->key < n->key || (p->key == n->key && p < n));
+		}
+	}
+
+	assert(avl_test_validate(&ta.root) == 0);
+	x = avl_tree_first(&ta);
+	y = avl_tree_first(&tb);
+	for (; x != NULL; x = avl_tree_next(&ta, x)) {
+		assert(y && (struct MyNode*)x - a == (struct MyNode*)y - b);
+		y = avl_tree_next(&tb, y);
+	}
+	assert(y == NULL);
+
+	free(first);
+	free(seen);
+	free(want);
+	free(results);
+	free(items);
+	free(b);
+	free(a);
+}
+
+static void check_batches(void)
+{
+	static const int cases[][3] = {
+		{ 1, 1, 0 }, { 1, 5, 1000 }, { 100, 1, 500 }, { 100, 50, 500 },
+		{ 100, 1000, 500 }, { 1000, 300, 0 }, { 1000, 300, 1000 },
+		{ 10000, 5000, 300 }, { 50000, 200000, 500 },
+	};
+	int i;
+	for (i = 0; i < (int)(sizeof(cases) / sizeof(cases[0])); i++) {
+		check_batch(cases[i][0], cases[i][1], cases[i][2]);
+		printf("batch of %d keys below %d, %d%% in tree: ok\n",
+				cases[i][1], cases[i][0], cases[i][2] / 10);
+	}
+	printf("\n");
+}
+
+//---------------------------------------------------------------------
+// range erase: avl_tree_remove loop vs avl_tree_remove_range
+//---------------------------------------------------------------------
+static void benchmark_range(int count, int range)
+{
+	struct avl_tree tree;
+	struct MyNode *nodes, lo, hi;
+	unsigned int ts;
+	int *keys, i, mode, removed;
+
+	keys = (int*)malloc(sizeof(int) * count);
+	nodes = (struct MyNode*)malloc(sizeof(struct MyNode) * count);
+	random_keys(keys, count, 0x11223344);
+	lo.key = (count - range) / 2;
+	hi.key = lo.key + range;
+
+	printf("remove %d of %d nodes:\n", range, count);
+
+	for (mode = 0; mode < 2; mode++) {
+		avl_tree_init(&tree, avl_node_compare, sizeof(struct MyNode), 0);
+		for (i = 0; i < count; i++) {
+			nodes[i].key = keys[i];
+			avl_node_init(&nodes[i].node);
+			avl_tree_add(&tree, &nodes[i]);
+		}
+		removed = 0;
+		sleepms(200);
+		ts = gettime();
+		if (mode == 0) {
+			struct MyNode *node = (struct MyNode*)
+				avl_tree_lower_bound(&tree, &lo);
+			while (node != NULL && node->key < hi.key) {
+				struct MyNode *next = (struct MyNode*)
+					avl_tree_next(&tree, node);
+				avl_tree_remove(&tree, node);
+				node = next;
+				removed++;
+			}
+		}	else {
+			removed = (int)avl_tree_remove_range(&tree, &lo, &hi, NULL);
+		}
+		ts = gettime() - ts;
+		avl_test_validate(&tree.root);
+		printf("%s time: %dms removed=%d\n", (mode == 0)?
+				"avl_tree_remove" : "avl_tree_remove_range", (int)ts, removed);
+	}
+
+	free(nodes);
+	free(keys);
+	printf("\n");
+}
+
+//---------------------------------------------------------------------
+// avl_tree_* through tree->compare vs AVL_DEFINE_TREE inlined
+//---------------------------------------------------------------------
+AVL_DEFINE_TREE(my_tree, struct MyNode, node, key, AVL_KEY_COMPARE)
+
+static void benchmark_define(int count)
+{
+	struct avl_tree tree;
+	struct MyNode *nodes, key;
+	unsigned int t1, t2, t3, t4;
+	int *keys, i, mode, found;
+
+	keys = (int*)malloc(sizeof(int) * count);
+	nodes = (struct MyNode*)malloc(sizeof(struct MyNode) * count);
+	random_keys(keys, count, 0x11223344);
+
+	printf("%d nodes:\n", count);
+
+	for (mode = 0; mode < 2; mode++) {
+		my_tree_init(&tree);
+		for (i = 0; i < count; i++) {
+			nodes[i].key = keys[i] * 2;
+			avl_node_init(&nodes[i].node);
+		}
+		found = 0;
+		sleepms(200);
+		t1 = gettime();
+		if (mode == 0) {
+			for (i = 0; i < count; i++) avl_tree_add(&tree, &nodes[i]);
+		}	else {
+			for (i = 0; i < count; i++) my_tree_add(&tree, &nodes[i]);
+		}
+		t1 = gettime() - t1;
+		avl_test_validate(&tree.root);
+		t2 = gettime();
+		for (i = 0; i < count; i++) {
+			key.key = keys[count - 1 - i] * 2;
+			if (mode == 0) found += (avl_tree_find(&tree, &key) != NULL);
+			else found += (my_tree_find(&tree, &key) != NULL);
+		}
+		t2 = gettime() - t2;
+		t3 = gettime();
+		for (i = 0; i < count; i++) {
+			/* keys in tree are even, odd ones fall in between */
+			key.key = keys[i] * 2 + 1;
+			if (mode == 0) found += (avl_tree_lower_bound(&tree, &key) != NULL);
+			else found += (my_tree_lower_bound(&tree, &key) != NULL);
+		}
+		t3 = gettime() - t3;
+		t4 = gettime();
+		if (mode == 0) {
+			for (i = 0; i < count; i++) avl_tree_remove(&tree, &nodes[i]);
+		}	else {
+			for (i = 0; i < count; i++) my_tree_remove(&tree, &nodes[i]);
+		}
+		t4 = gettime() - t4;
+		printf("%s: add %dms, find %dms, lower_bound %dms, remove %dms "
+				"found=%d\n", (mode == 0)? "avl_tree" : "AVL_DEFINE_TREE",
+				(int)t1, (int)t2, (int)t3, (int)t4, found);
+	}
+
+	free(nodes);
+	free(keys);
+	printf("\n");
+}
+
+//---------------------------------------------------------------------
+// session expiry: erase the oldest node, then add a new random key
+//---------------------------------------------------------------------
+static int churn_key(void)
+{
+	unsigned int x = xrand();
+	return (int)(((x << 15) ^ xrand()) & 0x3fffffff);
+}
+
+static void benchmark_churn(int count, int steps)
+{
+	struct MyNode *nodes;
+	struct RbNode *rb_nodes;
+	struct avl_root avl_root;
+	struct rb_root rb_root;
+	unsigned int ts;
+	int i, mode, height;
+#ifdef AVL_ROTATION_COUNT
+	size_t erased = 0, worst = 0;
+#endif
+
+	nodes = (struct MyNode*)malloc(sizeof(struct MyNode) * count);
+	rb_nodes = (struct RbNode*)malloc(sizeof(struct RbNode) * count);
+
+	printf("expire and add %d times in %d nodes:\n", steps, count);
+
+	for (mode = 0; mode < 2; mode++) {
+		avl_root.node = NULL;
+		rb_root.rb_node = NULL;
+		xseed = 0x11223344;
+		ts = gettime();
+		for (i = 0; i < count + steps; i++) {
+			int index = i % count;
+			if (i >= count) {
+#ifdef AVL_ROTATION_COUNT
+				size_t before = avl_rotation_count;
+#endif
+				if (mode == 0) avl_node_erase(&nodes[index].node, &avl_root);
+				else rb_erase(&rb_nodes[index].node, &rb_root);
+#ifdef AVL_ROTATION_COUNT
+				before = avl_rotation_count - before;
+				erased += before;
+				if (before > worst) worst = before;
+#endif
+			}
+			if (i == count) {
+				/* filled, time the churn only */
+				sleepms(200);
+				rotation_reset();
+#ifdef AVL_ROTATION_COUNT
+				erased = worst = 0;
+#endif
+				ts = gettime();
+			}
+			if (mode == 0) {
+				struct avl_node *dup = NULL;
+				nodes[index].key = churn_key();
+				do {
+					nodes[index].key++;
+					avl_node_add(&avl_root, &nodes[index].node,
+							avl_node_compare, dup);
+				}	while (dup);
+			}	else {
+				struct rb_node *dup = NULL;
+				rb_nodes[index].key = churn_key();
+				do {
+					rb_nodes[index].key++;
+					rb_node_add(&rb_root, &rb_nodes[index].node,
+							rb_node_compare, dup);
+				}	while (dup);
+			}
+		}
+		ts = gettime() - ts;
+		if (mode == 0) {
+			avl_test_validate(&avl_root);
+			height = avl_tree_height(avl_root.node);
+		}	else {
+			height = rb_tree_height(rb_root.rb_node);
+		}
+		printf("%s time: %dms, height=%d", (mode == 0)? "avlmini" :
+				"linux rbtree", (int)ts, height);
+#ifdef AVL_ROTATION_COUNT
+		printf(", rotations=%d (erase %d, worst erase %d)",
+				(int)avl_rotation_count, (int)erased, (int)worst);
+#endif
+		printf("\n");
+	}
+
+	free(nodes);
+	free(rb_nodes);
+	printf("\n");
+}
+
+//---------------------------------------------------------------------
+// split and join: random cuts checked against the keys in order
+//---------------------------------------------------------------------
+
+/* root must hold exactly the keys 2 * i for i in [lo, hi) */
+static void check_keys(struct avl_root *root, int lo, int hi)
+{
+	struct avl_node *node;
+	int i = lo;
+	assert(avl_test_validate(root) == 0);
+	for (node = avl_node_first(root); node; node = avl_node_next(node)) {
+		assert(i < hi && avl_key(node) == i * 2);
+		i++;
+	}
+	assert(i == hi);
+}
+
+/* number of keys 2 * i (0 <= i < count) less than key */
+static int check_cut(int key, int count)
+{
+	int n = (key + 1) / 2;
+	return (key <= 0)? 0 : (n < count)? n : count;
+}
+
+static void check_split(int count, int rounds)
+{
+	struct MyNode *nodes, cut;
+	struct avl_root root, left, right;
+	struct avl_tree tree, tl, tr;
+	int *keys, i, r, n;
+
+	keys = (int*)malloc(sizeof(int) * count);
+	nodes = (struct MyNode*)malloc(sizeof(struct MyNode) * count);
+	random_keys(keys, count, 0x11223344);
+
+	root.node = NULL;
+	for (i = 0; i < count; i++) {
+		struct avl_node *dup;
+		nodes[i].key = keys[i] * 2;
+		avl_node_add(&root, &nodes[i].node, avl_node_compare, dup);
+		assert(dup == NULL);
+	}
+
+	/* cut below, inside and above the keys, then glue back */
+	for (r = 0; r < rounds; r++) {
+		struct avl_root *lp = (r & 1)? &root : &left;
+		struct avl_root *from;
+		struct avl_node *pivot;
+		cut.key = churn_key() % (count * 2 + 8) - 4;
+		n = check_cut(cut.key, count);
+		avl_node_split(&root, &cut, avl_node_compare, lp, &right);
+		check_keys(lp, 0, n);
+		check_keys(&right, n, count);
+		from = (r % 3 == 1 && lp->node)? lp : &right;
+		if (r % 3 == 0 || from->node == NULL) {
+			avl_node_concat(&root, lp, &right);
+		}	else {
+			/* the pivot is taken from the side next to the cut */
+			pivot = (from == lp)? avl_node_last(lp) : avl_node_first(&right);
+			avl_node_erase(pivot, from);
+			avl_node_join(&root, lp, pivot, &right);
+		}
+		check_keys(&root, 0, count);
+	}
+
+	avl_tree_init(&tree, avl_node_compare, sizeof(struct MyNode),
+			AVL_OFFSET(struct MyNode, node));
+	avl_tree_init(&tl, avl_node_compare, sizeof(struct MyNode),
+			AVL_OFFSET(struct MyNode, node));
+	avl_tree_init(&tr, avl_node_compare, sizeof(struct MyNode),
+			AVL_OFFSET(struct MyNode, node));
+	tree.root.node = root.node;
+	tree.count = count;
+
+	for (r = 0; r < rounds; r++) {
+		struct avl_tree *lp = (r & 1)? &tree : &tl;
+		struct avl_tree *rp = (lp != &tree && (r & 2))? &tree : &tr;
+		cut.key = churn_key() % (count * 2 + 8) - 4;
+		n = check_cut(cut.key, count);
+		avl_tree_split(&tree, &cut, lp, rp);
+		assert((int)lp->count == n && (int)rp->count == count - n);
+		check_keys(&lp->root, 0, n);
+		check_keys(&rp->root, n, count);
+		avl_tree_concat(&tree, lp, rp);
+		assert((int)tree.count == count);
+		assert(tl.count == 0 && tr.count == 0);
+		check_keys(&tree.root, 0, count);
+	}
+
+	printf("split and join %d nodes, %d rounds: ok\n", count, rounds);
+	free(nodes);
+	free(keys);
+}
+
+//---------------------------------------------------------------------
+// rank and select, compile with -DAVL_ORDER_STATISTIC
+//---------------------------------------------------------------------
+#ifdef AVL_ORDER_STATISTIC
+static void check_rank(int count, int queries)
+{
+	struct MyNode *nodes, key;
+	struct avl_tree tree;
+	struct avl_node *node;
+	int *keys, *sorted, i, j, n;
+
+	keys = (int*)malloc(sizeof(int) * count);
+	sorted = (int*)malloc(sizeof(int) * count);
+	nodes = (struct MyNode*)malloc(sizeof(struct MyNode) * count);
+	random_keys(keys, count, 0x11223344);
+
+	avl_tree_init(&tree, avl_node_compare, sizeof(struct MyNode),
+			AVL_OFFSET(struct MyNode, node));
+	for (i = 0; i < count; i++) {
+		nodes[i].key = keys[i] * 2;
+		assert(avl_tree_add(&tree, &nodes[i]) == NULL);
+	}
+	/* erase every third node to leave gaps between keys */
+	for (i = 0; i < count; i += 3) {
+		avl_tree_remove(&tree, &nodes[i]);
+	}
+	assert(avl_test_validate(&tree.root) == 0);
+
+	n = 0;
+	for (node = avl_node_first(&tree.root); node; node = avl_node_next(node)) {
+		assert((int)avl_node_rank(node) == n);
+		assert(avl_node_select(&tree.root, n) == node);
+		assert(avl_tree_select(&tree, n) == (void*)node);
+		sorted[n++] = avl_key(node);
+	}
+	assert(n == (int)tree.count);
+	assert(avl_node_select(&tree.root, n) == NULL);
+	assert(avl_tree_select(&tree, n) == NULL);
+
+	/* keys in tree, removed ones, odd ones and out of range */
+	for (i = 0; i < queries; i++) {
+		int rank = 0;
+		key.key = churn_key() % (count * 2 + 8) - 4;
+		for (j = 0; j < n && sorted[j] < key.key; j++) rank++;
+		assert((int)avl_tree_rank(&tree, &key) == rank);
+	}
+
+	printf("rank and select %d nodes, %d queries: ok\n", n, queries);
+	free(nodes);
+	free(sorted);
+	free(keys);
+}
+#endif
+
+//---------------------------------------------------------------------
+// augmented: subtree sum checked after every insert, erase and replace
+//---------------------------------------------------------------------
+struct SumNode
+{
+	struct avl_node node;
+	int key;
+	int val;
+	int sum;		/* val of the whole subtree */
+};
+
+#define SUM_NODE(n) AVL_ENTRY(n, struct SumNode, node)
+
+static int sum_compute(struct SumNode *n)
+{
+	int sum = n->val;
+	if (n->node.left) sum += SUM_NODE(n->node.left)->sum;
+	if (n->node.right) sum += SUM_NODE(n->node.right)->sum;
+	return sum;
+}
+
+AVL_AUGMENT_DEFINE(static, sum_tree, struct SumNode, node, sum, sum_compute)
+
+/* every node must hold the sum of its subtree, returns that sum */
+static int check_sum(struct avl_node *node)
+{
+	int sum;
+	if (node == NULL) return 0;
+	sum = check_sum(node->left) + check_sum(node->right) +
+		SUM_NODE(node)->val;
+	assert(SUM_NODE(node)->sum == sum);
+	return sum;
+}
+
+static void check_augment(int count, int steps)
+{
+	struct SumNode *nodes, *spares, **live;
+	struct avl_root root;
+	int *keys, i, step, total = 0, size = 0;
+
+	keys = (int*)malloc(sizeof(int) * count);
+	nodes = (struct SumNode*)malloc(sizeof(struct SumNode) * count);
+	spares = (struct SumNode*)malloc(sizeof(struct SumNode) * count);
+	live = (struct SumNode**)malloc(sizeof(void*) * count);
+	random_keys(keys, count, 0x11223344);
+
+	for (i = 0; i < count; i++) {
+		nodes[i].key = spares[i].key = keys[i];
+		nodes[i].val = spares[i].val = (int)RANDOM(1000);
+		avl_node_init(&nodes[i].node);
+		live[i] = &nodes[i];
+	}
+
+	root.node = NULL;
+	for (step = 0; step < steps; step++) {
+		struct SumNode *data;
+		i = (int)RANDOM(count);
+		data = live[i];
+		if (avl_node_empty(&data->node)) {
+			struct avl_node **link = &root.node, *parent = NULL;
+			while (link[0]) {
+				parent = link[0];
+				link = (data->key < avl_key(parent))?
+					&(parent->left) : &(parent->right);
+			}
+			data->sum = -1;
+			avl_node_link(&data->node, parent, link);
+			sum_tree_post_insert(&data->node, &root);
+			total += data->val;
+			size++;
+		}
+		else if (step & 1) {
+			sum_tree_erase(&data->node, &root);
+			avl_node_init(&data->node);
+			total -= data->val;
+			size--;
+		}
+		else {
+			/* the spare has the same key and val, its sum is copied */
+			struct SumNode *spare = (data == &nodes[i])? &spares[i] : &nodes[i];
+			spare->sum = -1;
+			sum_tree_replace(&data->node, &spare->node, &root);
+			avl_node_init(&data->node);
+			live[i] = spare;
+		}
+		assert(check_sum(root.node) == total);
+		if ((step & 63) == 0) {
+			assert(avl_test_validate(&root) == 0);
+		}
+	}
+	assert(avl_test_validate(&root) == 0);
+
+	printf("augmented %d nodes, %d steps: ok\n", size, steps);
+	free(live);
+	free(spares);
+	free(nodes);
+	free(keys);
+}
+
+//---------------------------------------------------------------------
+// bounds and ranges checked against a linear scan
+//---------------------------------------------------------------------
+static void check_bounds(int count, int queries)
+{
+	struct MyNode *nodes, lo, hi, *data;
+	struct avl_tree tree;
+	struct avl_node *node;
+	int *keys, *sorted, i, j, n;
+
+	keys = (int*)malloc(sizeof(int) * count);
+	sorted = (int*)malloc(sizeof(int) * count);
+	nodes = (struct MyNode*)malloc(sizeof(struct MyNode) * count);
+	random_keys(keys, count, 0x11223344);
+
+	avl_tree_init(&tree, avl_node_compare, sizeof(struct MyNode),
+			AVL_OFFSET(struct MyNode, node));
+	for (i = 0; i < count; i++) {
+		nodes[i].key = keys[i] * 2;
+		assert(avl_tree_add(&tree, &nodes[i]) == NULL);
+	}
+	/* erase every third node to leave gaps between keys */
+	for (i = 0; i < count; i += 3) {
+		avl_tree_remove(&tree, &nodes[i]);
+	}
+	n = 0;
+	for (node = avl_node_first(&tree.root); node; node = avl_node_next(node)) {
+		sorted[n++] = avl_key(node);
+	}
+
+	/* keys below the first, above the last, present and in between */
+	for (i = 0; i < queries; i++) {
+		int lb = -1, ub = -1, fl = -1, k;
+		lo.key = churn_key() % (count * 2 + 8) - 4;
+		hi.key = lo.key + (int)RANDOM(count / 4 + 4) - 2;
+		for (j = 0; j < n; j++) {
+			if (lb < 0 && sorted[j] >= lo.key) lb = j;
+			if (ub < 0 && sorted[j] > lo.key) ub = j;
+			if (sorted[j] <= lo.key) fl = j;
+		}
+		data = (struct MyNode*)avl_tree_lower_bound(&tree, &lo);
+		assert((lb < 0)? data == NULL : data && data->key == sorted[lb]);
+		data = (struct MyNode*)avl_tree_ceiling(&tree, &lo);
+		assert((lb < 0)? data == NULL : data && data->key == sorted[lb]);
+		data = (struct MyNode*)avl_tree_upper_bound(&tree, &lo);
+		assert((ub < 0)? data == NULL : data && data->key == sorted[ub]);
+		data = (struct MyNode*)avl_tree_floor(&tree, &lo);
+		assert((fl < 0)? data == NULL : data && data->key == sorted[fl]);
+		avl_node_upper_bound(&tree.root, &lo, avl_node_compare, node);
+		assert((ub < 0)? node == NULL : node && avl_key(node) == sorted[ub]);
+		avl_node_floor(&tree.root, &lo, avl_node_compare, node);
+		assert((fl < 0)? node == NULL : node && avl_key(node) == sorted[fl]);
+		/* [lo, hi) must stream the keys the scan finds, hi may be <= lo */
+		k = (lb < 0)? n : lb;
+		avl_tree_range_foreach(data, &tree, &lo, &hi) {
+			assert(k < n && data->key == sorted[k] && data->key < hi.key);
+			k++;
+		}
+		assert(k == n || sorted[k] >= hi.key);
+		j = (lb < 0)? n : lb;
+		avl_node_range_foreach(node, &tree.root, &lo, &hi, avl_node_compare) {
+			assert(avl_key(node) == sorted[j]);
+			j++;
+		}
+		assert(j == k);
+	}
+
+	printf("bounds %d nodes, %d queries: ok\n", n, queries);
+	free(nodes);
+	free(sorted);
+	free(keys);
+}
+
+//---------------------------------------------------------------------
+// set operations checked against membership of the sorted inputs
+//---------------------------------------------------------------------
+static int setop_dropped = 0;
+
+static void setop_destroy(void *data)
+{
+	struct MyNode *x = (struct MyNode*)data;
+	assert(avl_node_empty(&x->node));
+	x->val = -1;
+	setop_dropped++;
+}
+
+/* root must hold exactly the keys k (0 <= k < range) with want[k] set */
+static void check_set(struct avl_root *root, const char *want, int range)
+{
+	struct avl_node *node = avl_node_first(root);
+	int k;
+	assert(avl_test_validate(root) == 0);
+	for (k = 0; k < range; k++) {
+		if (want[k] == 0) continue;
+		assert(node && avl_key(node) == k);
+		node = avl_node_next(node);
+	}
+	assert(node == NULL);
+}
+
+/* a fork without threads: a spawned half runs at join, after the other
+ * half, and one spawn in three is refused to run inline */
+struct SetopTask
+{
+	void (*run)(void *arg);
+	void *arg;
+};
+
+static int setop_spawns = 0;
+
+static void *setop_spawn(void (*run)(void *arg), void *arg, void *user)
+{
+	struct SetopTask *task;
+	if (++setop_spawns % 3 == 0) return NULL;
+	task = (struct SetopTask*)malloc(sizeof(struct SetopTask));
+	task->run = run;
+	task->arg = arg;
+	return task;
+}
+
+static void setop_join(void *handle, void *user)
+{
+	struct SetopTask *task = (struct SetopTask*)handle;
+	task->run(task->arg);
+	free(task);
+}
+
+/* op 0: union, 1: intersect, 2: difference. a_rate and b_rate are the
+ * chances per mille of each key in [0, range) to be in a or b, fork
+ * may be NULL */
+static void check_setop(int range, int a_rate, int b_rate, int op, int tree,
+		const struct avl_fork *fork)
+{
+	struct MyNode *a = (struct MyNode*)malloc(sizeof(struct MyNode) * range);
+	struct MyNode *b = (struct MyNode*)malloc(sizeof(struct MyNode) * range);
+	char *in_a = (char*)malloc(range), *in_b = (char*)malloc(range);
+	char *want = (char*)malloc(range), *after_b = (char*)malloc(range);
+	struct avl_tree ta, tb;
+	int k, size = 0, dropped = 0, nb = 0, n;
+
+	avl_tree_init(&ta, avl_node_compare, sizeof(struct MyNode),
+			AVL_OFFSET(struct MyNode, node));
+	avl_tree_init(&tb, avl_node_compare, sizeof(struct MyNode),
+			AVL_OFFSET(struct MyNode, node));
+	for (k = 0; k < range; k++) {
+		in_a[k] = ((int)RANDOM(1000) < a_rate);
+		in_b[k] = ((int)RANDOM(1000) < b_rate);
+		a[k].key = b[k].key = k;
+		a[k].val = b[k].val = 0;
+		if (in_a[k]) assert(avl_tree_add(&ta, &a[k]) == NULL);
+		if (in_b[k]) assert(avl_tree_add(&tb, &b[k]) == NULL);
+		if (op == 0) want[k] = in_a[k] | in_b[k];
+		else if (op == 1) want[k] = in_a[k] & in_b[k];
+		else want[k] = in_a[k] & !in_b[k];
+		after_b[k] = (op == 0)? 0 : in_b[k];
+		/* union drops the copy in b, the others drop from a */
+		if (op != 1) dropped += in_a[k] & in_b[k];
+		else dropped += in_a[k] & !in_b[k];
+		size += want[k];
+		nb += in_b[k];
+	}
+
+	setop_dropped = 0;
+	if (tree && fork) {
+		avl_tree_setop(&ta, &tb, op, setop_destroy, fork);
+		n = setop_dropped;
+		assert((int)ta.count == size);
+		assert((int)tb.count == ((op == 0)? 0 : nb));
+	}	else if (fork) {
+		n = (int)avl_node_setop(&ta.root, &tb.root, op, avl_node_compare,
+				setop_destroy, fork);
+		assert(n == setop_dropped);
+	}	else if (tree) {
+		if (op == 0) avl_tree_union(&ta, &tb, setop_destroy);
+		else if (op == 1) avl_tree_intersect(&ta, &tb, setop_destroy);
+		else avl_tree_difference(&ta, &tb, setop_destroy);
+		n = setop_dropped;
+		assert((int)ta.count == size);
+		assert((int)tb.count == ((op == 0)? 0 : nb));
+	}	else {
+		if (op == 0)
+			n = (int)avl_node_union(&ta.root, &tb.root, avl_node_compare,
+					setop_destroy);
+		else if (op == 1)
+			n = (int)avl_node_intersect(&ta.root, &tb.root, avl_node_compare,
+					setop_destroy);
+		else
+			n = (int)avl_node_difference(&ta.root, &tb.root, avl_node_compare,
+					setop_destroy);
+		assert(n == setop_dropped);
+	}
+	assert(n == dropped);
+	check_set(&ta.root, want, range);
+	check_set(&tb.root, after_b, range);
+
+	/* destroy must have seen exactly the dropped nodes */
+	for (k = 0; k < range; k++) {
+		int gone = (op == 0)? in_a[k] & in_b[k] : in_a[k] & !want[k];
+		struct MyNode *x = (op == 0)? &b[k] : &a[k];
+		assert((x->val == -1) == gone);
+	}
+
+	free(a);
+	free(b);
+	free(in_a);
+	free(in_b);
+	free(want);
+	free(after_b);
+}
+
+static void check_setops(int range)
+{
+	static const int rates[][2] = {
+		{ 500, 500 }, { 500, 20 }, { 20, 500 }, { 900, 900 }, { 0, 500 },
+		{ 500, 0 }, { 1000, 1000 },
+	};
+	struct avl_fork fork;
+	int i, op, tree;
+	fork.spawn = setop_spawn;
+	fork.join = setop_join;
+	fork.grain = 8;
+	fork.user = NULL;
+	setop_spawns = 0;
+	for (i = 0; i < (int)(sizeof(rates) / sizeof(rates[0])); i++) {
+		for (op = 0; op < 3; op++) {
+			for (tree = 0; tree < 2; tree++) {
+				check_setop(range, rates[i][0], rates[i][1], op, tree, NULL);
+				check_setop(range, rates[i][0], rates[i][1], op, tree, &fork);
+			}
+		}
+	}
+	printf("union, intersect and difference in %d keys, %d spawns: ok\n",
+			range, setop_spawns);
+}
+
+//---------------------------------------------------------------------
+// hint: compares counted on sorted streams, then far hints
+//---------------------------------------------------------------------
+static int hint_compares = 0;
+
+static int hint_compare(const void *n1, const void *n2)
+{
+	hint_compares++;
+	return avl_node_compare(n1, n2);
+}
+
+/* root must hold exactly the keys 0 .. count - 1 */
+static void check_hint_keys(struct avl_root *root, int count)
+{
+	struct avl_node *node;
+	int i = 0;
+	assert(avl_test_validate(root) == 0);
+	for (node = avl_node_first(root); node; node = avl_node_next(node)) {
+		assert(i < count && avl_key(node) == i);
+		i++;
+	}
+	assert(i == count);
+}
+
+/* even keys going up (step 1) or down (step -1) swapped in a window,
+ * each hinted by the one before, then odd keys and duplicates hinted
+ * by random nodes */
+static void check_hint(int count, int window, int step)
+{
+	struct MyNode *nodes, probe;
+	struct avl_root root;
+	struct avl_tree tree;
+	int *keys, i, mode, compares[2];
+
+	keys = (int*)malloc(sizeof(int) * count);
+	nodes = (struct MyNode*)malloc(sizeof(struct MyNode) * count * 2);
+	for (i = 0; i < count; i++) keys[i] = (step > 0)? i : count - 1 - i;
+	for (i = 0; window > 1 && i < count; i++) {
+		int j = i + RANDOM(window);
+		int t = keys[i];
+		if (j >= count) continue;
+		keys[i] = keys[j];
+		keys[j] = t;
+	}
+
+	for (mode = 0; mode < 2; mode++) {
+		void *hint = NULL, *dup;
+		struct avl_node *node;
+		for (i = 0; i < count; i++) {
+			nodes[i].key = keys[i] * 2;
+			nodes[count + i].key = keys[i] * 2 + 1;
+		}
+		root.node = NULL;
+		avl_tree_init(&tree, hint_compare, sizeof(struct MyNode), 0);
+		hint_compares = 0;
+		for (i = 0; i < count; i++) {
+			if (mode == 0) {
+				avl_node_add_hint(&root, &nodes[i].node,
+						(struct avl_node*)hint, hint_compare, node);
+				dup = node;
+			}	else {
+				dup = avl_tree_add_hint(&tree, &nodes[i], hint);
+			}
+			assert(dup == NULL);
+			hint = &nodes[i];
+		}
+		compares[mode] = hint_compares;
+		for (i = 0; i < count * 2; i++) {
+			void *near = &nodes[RANDOM(count)];
+			probe.key = (i < count)? keys[i] * 2 : keys[i - count] * 2 + 1;
+			if (mode == 0) {
+				avl_node_add_hint(&root, (i < count)? &probe.node :
+						&nodes[i].node, (struct avl_node*)near,
+						hint_compare, node);
+				dup = node;
+			}	else {
+				dup = avl_tree_add_hint(&tree, (i < count)? &probe :
+						&nodes[i], near);
+			}
+			if (i < count) {
+				assert(dup && ((struct MyNode*)dup)->key == probe.key);
+			}	else {
+				assert(dup == NULL);
+			}
+		}
+		check_hint_keys((mode == 0)? &root : &tree.root, count * 2);
+	}
+
+	/* a sorted stream costs one compare per add, none for the first */
+	if (window == 1) {
+		assert(compares[0] < count && compares[1] < count);
+	}
+	printf("hint %d keys %s in a window of %d, compares per add %.2f "
+			"and %.2f: ok\n", count, (step > 0)? "up" : "down", window,
+			(double)compares[0] / count, (double)compares[1] / count);
+
+	free(nodes);
+	free(keys);
+}
+
+static void check_hints(int count)
+{
+	int window;
+	for (window = 1; window <= 16; window *= 4) {
+		check_hint(count, window, 1);
+		check_hint(count, window, -1);
+	}
+}
+
 void test1()
 {
 	int a[100];
@@ -172,13 +1547,148 @@ void test3()
 	benchmark("avlmini", 0, 1000);
 }
 
-int main(void)
+void test_build()
+{
+	benchmark_build(COUNT);
+	benchmark_build(COUNT2);
+}
+
+void test_union()
+{
+	benchmark_union(COUNT, COUNT2);
+	benchmark_union(COUNT, COUNT3);
+	benchmark_union(COUNT2, COUNT2);
+}
+
+void test_scan()
+{
+	benchmark_scan(COUNT, 1);
+	benchmark_scan(COUNT2, 10);
+	benchmark_scan(COUNT3, 100);
+}
+
+void test_hint()
+{
+	check_hints(1);
+	check_hints(1000);
+	check_hints(COUNT3);
+	benchmark_hint(COUNT, 1);
+	benchmark_hint(COUNT, 16);
+	benchmark_hint(COUNT2, 1);
+	benchmark_hint(COUNT2, 16);
+}
+
+void test_cached()
+{
+	check_cacheds();
+	benchmark_cached(COUNT);
+	benchmark_cached(COUNT2);
+}
+
+void test_batch()
+{
+	check_batches();
+	benchmark_batch(COUNT2, COUNT2 / 100);
+	benchmark_batch(COUNT2, COUNT2 / 10);
+	benchmark_batch(COUNT, COUNT3);
+}
+
+void test_range()
+{
+	benchmark_range(COUNT, COUNT2);
+	benchmark_range(COUNT, COUNT / 2);
+	benchmark_range(COUNT2, COUNT3);
+}
+
+void test_define()
+{
+	benchmark_define(COUNT);
+	benchmark_define(COUNT2);
+	benchmark_define(COUNT3);
+}
+
+void test_churn()
+{
+	benchmark_churn(COUNT2, COUNT);
+	benchmark_churn(COUNT3, COUNT);
+}
+
+void test_split()
+{
+	check_split(1, 40);
+	check_split(1000, 2000);
+	check_split(COUNT3, 200);
+}
+
+void test_rank()
+{
+#ifdef AVL_ORDER_STATISTIC
+	check_rank(4, 20);
+	check_rank(1000, 2000);
+	check_rank(COUNT3, 2000);
+#else
+	printf("rank and select need -DAVL_ORDER_STATISTIC\n");
+#endif
+}
+
+void test_augment()
+{
+	check_augment(100, 10000);
+	check_augment(5000, 20000);
+}
+
+void test_bounds()
+{
+	check_bounds(4, 100);
+	check_bounds(1000, 5000);
+	check_bounds(COUNT3, 2000);
+}
+
+void test_setop()
+{
+	check_setops(1);
+	check_setops(1000);
+	check_setops(COUNT3);
+}
+
+int main(int argc, char *argv[])
 {
+	const char *name = (argc > 1)? argv[1] : "";
 #ifdef _WIN32
 	SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_TIME_CRITICAL);
 #endif
-	printf("sizeof=%d/%d\n", sizeof(struct avl_node), sizeof(struct rb_node));
-	test2();
+	printf("sizeof=%d/%d\n", (int)sizeof(struct avl_node),
+			(int)sizeof(struct rb_node));
+	if (strcmp(name, "build") == 0) 
+		test_build();
+	else if (strcmp(name, "union") == 0) 
+		test_union();
+	else if (strcmp(name, "scan") == 0) 
+		test_scan();
+	else if (strcmp(name, "hint") == 0) 
+		test_hint();
+	else if (strcmp(name, "cached") == 0) 
+		test_cached();
+	else if (strcmp(name, "batch") == 0) 
+		test_batch();
+	else if (strcmp(name, "range") == 0) 
+		test_range();
+	else if (strcmp(name, "define") == 0) 
+		test_define();
+	else if (strcmp(name, "churn") == 0) 
+		test_churn();
+	else if (strcmp(name, "split") == 0) 
+		test_split();
+	else if (strcmp(name, "rank") == 0) 
+		test_rank();
+	else if (strcmp(name, "augment") == 0) 
+		test_augment();
+	else if (strcmp(name, "bounds") == 0) 
+		test_bounds();
+	else if (strcmp(name, "setop") == 0) 
+		test_setop();
+	else
+		test2();
 	return 0;
 }
 
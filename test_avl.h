@@ -7,6 +7,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <time.h>
 #include <assert.h>
 
@@ -88,6 +89,7 @@ static inline int avl_test_bst(struct avl_root *tree)
 	return 0;
 }
 
+#ifndef AVL_WAVL
 static int avl_test_height(struct avl_node *node, int *error)
 {
 	if (node == NULL) {
@@ -98,8 +100,8 @@ static int avl_test_height(struct avl_node *node, int *error)
 		int h1 = avl_test_height(node->right, error);
 		int mh = (h0 > h1)? h0 : h1;
 		int dh = (h0 > h1)? h0 - h1 : h1 - h0;
-		if (node->height != mh + 1) {
-			printf("height mismatch %d <-> %d\n",node->height, mh + 1);
+		if (AVL_HEIGHT(node) != mh + 1) {
+			printf("height mismatch %d <-> %d\n",AVL_HEIGHT(node), mh + 1);
 			error[0]++;
 			assert(0);
 			return 0;
@@ -113,6 +115,28 @@ static int avl_test_height(struct avl_node *node, int *error)
 		return mh + 1;
 	}
 }
+#else
+/* weak avl: rank differences are 1 or 2 and leaves have rank 0 */
+static int avl_test_height(struct avl_node *node, int *error)
+{
+	if (node == NULL) {
+		return 0;
+	}
+	else {
+		int r0 = avl_test_height(node->left, error);
+		int r1 = avl_test_height(node->right, error);
+		int rank = AVL_HEIGHT(node);
+		if (rank - r0 < 1 || rank - r0 > 2 || rank - r1 < 1 || rank - r1 > 2
+				|| (r0 == 0 && r1 == 0 && rank != 1)) {
+			printf("rank error %d <-> %d/%d\n", rank, r0, r1);
+			error[0]++;
+			assert(0);
+			return 0;
+		}
+		return rank;
+	}
+}
+#endif
 
 static int avl_test_father(struct avl_node *node, int *error)
 {
@@ -121,10 +145,10 @@ static int avl_test_father(struct avl_node *node, int *error)
 	}
 	else {
 		if (node->left) {
-			if (node->left->parent != node) {
+			if (AVL_PARENT(node->left) != node) {
 				printf("n%d.left.parent error\n", avl_key(node));
-				if (node->left->parent) {
-					printf("current parent=%d\n", avl_key(node->left->parent));
+				if (AVL_PARENT(node->left)) {
+					printf("current parent=%d\n", avl_key(AVL_PARENT(node->left)));
 				}
 				if (error) error[0]++;
 				assert(0);
@@ -132,10 +156,10 @@ static int avl_test_father(struct avl_node *node, int *error)
 			}
 		}
 		if (node->right) {
-			if (node->right->parent != node) {
+			if (AVL_PARENT(node->right) != node) {
 				printf("n%d.right.parent error\n", avl_key(node));
-				if (node->right->parent) {
-					printf("current parent=%d\n", avl_key(node->right->parent));
+				if (AVL_PARENT(node->right)) {
+					printf("current parent=%d\n", avl_key(AVL_PARENT(node->right)));
 				}
 				if (error) error[0]++;
 				assert(0);
@@ -148,6 +172,39 @@ static int avl_test_father(struct avl_node *node, int *error)
 	return 0;
 }
 
+#ifdef AVL_THREADED
+static struct avl_node *avl_test_thread(struct avl_node *node,
+		struct avl_node *prev, int *error)
+{
+	if (node == NULL) return prev;
+	prev = avl_test_thread(node->left, prev, error);
+	if (node->prev != prev || (prev && prev->next != node)) {
+		printf("n%d.prev thread error\n", avl_key(node));
+		error[0]++;
+		assert(0);
+	}
+	return avl_test_thread(node->right, node, error);
+}
+#endif
+
+#ifdef AVL_ORDER_STATISTIC
+/* every count must be the size of its subtree */
+static size_t avl_test_count(struct avl_node *node, int *error)
+{
+	size_t count;
+	if (node == NULL) return 0;
+	count = avl_test_count(node->left, error) +
+		avl_test_count(node->right, error) + 1;
+	if (node->count != count) {
+		printf("n%d.count error %d <-> %d\n", avl_key(node),
+				(int)node->count, (int)count);
+		error[0]++;
+		assert(0);
+	}
+	return count;
+}
+#endif
+
 static inline int avl_test_validate(struct avl_root *tree)
 {
 	int error = 0;
@@ -164,6 +221,19 @@ static inline int avl_test_validate(struct avl_root *tree)
 	if (error) {
 		return error;
 	}
+#ifdef AVL_ORDER_STATISTIC
+	avl_test_count(tree->node, &error);
+	if (error) {
+		return error;
+	}
+#endif
+#ifdef AVL_THREADED
+	{
+		struct avl_node *last = avl_test_thread(tree->node, NULL, &error);
+		if (last && last->next != NULL) error++;
+		assert(error == 0);
+	}
+#endif
 	/* printf("ok\n"); */
 	return error;
 }
@@ -196,15 +266,30 @@ static inline void random_keys(int *keys, int count, int seed)
 }
 
 
-static int avl_tree_height(struct avl_node *node)
+/* walks parent links without recursion, so it can be inlined */
+static inline int avl_tree_height(struct avl_node *node)
 {
-	if (node == NULL) 
-		return 0;
-	else if (node->left == NULL && node->right == NULL) 
-		return 1;
-	else
-		return _int_max(avl_tree_height(node->left),
-				avl_tree_height(node->right)) + 1;
+	struct avl_node *top = (node)? AVL_PARENT(node) : NULL;
+	struct avl_node *prev = top, *next;
+	int depth = 0, height = 0;
+	while (node != top) {
+		if (prev == AVL_PARENT(node)) {
+			depth++;
+			if (depth > height) height = depth;
+			next = (node->left)? node->left : node->right;
+			if (next == NULL) next = AVL_PARENT(node);
+		}
+		else if (prev == node->left && node->right) {
+			next = node->right;
+		}
+		else {
+			next = AVL_PARENT(node);
+		}
+		if (next == AVL_PARENT(node)) depth--;
+		prev = node;
+		node = next;
+	}
+	return height;
 }
 
 #endif
@@ -0,0 +1,125 @@
+#include "avlmini.c"
+#include "test/linux_rbtree.c"
+#include "test_avl.h"
+
+
+
+//---------------------------------------------------------------------
+// benchmark: avl_node_find one by one vs avl_node_find_batch
+//---------------------------------------------------------------------
+static void benchmark(int count)
+{
+	static const int sizes[] = { 1, 4, 8, 16, 32, 64, 128, 256 };
+	struct avl_root root;
+	struct MyNode *nodes, *queries;
+	struct MyNode **whats;
+	struct avl_node **results;
+	unsigned int ts, total;
+	int *keys, i, k, missing;
+
+	keys = (int*)malloc(sizeof(int) * count);
+	nodes = (struct MyNode*)malloc(sizeof(struct MyNode) * count);
+	queries = (struct MyNode*)malloc(sizeof(struct MyNode) * count);
+	whats = (struct MyNode**)malloc(sizeof(void*) * count);
+	results = (struct avl_node**)malloc(sizeof(void*) * count);
+
+	random_keys(keys, count, 0x11223344);
+	root.node = NULL;
+	for (i = 0; i < count; i++) {
+		struct avl_node *dup;
+		nodes[i].key = keys[i];
+		avl_node_add(&root, &nodes[i].node, avl_node_compare, dup);
+		assert(dup == NULL);
+	}
+
+	random_keys(keys, count, 0x55667788);
+	for (i = 0; i < count; i++) {
+		queries[i].key = keys[i];
+		whats[i] = &queries[i];
+		results[i] = NULL;
+	}
+
+	printf("search %d keys:\n", count);
+
+	sleepms(200);
+	total = 0;
+	missing = 0;
+	ts = gettime();
+	for (i = 0; i < count; i++) {
+		struct avl_node *res;
+		avl_node_find(&root, &queries[i].node, avl_node_compare, res);
+		if (res == NULL) missing++;
+		else total += avl_key(res);
+	}
+	ts = gettime() - ts;
+	printf("avl_node_find: %dms (%.1fM/s) missing=%d checksum=%u\n",
+			(int)ts, count / 1000.0 / (ts? ts : 1), missing, total);
+
+	for (k = 0; k < (int)(sizeof(sizes) / sizeof(sizes[0])); k++) {
+		int batch = sizes[k];
+		sleepms(200);
+		total = 0;
+		missing = 0;
+		ts = gettime();
+		for (i = 0; i < count; i += batch) {
+			int n = (count - i < batch)? count - i : batch;
+			avl_node_find_batch(&root, whats + i, n, avl_node_compare,
+					results + i);
+		}
+		ts = gettime() - ts;
+		for (i = 0; i < count; i++) {
+			if (results[i] == NULL) missing++;
+			else total += avl_key(results[i]);
+		}
+		printf("batch %3d: %dms (%.1fM/s) missing=%d checksum=%u\n", batch,
+				(int)ts, count / 1000.0 / (ts? ts : 1), missing, total);
+	}
+
+	free(keys);
+	free(nodes);
+	free(queries);
+	free(whats);
+	free(results);
+	printf("\n");
+}
+
+void test1()
+{
+	benchmark(10000000);
+	benchmark(1000000);
+}
+
+int main(void)
+{
+#ifdef _WIN32
+	SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_TIME_CRITICAL);
+#endif
+	test1();
+	return 0;
+}
+
+
+/*
+search 10000000 keys:
+avl_node_find: 4299ms (2.3M/s) missing=0 checksum=2280707264
+batch   1: 4420ms (2.3M/s) missing=0 checksum=2280707264
+batch   4: 3253ms (3.1M/s) missing=0 checksum=2280707264
+batch   8: 2214ms (4.5M/s) missing=0 checksum=2280707264
+batch  16: 1915ms (5.2M/s) missing=0 checksum=2280707264
+batch  32: 1553ms (6.4M/s) missing=0 checksum=2280707264
+batch  64: 1411ms (7.1M/s) missing=0 checksum=2280707264
+batch 128: 1581ms (6.3M/s) missing=0 checksum=2280707264
+batch 256: 1888ms (5.3M/s) missing=0 checksum=2280707264
+
+search 1000000 keys:
+avl_node_find: 439ms (2.3M/s) missing=0 checksum=1783293664
+batch   1: 341ms (2.9M/s) missing=0 checksum=1783293664
+batch   4: 248ms (4.0M/s) missing=0 checksum=1783293664
+batch   8: 221ms (4.5M/s) missing=0 checksum=1783293664
+batch  16: 161ms (6.2M/s) missing=0 checksum=1783293664
+batch  32: 155ms (6.5M/s) missing=0 checksum=1783293664
+batch  64: 172ms (5.8M/s) missing=0 checksum=1783293664
+batch 128: 164ms (6.1M/s) missing=0 checksum=1783293664
+batch 256: 175ms (5.7M/s) missing=0 checksum=1783293664
+*/
+
@@ -0,0 +1,563 @@
+#include "avlmini.c"
+#include "avlsync.h"
+
+/* set by the stress test: yield at one in 8 stores of avl_ctree,
+ * picked by a hash of a shared counter */
+static int stress_yield = 0;
+static long stress_access = 0;
+
+static inline void stress_maybe_yield(void)
+{
+	if (stress_yield) {
+		unsigned long x = (unsigned long)avl_atomic_inc(&stress_access);
+		x = (x ^ (x >> 15)) * 2654435761ul;
+		if (((x ^ (x >> 13)) & 0x70) == 0) avl_thread_yield();
+	}
+}
+
+#define AVL_CYIELD() stress_maybe_yield()
+#include "avlconc.c"
+#include "avlshard.c"
+#include "test/linux_rbtree.c"
+#include "test_avl.h"
+#include "test_thread.h"
+
+
+
+//---------------------------------------------------------------------
+// many writers: mutex + avl_tree vs avl_ctree vs avl_shard_tree
+//---------------------------------------------------------------------
+#define KEY_RANGE     (1 << 16)
+#define HOT_RANGE     (1 << 10)   /* keys taking most operations if skewed */
+#define FIND_RATIO    50          /* percent of finds, the rest is split
+                                     between adds and removes */
+#define SHARDS        16
+
+struct Shared
+{
+	int mode;                   /* 0: mutex + avl_tree, 1: avl_ctree,
+                                   2: avl_shard_tree */
+	int skew;                   /* 90% of operations on HOT_RANGE keys */
+	int threads;
+	volatile int stop;
+	volatile long done;         /* stress workers finished */
+	avl_mutex_t lock;
+	struct avl_tree tree;
+	struct avl_ctree ctree;
+	struct avl_shard_tree shards;
+	struct MyNode *nodes;
+	char *present;              /* stress: key is in, set by its owner */
+};
+
+static void worker_mutex(struct Worker *w, struct MyNode *node, int op)
+{
+	struct Shared *s = (struct Shared*)w->shared;
+	avl_mutex_lock(&s->lock);
+	if (op < FIND_RATIO) {
+		avl_tree_find(&s->tree, node);
+	}
+	else if (op & 1) {
+		if (avl_node_empty(&node->node)) avl_tree_add(&s->tree, node);
+	}
+	else {
+		if (!avl_node_empty(&node->node)) avl_tree_remove(&s->tree, node);
+	}
+	avl_mutex_unlock(&s->lock);
+}
+
+static void worker_ctree(struct Worker *w, struct MyNode *node, int op,
+		int tid)
+{
+	struct Shared *s = (struct Shared*)w->shared;
+	if (op < FIND_RATIO) avl_ctree_find(&s->ctree, tid, &node->key);
+	else if (op & 1) avl_ctree_add(&s->ctree, tid, &node->key, node);
+	else avl_ctree_remove(&s->ctree, tid, &node->key);
+}
+
+static void worker_shard(struct Worker *w, struct MyNode *node, int op)
+{
+	struct Shared *s = (struct Shared*)w->shared;
+	if (op < FIND_RATIO) avl_shard_find(&s->shards, node);
+	else if (op & 1) avl_shard_add(&s->shards, node);
+	else avl_shard_remove(&s->shards, node);
+}
+
+static void *worker_main(void *arg)
+{
+	struct Worker *w = (struct Worker*)arg;
+	struct Shared *s = (struct Shared*)w->shared;
+	int tid = (s->mode == 1)? avl_ctree_thread(&s->ctree) : 0;
+	while (!s->stop) {
+		unsigned int r = worker_rand(&w->seed);
+		unsigned int x = worker_rand(&w->seed);
+		int op = (int)(x % 100);
+		int key = (int)(r & (KEY_RANGE - 1));
+		struct MyNode *node;
+		if (s->skew && (x >> 8) % 10 < 9) {
+			key = KEY_RANGE / 2 + (int)(r & (HOT_RANGE - 1));
+		}
+		node = &s->nodes[key];
+		if (s->mode == 0) worker_mutex(w, node, op);
+		else if (s->mode == 1) worker_ctree(w, node, op, tid);
+		else worker_shard(w, node, op);
+		w->ops++;
+	}
+	return NULL;
+}
+
+static int key_compare(const void *k1, const void *k2)
+{
+	int x = *(const int*)k1;
+	int y = *(const int*)k2;
+	return (x < y)? -1 : (x > y)? 1 : 0;
+}
+
+/* shrink the hottest shard every 100ms if balance is set, returns the
+ * share of operations taken by the hottest shard in the last period */
+static double benchmark(int mode, int threads, int millisec, int skew,
+		int balance)
+{
+	static const char *names[] = { 
+		"mutex + avl_tree", "avl_ctree", "avl_shard_tree" };
+	struct Shared shared;
+	struct Worker *workers;
+	struct MyNode bounds[SHARDS - 1];
+	void *bptr[SHARDS - 1];
+	unsigned long ops = 0;
+	double share = 0;
+	int i, tid, elapsed;
+
+	workers = (struct Worker*)malloc(sizeof(struct Worker) * threads);
+	shared.mode = mode;
+	shared.skew = skew;
+	shared.threads = threads;
+	shared.stop = 0;
+	shared.done = 0;
+	shared.present = NULL;
+	avl_mutex_init(&shared.lock);
+	avl_tree_init(&shared.tree, avl_node_compare, sizeof(struct MyNode), 0);
+	avl_ctree_init(&shared.ctree, key_compare, sizeof(int), threads + 1);
+	for (i = 0; i < SHARDS - 1; i++) {
+		bounds[i].key = (i + 1) * (KEY_RANGE / SHARDS);
+		bptr[i] = &bounds[i];
+	}
+	avl_shard_init(&shared.shards, avl_node_compare, sizeof(struct MyNode),
+			0, SHARDS, bptr);
+	shared.nodes = (struct MyNode*)malloc(sizeof(struct MyNode) * KEY_RANGE);
+	for (i = 0; i < KEY_RANGE; i++) {
+		shared.nodes[i].key = i;
+		avl_node_init(&shared.nodes[i].node);
+	}
+	/* the main thread takes one more id for filling */
+	tid = avl_ctree_thread(&shared.ctree);
+	for (i = 0; i < KEY_RANGE; i += 2) {
+		if (mode == 0) avl_tree_add(&shared.tree, &shared.nodes[i]);
+		else if (mode == 1) 
+			avl_ctree_add(&shared.ctree, tid, &i, &shared.nodes[i]);
+		else avl_shard_add(&shared.shards, &shared.nodes[i]);
+	}
+
+	workers_start(workers, threads, &shared, NULL, worker_main);
+	for (elapsed = 0; elapsed < millisec; elapsed += 100) {
+		sleepms(100);
+		if (mode == 2) {
+			int hottest = avl_shard_hottest(&shared.shards, &share);
+			if (balance) avl_shard_shrink(&shared.shards, hottest);
+		}
+	}
+	shared.stop = 1;
+	ops = workers_join(workers, threads, 0);
+
+	printf("%s, %d threads: %.2fM ops/s", names[mode], threads,
+			ops / (millisec * 1000.0));
+	if (mode == 2) printf(", hottest shard %.0f%%", share * 100);
+	printf("\n");
+
+	avl_shard_destroy(&shared.shards, NULL);
+	avl_ctree_destroy(&shared.ctree);
+	avl_mutex_destroy(&shared.lock);
+	free(shared.nodes);
+	free(workers);
+	return share;
+}
+
+//---------------------------------------------------------------------
+// stress: each thread owns the keys k with k % threads == id and
+// checks every result against what it did to them
+//---------------------------------------------------------------------
+#define STRESS_OPS    100000
+
+static void *stress_main(void *arg)
+{
+	struct Worker *w = (struct Worker*)arg;
+	struct Shared *s = (struct Shared*)w->shared;
+	int tid = (s->mode == 1)? avl_ctree_thread(&s->ctree) : 0;
+	int slice = KEY_RANGE / s->threads;
+	for (; w->ops < STRESS_OPS; w->ops++) {
+		int key = (int)(worker_rand(&w->seed) % slice) * s->threads + w->id;
+		int op = (int)(worker_rand(&w->seed) % 3);
+		struct MyNode *node = &s->nodes[key];
+		void *hr;
+		if (s->mode == 0) {
+			avl_mutex_lock(&s->lock);
+			if (op == 0) hr = avl_tree_find(&s->tree, node);
+			else if (op == 1) hr = avl_tree_add(&s->tree, node);
+			else {
+				hr = avl_tree_find(&s->tree, node);
+				if (hr) avl_tree_remove(&s->tree, hr);
+			}
+			avl_mutex_unlock(&s->lock);
+		}
+		else if (s->mode == 1) {
+			if (op == 0) hr = avl_ctree_find(&s->ctree, tid, &key);
+			else if (op == 1) {
+				int added = avl_ctree_add(&s->ctree, tid, &key, node);
+				assert(added >= 0);
+				hr = (added == 0)? NULL : node;
+			}
+			else hr = avl_ctree_remove(&s->ctree, tid, &key);
+		}
+		else {
+			if (op == 0) hr = avl_shard_find(&s->shards, node);
+			else if (op == 1) hr = avl_shard_add(&s->shards, node);
+			else hr = avl_shard_remove(&s->shards, node);
+		}
+		/* find, add (as duplicate) and remove return node iff it is in */
+		assert(hr == ((s->present[key])? (void*)node : NULL));
+		if (op == 1) s->present[key] = 1;
+		else if (op == 2) s->present[key] = 0;
+	}
+	avl_atomic_inc(&s->done);
+	return NULL;
+}
+
+struct Collect
+{
+	int *keys;
+	int count;
+};
+
+static void stress_visit(void *data, void *user)
+{
+	struct Collect *c = (struct Collect*)user;
+	c->keys[c->count++] = ((struct MyNode*)data)->key;
+}
+
+/* in key order with parent links and balance, returns the height */
+static long stress_ctree(struct avl_cnode *node, struct avl_cnode *parent,
+		struct Collect *c)
+{
+	long h0, h1;
+	if (node == NULL) return 0;
+	assert(node->parent == parent);
+	assert((node->version & AVL_CUNLINKED) == 0);
+	h0 = stress_ctree(node->left, node, c);
+	if (node->value) {
+		assert(((struct MyNode*)node->value)->key ==
+				*(int*)AVL_CNODE_KEY(node));
+		stress_visit(node->value, c);
+	}
+	h1 = stress_ctree(node->right, node, c);
+	assert(node->height == ((h0 > h1)? h0 : h1) + 1);
+	assert(h0 - h1 <= 1 && h1 - h0 <= 1);
+	return node->height;
+}
+
+static void stress(int mode, int threads)
+{
+	static const char *names[] = { 
+		"mutex + avl_tree", "avl_ctree", "avl_shard_tree" };
+	struct Shared shared;
+	struct Worker *workers;
+	struct Collect collect;
+	unsigned int seed = 0x11223344;
+	int i, j, moves = 0;
+
+	workers = (struct Worker*)malloc(sizeof(struct Worker) * threads);
+	shared.mode = mode;
+	shared.skew = 0;
+	shared.threads = threads;
+	shared.stop = 0;
+	shared.done = 0;
+	avl_mutex_init(&shared.lock);
+	avl_tree_init(&shared.tree, avl_node_compare, sizeof(struct MyNode), 0);
+	avl_ctree_init(&shared.ctree, key_compare, sizeof(int), threads);
+	avl_shard_init(&shared.shards, avl_node_compare, sizeof(struct MyNode),
+			0, SHARDS, NULL);
+	shared.nodes = (struct MyNode*)malloc(sizeof(struct MyNode) * KEY_RANGE);
+	shared.present = (char*)malloc(KEY_RANGE);
+	collect.keys = (int*)malloc(sizeof(int) * KEY_RANGE);
+	collect.count = 0;
+	for (i = 0; i < KEY_RANGE; i++) {
+		shared.nodes[i].key = i;
+		avl_node_init(&shared.nodes[i].node);
+		shared.present[i] = 0;
+	}
+
+	workers_start(workers, threads, &shared, NULL, stress_main);
+	/* bounds start empty and move around while the workers run */
+	for (i = 1; avl_atomic_load(&shared.done) < threads; i++) {
+		if (mode == 2) {
+			struct MyNode bound;
+			bound.key = (int)(worker_rand(&seed) % (KEY_RANGE + 64)) - 32;
+			if (avl_shard_move(&shared.shards,
+					(int)(worker_rand(&seed) % (SHARDS - 1)), &bound) >= 0)
+				moves++;
+			if ((i & 15) == 0)
+				avl_shard_shrink(&shared.shards,
+						avl_shard_hottest(&shared.shards, NULL));
+		}
+		if (mode != 2 || (i & 63) == 0) avl_thread_yield();
+	}
+	workers_join(workers, threads, 0);
+
+	if (mode == 0) {
+		void *data;
+		assert(avl_test_validate(&shared.tree.root) == 0);
+		for (data = avl_tree_first(&shared.tree); data != NULL;
+				data = avl_tree_next(&shared.tree, data))
+			stress_visit(data, &collect);
+		assert(collect.count == (int)shared.tree.count);
+	}
+	else if (mode == 1) {
+		stress_ctree(shared.ctree.holder.right, &shared.ctree.holder,
+				&collect);
+	}
+	else {
+		for (i = 0; i < SHARDS; i++) {
+			struct avl_shard *shard = avl_shard_at(&shared.shards, i);
+			void *data;
+			assert(avl_test_validate(&shard->tree.root) == 0);
+			for (data = avl_tree_first(&shard->tree); data != NULL;
+					data = avl_tree_next(&shard->tree, data))
+				assert(_avl_shard_owns(&shared.shards, i, data));
+		}
+		avl_shard_walk(&shared.shards, stress_visit, &collect);
+		assert(collect.count == (int)avl_shard_count(&shared.shards));
+	}
+	for (i = 0, j = 0; i < KEY_RANGE; i++) {
+		if (shared.present[i] == 0) continue;
+		assert(j < collect.count && collect.keys[j] == i);
+		j++;
+	}
+	assert(j == collect.count);
+
+	printf("%s, %d threads: %d keys", names[mode], threads, collect.count);
+	if (mode == 2) printf(", %d bound moves", moves);
+	if (stress_yield) printf(", yielding");
+	printf(", ok\n");
+
+	avl_shard_destroy(&shared.shards, NULL);
+	avl_ctree_destroy(&shared.ctree);
+	avl_mutex_destroy(&shared.lock);
+	free(collect.keys);
+	free(shared.present);
+	free(shared.nodes);
+	free(workers);
+}
+
+//---------------------------------------------------------------------
+// set operations forked onto threads, checked against serial runs
+//---------------------------------------------------------------------
+struct SetopThread
+{
+	avl_thread_t thread;
+	void (*run)(void *arg);
+	void *arg;
+};
+
+static long setop_threads = 0;
+static long setop_dropped = 0;
+
+static void *setop_thread(void *arg)
+{
+	struct SetopThread *t = (struct SetopThread*)arg;
+	t->run(t->arg);
+	return NULL;
+}
+
+static void *setop_spawn(void (*run)(void *arg), void *arg, void *user)
+{
+	struct SetopThread *t;
+	t = (struct SetopThread*)malloc(sizeof(struct SetopThread));
+	t->run = run;
+	t->arg = arg;
+	if (avl_thread_create(&t->thread, setop_thread, t) != 0) {
+		free(t);
+		return NULL;
+	}
+	avl_atomic_inc(&setop_threads);
+	return t;
+}
+
+static void setop_join(void *handle, void *user)
+{
+	struct SetopThread *t = (struct SetopThread*)handle;
+	avl_thread_join(t->thread);
+	free(t);
+}
+
+static void setop_destroy(void *data)
+{
+	avl_atomic_inc(&setop_dropped);
+}
+
+/* a and b draw keys of [0, 2 * count) at half density, the same sets
+ * go serial into a copy, results must match node by node */
+static void setop_fork(int count, int op, size_t grain)
+{
+	static const char *names[] = { "union", "intersect", "difference" };
+	struct MyNode *nodes[4];
+	struct avl_tree trees[4];
+	struct avl_fork fork;
+	long dropped;
+	unsigned int ts[2];
+	void *x, *y;
+	int i, k;
+
+	for (i = 0; i < 4; i++) {
+		nodes[i] = (struct MyNode*)malloc(sizeof(struct MyNode) * count * 2);
+		avl_tree_init(&trees[i], avl_node_compare, sizeof(struct MyNode),
+				AVL_OFFSET(struct MyNode, node));
+	}
+	for (k = 0; k < count * 2; k++) {
+		int in_a = RANDOM(2), in_b = RANDOM(2);
+		for (i = 0; i < 4; i++) nodes[i][k].key = k;
+		if (in_a) {
+			avl_tree_add(&trees[0], &nodes[0][k]);
+			avl_tree_add(&trees[2], &nodes[2][k]);
+		}
+		if (in_b) {
+			avl_tree_add(&trees[1], &nodes[1][k]);
+			avl_tree_add(&trees[3], &nodes[3][k]);
+		}
+	}
+	fork.spawn = setop_spawn;
+	fork.join = setop_join;
+	fork.grain = grain;
+	fork.user = NULL;
+
+	setop_dropped = 0;
+	ts[0] = gettime();
+	avl_tree_setop(&trees[0], &trees[1], op, setop_destroy, NULL);
+	ts[0] = gettime() - ts[0];
+	dropped = setop_dropped;
+	setop_dropped = 0;
+	setop_threads = 0;
+	ts[1] = gettime();
+	avl_tree_setop(&trees[2], &trees[3], op, setop_destroy, &fork);
+	ts[1] = gettime() - ts[1];
+	assert(setop_dropped == dropped);
+
+	for (i = 0; i < 2; i++) {
+		assert(avl_test_validate(&trees[i + 2].root) == 0);
+		assert(trees[i].count == trees[i + 2].count);
+		x = avl_tree_first(&trees[i]);
+		y = avl_tree_first(&trees[i + 2]);
+		for (; x != NULL; x = avl_tree_next(&trees[i], x)) {
+			assert(y && ((struct MyNode*)x)->key == ((struct MyNode*)y)->key);
+			y = avl_tree_next(&trees[i + 2], y);
+		}
+		assert(y == NULL);
+	}
+
+	printf("%s in %d keys, grain %d: %ums serial, %ums on %d threads, ok\n",
+			names[op], count * 2, (int)grain, ts[0], ts[1],
+			(int)setop_threads);
+	for (i = 0; i < 4; i++) free(nodes[i]);
+}
+
+void test_setop()
+{
+	int op;
+	for (op = 0; op < 3; op++) {
+		setop_fork(1000, op, 16);
+		setop_fork(1 << 20, op, 1 << 14);
+	}
+}
+
+void test1()
+{
+	int threads, mode;
+	for (threads = 1; threads <= 16; threads *= 2) {
+		for (mode = 0; mode < 3; mode++) {
+			benchmark(mode, threads, 2000, 0, 0);
+		}
+	}
+}
+
+/* skewed load: shards with fixed bounds vs hot shards shrunk online */
+void test2()
+{
+	int threads;
+	for (threads = 1; threads <= 16; threads *= 4) {
+		printf("skewed, fixed bounds: ");
+		benchmark(2, threads, 2000, 1, 0);
+		printf("skewed, shrinking hot shards: ");
+		benchmark(2, threads, 2000, 1, 1);
+	}
+}
+
+void test_stress()
+{
+	int threads, mode, round;
+	for (threads = 1; threads <= 8; threads *= 2) {
+		for (mode = 0; mode < 3; mode++) {
+			stress(mode, threads);
+		}
+	}
+	/* preempted in the middle of updates, as many cores would do */
+	stress_yield = 1;
+	for (round = 0; round < 4; round++) {
+		for (threads = 2; threads <= 8; threads *= 2) {
+			stress(1, threads);
+		}
+	}
+	stress_yield = 0;
+}
+
+int main(int argc, char *argv[])
+{
+	const char *name = (argc > 1)? argv[1] : "";
+	if (strcmp(name, "stress") == 0) {
+		test_stress();
+		return 0;
+	}
+	if (strcmp(name, "setop") == 0) {
+		test_setop();
+		return 0;
+	}
+	test1();
+	test2();
+	return 0;
+}
+
+
+/*
+(single cpu, threads are time sliced: a thread preempted with a lock
+held makes the others wait, writers can not scale here. nodes of the
+mutex run are one array in key order, which flatters its cache use.
+the share of the hottest shard is what bounds scaling on many cores)
+mutex + avl_tree, 1 threads: 6.49M ops/s
+avl_ctree, 1 threads: 1.36M ops/s
+avl_shard_tree, 1 threads: 4.46M ops/s, hottest shard 6%
+mutex + avl_tree, 2 threads: 5.74M ops/s
+avl_ctree, 2 threads: 0.92M ops/s
+avl_shard_tree, 2 threads: 3.14M ops/s, hottest shard 6%
+mutex + avl_tree, 4 threads: 4.92M ops/s
+avl_ctree, 4 threads: 0.65M ops/s
+avl_shard_tree, 4 threads: 3.48M ops/s, hottest shard 6%
+mutex + avl_tree, 8 threads: 5.56M ops/s
+avl_ctree, 8 threads: 0.57M ops/s
+avl_shard_tree, 8 threads: 3.88M ops/s, hottest shard 6%
+mutex + avl_tree, 16 threads: 5.61M ops/s
+avl_ctree, 16 threads: 0.61M ops/s
+avl_shard_tree, 16 threads: 4.15M ops/s, hottest shard 6%
+skewed, fixed bounds: avl_shard_tree, 1 threads: 6.32M ops/s, hottest shard 91%
+skewed, shrinking hot shards: avl_shard_tree, 1 threads: 5.76M ops/s, hottest shard 61%
+skewed, fixed bounds: avl_shard_tree, 4 threads: 5.35M ops/s, hottest shard 91%
+skewed, shrinking hot shards: avl_shard_tree, 4 threads: 5.19M ops/s, hottest shard 43%
+skewed, fixed bounds: avl_shard_tree, 16 threads: 6.71M ops/s, hottest shard 91%
+skewed, shrinking hot shards: avl_shard_tree, 16 threads: 5.80M ops/s, hottest shard 56%
+*/
+
@@ -0,0 +1,421 @@
+#include "avlmini.c"
+#include "avlitree.c"
+#include "test/linux_rbtree.c"
+#include "test_avl.h"
+
+
+
+//---------------------------------------------------------------------
+// rbtree interval tree with augment path update (linux 2.6.35 style)
+//---------------------------------------------------------------------
+struct RbInterval
+{
+	struct rb_node node;
+	long long start;
+	long long last;
+	long long subtree_last;
+};
+
+#define RB_INTERVAL(n) rb_entry(n, struct RbInterval, node)
+
+static void rb_interval_compute(struct rb_node *rb)
+{
+	struct RbInterval *node = RB_INTERVAL(rb);
+	long long last = node->last;
+	if (rb->rb_left && RB_INTERVAL(rb->rb_left)->subtree_last > last)
+		last = RB_INTERVAL(rb->rb_left)->subtree_last;
+	if (rb->rb_right && RB_INTERVAL(rb->rb_right)->subtree_last > last)
+		last = RB_INTERVAL(rb->rb_right)->subtree_last;
+	node->subtree_last = last;
+}
+
+static void rb_augment_path(struct rb_node *node)
+{
+	struct rb_node *parent;
+	while (1) {
+		rb_interval_compute(node);
+		parent = node->rb_parent;
+		if (!parent) return;
+		if (node == parent->rb_left && parent->rb_right)
+			rb_interval_compute(parent->rb_right);
+		else if (parent->rb_left)
+			rb_interval_compute(parent->rb_left);
+		node = parent;
+	}
+}
+
+static void rb_interval_insert(struct rb_root *root, struct RbInterval *node)
+{
+	struct rb_node **link = &root->rb_node, *parent = NULL, *deepest;
+	while (link[0]) {
+		parent = link[0];
+		if (node->start < RB_INTERVAL(parent)->start)
+			link = &parent->rb_left;
+		else
+			link = &parent->rb_right;
+	}
+	rb_link_node(&node->node, parent, link);
+	rb_insert_color(&node->node, root);
+	deepest = &node->node;
+	if (deepest->rb_left) deepest = deepest->rb_left;
+	else if (deepest->rb_right) deepest = deepest->rb_right;
+	rb_augment_path(deepest);
+}
+
+static void rb_interval_erase(struct rb_root *root, struct RbInterval *data)
+{
+	struct rb_node *node = &data->node, *deepest;
+	if (!node->rb_right && !node->rb_left)
+		deepest = node->rb_parent;
+	else if (!node->rb_right)
+		deepest = node->rb_left;
+	else if (!node->rb_left)
+		deepest = node->rb_right;
+	else {
+		deepest = rb_next(node);
+		if (deepest->rb_right)
+			deepest = deepest->rb_right;
+		else if (deepest->rb_parent != node)
+			deepest = deepest->rb_parent;
+	}
+	rb_erase(node, root);
+	if (deepest) rb_augment_path(deepest);
+}
+
+static struct RbInterval *
+rb_interval_search(struct RbInterval *node, long long start, long long last)
+{
+	while (1) {
+		if (node->node.rb_left) {
+			struct RbInterval *left = RB_INTERVAL(node->node.rb_left);
+			if (start <= left->subtree_last) {
+				node = left;
+				continue;
+			}
+		}
+		if (node->start <= last) {
+			if (start <= node->last)
+				return node;
+			if (node->node.rb_right) {
+				node = RB_INTERVAL(node->node.rb_right);
+				if (start <= node->subtree_last)
+					continue;
+			}
+		}
+		return NULL;
+	}
+}
+
+static struct RbInterval *
+rb_interval_first(struct rb_root *root, long long start, long long last)
+{
+	struct RbInterval *node;
+	if (root->rb_node == NULL) return NULL;
+	node = RB_INTERVAL(root->rb_node);
+	if (node->subtree_last < start) return NULL;
+	return rb_interval_search(node, start, last);
+}
+
+static struct RbInterval *
+rb_interval_next(struct RbInterval *node, long long start, long long last)
+{
+	struct rb_node *rb = node->node.rb_right, *prev;
+	while (1) {
+		if (rb) {
+			struct RbInterval *right = RB_INTERVAL(rb);
+			if (start <= right->subtree_last)
+				return rb_interval_search(right, start, last);
+		}
+		do {
+			rb = node->node.rb_parent;
+			if (!rb) return NULL;
+			prev = &node->node;
+			node = RB_INTERVAL(rb);
+			rb = node->node.rb_right;
+		}	while (prev == rb);
+		if (last < node->start)
+			return NULL;
+		else if (start <= node->last)
+			return node;
+	}
+}
+
+
+//---------------------------------------------------------------------
+// benchmark: 0 for avl itree, 1 for rbtree, 2 for linear scan
+//---------------------------------------------------------------------
+#define SPACE    1000000000
+#define CHECKED  1000          /* queries every mode runs */
+
+static void benchmark(const char *text, int mode, int count, int queries)
+{
+	struct avl_itree_node *avl_nodes = NULL;
+	struct RbInterval *rb_nodes = NULL;
+	struct avl_itree itree;
+	struct rb_root rb_root;
+	long long *starts, *lasts, *qs, total = 0, checked = 0;
+	unsigned int ts, seed = xseed;
+	int i;
+
+	starts = (long long*)malloc(sizeof(long long) * count);
+	lasts = (long long*)malloc(sizeof(long long) * count);
+	qs = (long long*)malloc(sizeof(long long) * queries);
+	assert(queries >= CHECKED);
+	xseed = 0x11223344;
+	for (i = 0; i < count; i++) {
+		starts[i] = ((long long)xrand() * 32768 + xrand()) % SPACE;
+		lasts[i] = starts[i] + xrand() % (SPACE / count * 8 + 1);
+	}
+	/* made after the intervals, so fewer queries are a prefix of more */
+	for (i = 0; i < queries; i++) {
+		qs[i] = ((long long)xrand() * 32768 + xrand()) % SPACE;
+	}
+	xseed = seed;
+
+	printf("%s with %d intervals:\n", text, count);
+	sleepms(200);
+	ts = gettime();
+
+	if (mode == 0) {
+		avl_nodes = (struct avl_itree_node*)
+			malloc(sizeof(struct avl_itree_node) * count);
+		avl_itree_init(&itree);
+		for (i = 0; i < count; i++) {
+			avl_nodes[i].start = starts[i];
+			avl_nodes[i].last = lasts[i];
+			avl_itree_insert(&itree, &avl_nodes[i]);
+		}
+	}
+	else if (mode == 1) {
+		rb_nodes = (struct RbInterval*)malloc(sizeof(struct RbInterval) * count);
+		rb_root.rb_node = NULL;
+		for (i = 0; i < count; i++) {
+			rb_nodes[i].start = starts[i];
+			rb_nodes[i].last = lasts[i];
+			rb_interval_insert(&rb_root, &rb_nodes[i]);
+		}
+	}
+
+	ts = gettime() - ts;
+	printf("insert time: %dms\n", (int)ts);
+
+	sleepms(100);
+	ts = gettime();
+
+	for (i = 0; i < queries; i++) {
+		long long start = qs[i], last = qs[i] + SPACE / count * 16;
+		if (mode == 0) {
+			struct avl_itree_node *node;
+			avl_itree_foreach(node, &itree, start, last) {
+				total += node->start;
+			}
+		}
+		else if (mode == 1) {
+			struct RbInterval *node;
+			node = rb_interval_first(&rb_root, start, last);
+			for (; node; node = rb_interval_next(node, start, last)) {
+				total += node->start;
+			}
+		}
+		else {
+			int j;
+			for (j = 0; j < count; j++) {
+				if (starts[j] <= last && start <= lasts[j])
+					total += starts[j];
+			}
+		}
+		if (i == CHECKED - 1) checked = total;
+	}
+
+	ts = gettime() - ts;
+	printf("query time: %dms for %d queries, checksum=%lld, "
+			"first %d checksum=%lld\n", (int)ts, queries, total,
+			CHECKED, checked);
+
+	sleepms(100);
+	ts = gettime();
+
+	if (mode == 0) {
+		for (i = 0; i < count; i++)
+			avl_itree_erase(&itree, &avl_nodes[i]);
+		assert(itree.root.node == NULL);
+	}
+	else if (mode == 1) {
+		for (i = 0; i < count; i++)
+			rb_interval_erase(&rb_root, &rb_nodes[i]);
+		assert(rb_root.rb_node == NULL);
+	}
+
+	ts = gettime() - ts;
+	printf("delete time: %dms\n", (int)ts);
+
+	if (avl_nodes) free(avl_nodes);
+	if (rb_nodes) free(rb_nodes);
+	free(starts);
+	free(lasts);
+	free(qs);
+	printf("\n");
+}
+
+//---------------------------------------------------------------------
+// check: every query against a linear scan, after erases and replaces
+//---------------------------------------------------------------------
+
+/* subtree_last of each node must be the max last below it */
+static AVL_ITREE_KEY check_subtree_last(struct avl_node *node)
+{
+	struct avl_itree_node *x;
+	AVL_ITREE_KEY last, child;
+	if (node == NULL) return -1;
+	x = AVL_ENTRY(node, struct avl_itree_node, node);
+	last = x->last;
+	child = check_subtree_last(node->left);
+	if (child > last) last = child;
+	child = check_subtree_last(node->right);
+	if (child > last) last = child;
+	assert(x->subtree_last == last);
+	return last;
+}
+
+/* links and heights as avl_test_validate, starts in order */
+static void check_itree(struct avl_itree *itree)
+{
+	struct avl_node *node;
+	long long prev = -1;
+	int error = 0;
+	avl_test_father(itree->root.node, &error);
+	avl_test_height(itree->root.node, &error);
+	assert(error == 0);
+	node = avl_node_first(&itree->root);
+	for (; node; node = avl_node_next(node)) {
+		struct avl_itree_node *x = AVL_ENTRY(node, struct avl_itree_node,
+				node);
+		assert(prev <= x->start);
+		prev = x->start;
+	}
+	check_subtree_last(itree->root.node);
+}
+
+/* 30 random bits, taken modulo n */
+static long long check_rand(long long n)
+{
+	return ((long long)xrand() * 32768 + xrand()) % n;
+}
+
+/* interval i lives in a[i] or its replacement b[i], in[i] says which
+ * one (0 for none). each round runs the queries, then erases, replaces
+ * and inserts back one interval in four at random */
+static void check(int count, long long space, int queries, int rounds)
+{
+	struct avl_itree_node *a, *b, *node;
+	struct avl_itree itree;
+	char *in;
+	int *seen, i, j, q, round, present = count, visits = 0;
+
+	a = (struct avl_itree_node*)malloc(sizeof(*a) * count);
+	b = (struct avl_itree_node*)malloc(sizeof(*b) * count);
+	in = (char*)malloc(count);
+	seen = (int*)malloc(sizeof(int) * count);
+	avl_itree_init(&itree);
+	for (i = 0; i < count; i++) {
+		a[i].start = b[i].start = check_rand(space);
+		a[i].last = b[i].last = a[i].start + check_rand(space / 8 + 1);
+		avl_itree_insert(&itree, &a[i]);
+		in[i] = 1;
+		seen[i] = -1;
+	}
+
+	for (round = 0; round < rounds; round++) {
+		check_itree(&itree);
+		assert((int)itree.count == present);
+		for (q = 0; q < queries; q++) {
+			long long start = check_rand(space);
+			long long width = (q & 1)? space / 4 : space / 1000;
+			long long last = start + check_rand(width + 1);
+			long long prev = -1;
+			int found = 0, want = 0;
+			avl_itree_foreach(node, &itree, start, last) {
+				i = (int)((node >= a && node < a + count)?
+					node - a : node - b);
+				assert(node == ((in[i] == 1)? &a[i] : &b[i]));
+				assert(node->start <= last && start <= node->last);
+				assert(prev <= node->start && seen[i] != q + round * queries);
+				seen[i] = q + round * queries;
+				prev = node->start;
+				found++;
+			}
+			for (j = 0; j < count; j++) {
+				if (in[j] && a[j].start <= last && start <= a[j].last) {
+					assert(seen[j] == q + round * queries);
+					want++;
+				}
+			}
+			assert(found == want);
+			visits += found;
+		}
+		for (i = 0; i < count; i++) {
+			struct avl_itree_node *x = (in[i] == 1)? &a[i] : &b[i];
+			if (xrand() % 4 != 0) continue;
+			switch (xrand() % 3) {
+			case 0:
+				if (in[i] == 0) break;
+				avl_itree_erase(&itree, x);
+				in[i] = 0;
+				present--;
+				break;
+			case 1:
+				if (in[i] == 0) break;
+				avl_itree_replace(&itree, x, (in[i] == 1)? &b[i] : &a[i]);
+				in[i] = (in[i] == 1)? 2 : 1;
+				break;
+			default:
+				if (in[i] != 0) break;
+				avl_itree_insert(&itree, &a[i]);
+				in[i] = 1;
+				present++;
+				break;
+			}
+		}
+	}
+
+	printf("%d intervals, %d queries x %d rounds, %d hits: ok\n",
+			count, queries, rounds, visits);
+	free(seen);
+	free(in);
+	free(b);
+	free(a);
+}
+
+void test_check()
+{
+	check(1, 10, 100, 4);
+	check(10, 100, 1000, 8);
+	check(1000, 100000, 1000, 8);
+	check(20000, 1000000000, 200, 8);
+}
+
+void test1()
+{
+	benchmark("avl itree", 0, 1000000, 100000);
+	benchmark("linux rbtree", 1, 1000000, 100000);
+	benchmark("linear scan", 2, 1000000, 1000);
+	benchmark("avl itree", 0, 100000, 100000);
+	benchmark("linux rbtree", 1, 100000, 100000);
+	benchmark("linear scan", 2, 100000, 10000);
+}
+
+int main(int argc, char *argv[])
+{
+	const char *name = (argc > 1)? argv[1] : "";
+#ifdef _WIN32
+	SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_TIME_CRITICAL);
+#endif
+	if (strcmp(name, "check") == 0) {
+		test_check();
+		return 0;
+	}
+	test1();
+	return 0;
+}
+
+
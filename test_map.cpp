@@ -1,8 +1,13 @@
 #include "avlmini.c"
+#include "avlsnap.c"
+#include "avlhash.c"
+#include "avlmini.hpp"
 #include "test/linux_rbtree.c"
 #include "test_avl.h"
 
 #include <map>
+#include <set>
+#include <string>
 
 
 //---------------------------------------------------------------------
@@ -13,13 +18,17 @@ static void benchmark(const char *text, int mode, int count)
 	int *keys;
 	struct avl_root avl_root;
 	struct rb_root rb_root;
+	struct avl_kary kary;
 	unsigned int ts, total = 0;
 	int i, missing = 0;
 	std::map<int, int> stlmap;
+	avl::map<int, int> avlmap;
+	avl::map<int, int, std::less<int>, std::allocator<std::pair<const int, int> > >
+		avlmap2;
 
 	keys = (int*)malloc(sizeof(int) * count);
 	random_keys(keys, count, 0x11223344);
-	if (mode == 0) {
+	if (mode == 0 || mode == 3) {
 		avl_root.node = NULL;
 	}
 	else if (mode == 1) {
@@ -32,7 +41,7 @@ static void benchmark(const char *text, int mode, int count)
 	ts = gettime();
 
 	// test insert
-	if (mode == 0) {
+	if (mode == 0 || mode == 3) {
 		for (i = 0; i < count; i++) {
 			struct avl_node *dup;
 			struct MyNode *node = avl_node_new(keys[i]);
@@ -56,12 +65,31 @@ static void benchmark(const char *text, int mode, int count)
 			stlmap[key] = key * 10;
 		}
 	}
+	else if (mode == 4) {
+		for (i = 0; i < count; i++) {
+			int key = keys[i];
+			avlmap[key] = key * 10;
+		}
+	}
+	else if (mode == 5) {
+		for (i = 0; i < count; i++) {
+			int key = keys[i];
+			avlmap2[key] = key * 10;
+		}
+	}
 
 	ts = gettime() - ts;
 	total += ts;
 	printf("insert time: %dms", (int)ts);
 
-	if (mode == 0) {
+	if (mode == 3) {
+		ts = gettime();
+		avl_kary_build(&kary, &avl_root, AVL_OFFSET(struct MyNode, node),
+				AVL_OFFSET(struct MyNode, key), -1);
+		ts = gettime() - ts;
+		printf(", build time: %dms, simd=%d\n", (int)ts, kary.simd);
+	}
+	else if (mode == 0) {
 		printf(", height=%d\n", avl_tree_height(avl_root.node));
 		avl_test_validate(&avl_root);
 		avl_node_first(&avl_root);
@@ -110,6 +138,29 @@ static void benchmark(const char *text, int mode, int count)
 			assert(it != stlmap.end());
 		}
 	}
+	else if (mode == 3) {
+		for (i = 0; i < count; i++) {
+			int key = keys[count - 1 - i];
+			struct MyNode *result = (struct MyNode*)avl_kary_find(&kary, key);
+			assert(result);
+			assert(result->key == key);
+		}
+	}
+	else if (mode == 4) {
+		for (i = 0; i < count; i++) {
+			int key = keys[count - 1 - i];
+			avl::map<int, int>::iterator it = avlmap.find(key);
+			assert(it != avlmap.end());
+		}
+	}
+	else if (mode == 5) {
+		for (i = 0; i < count; i++) {
+			int key = keys[count - 1 - i];
+			avl::map<int, int, std::less<int>, std::allocator<std::pair<const int, int> > >
+				::iterator it = avlmap2.find(key);
+			assert(it != avlmap2.end());
+		}
+	}
 
 	ts = gettime() - ts;
 	total += ts;
@@ -118,7 +169,11 @@ static void benchmark(const char *text, int mode, int count)
 	sleepms(200);
 	ts = gettime();
 
-	if (mode == 0) {
+	if (mode == 3) {
+		avl_kary_destroy(&kary);
+	}
+
+	if (mode == 0 || mode == 3) {
 		for (i = 0; i < count; i++) {
 			struct avl_node *node = avl_node_first(&avl_root);
 			assert(node);
@@ -143,6 +198,21 @@ static void benchmark(const char *text, int mode, int count)
 			stlmap.erase(it);
 		}
 	}
+	else if (mode == 4) {
+		for (i = 0; i < count; i++) {
+			avl::map<int, int>::iterator it = avlmap.begin();
+			assert(it != avlmap.end());
+			avlmap.erase(it);
+		}
+	}
+	else if (mode == 5) {
+		for (i = 0; i < count; i++) {
+			avl::map<int, int, std::less<int>, std::allocator<std::pair<const int, int> > >
+				::iterator it = avlmap2.begin();
+			assert(it != avlmap2.end());
+			avlmap2.erase(it);
+		}
+	}
 
 	ts = gettime() - ts;
 	total += ts;
@@ -152,6 +222,439 @@ static void benchmark(const char *text, int mode, int count)
 	printf("\n");
 }
 
+//---------------------------------------------------------------------
+// check: avl::map and avl::set against std::map and std::set
+//---------------------------------------------------------------------
+typedef std::map<int, std::string> Model;
+typedef avl::map<int, std::string> FastMap;
+typedef avl::map<int, std::string, std::less<int>,
+	std::allocator<std::pair<const int, std::string> > > HeapMap;
+
+// a container which can validate its tree
+template <class T>
+class Checked: public T
+{
+public:
+	Checked() {}
+	explicit Checked(const typename T::allocator_type &a): T(a) {}
+	int validate() { return avl_test_validate(&this->_root); }
+};
+
+// long enough to live on the heap, so a leak or a double free shows
+static std::string check_value(int key, int step)
+{
+	char text[64];
+	sprintf(text, "key %d, written at step %d", key, step);
+	return std::string(text);
+}
+
+// same values in both directions, walking back from end() too
+template <class Map, class M>
+static void check_same(Map &m, const M &model)
+{
+	typename Map::const_iterator it = m.cbegin();
+	typename M::const_iterator mt;
+	typename M::const_reverse_iterator rt;
+	assert(m.validate() == 0);
+	assert(m.size() == model.size() && m.empty() == model.empty());
+	for (mt = model.begin(); mt != model.end(); ++mt) {
+		assert(it != m.cend() && *it++ == *mt);
+	}
+	assert(it == m.cend());
+	for (rt = model.rbegin(); rt != model.rend(); ++rt) {
+		assert(*--it == *rt);
+	}
+	assert(it == m.cbegin());
+	assert(std::equal(m.rbegin(), m.rend(), model.rbegin()));
+}
+
+// it and mt hold the same value or are both at the end
+template <class Map, class M>
+static bool check_at(const Map &m, typename Map::const_iterator it,
+		const M &model, typename M::const_iterator mt)
+{
+	if (mt == model.end()) return it == m.end();
+	return it != m.end() && *it == *mt;
+}
+
+// right at key, just before it, anywhere or end()
+template <class Map>
+static typename Map::const_iterator check_hint(Map &m, int key, int range)
+{
+	typename Map::const_iterator it;
+	switch (RANDOM(4)) {
+	case 0: return m.lower_bound(key);
+	case 1:
+		it = m.lower_bound(key);
+		return (it == m.cbegin())? it : --it;
+	case 2: return m.lower_bound(RANDOM(range));
+	}
+	return m.end();
+}
+
+// lookups, const and not
+template <class Map>
+static void check_find(Map &m, const Model &model, int key)
+{
+	const Map &cm = m;
+	Model::const_iterator mt = model.find(key);
+	assert(check_at(m, m.find(key), model, mt));
+	assert(check_at(m, cm.find(key), model, mt));
+	assert(m.count(key) == model.count(key));
+	assert(m.contains(key) == (mt != model.end()));
+	assert(check_at(m, m.lower_bound(key), model, model.lower_bound(key)));
+	assert(check_at(m, cm.upper_bound(key), model, model.upper_bound(key)));
+	assert(check_at(m, m.equal_range(key).first, model,
+				model.equal_range(key).first));
+	assert(check_at(m, cm.equal_range(key).second, model,
+				model.equal_range(key).second));
+	if (mt != model.end()) {
+		assert(m.at(key) == mt->second && cm.at(key) == mt->second);
+	}
+	else {
+		bool thrown = false;
+		try { m.at(key); }
+		catch (const std::out_of_range &) { thrown = true; }
+		assert(thrown);
+	}
+}
+
+// node handles taken out and put back, often under another key
+template <class Map>
+static void check_extract(Map &m, Model &model, int key, int range,
+		const std::string &value)
+{
+	typename Map::node_type nh = (RANDOM(2))? m.extract(key) :
+		(m.find(key) == m.end())? typename Map::node_type() :
+		m.extract(m.find(key));
+	Model::iterator mt = model.find(key);
+	assert(nh.empty() == (mt == model.end()) && !nh == nh.empty());
+	if (nh.empty()) return;
+	assert(nh.key() == key && nh.mapped() == mt->second);
+	model.erase(mt);
+	key = (RANDOM(2))? key : RANDOM(range);
+	nh.key() = key;
+	nh.mapped() = value;
+	bool inserted = (model.count(key) == 0);
+	if (inserted) model[key] = value;
+	if (RANDOM(2)) {
+		typename Map::insert_return_type r = m.insert(std::move(nh));
+		assert(r.inserted == inserted && r.node.empty() == inserted);
+		assert(r.position->first == key && nh.empty());
+		assert(r.position->second == model[key]);
+		assert(inserted || r.node.key() == key);
+	}
+	else {
+		typename Map::iterator it = m.insert(check_hint(m, key, range),
+				std::move(nh));
+		assert(it->first == key && it->second == model[key]);
+		assert(nh.empty() == inserted);
+	}
+}
+
+// random operations on m and a std::map, compared after each of them
+template <class Map>
+static void check_map(int range, int steps)
+{
+	typedef typename Map::iterator iterator;
+	typedef std::pair<iterator, bool> result;
+	typedef std::pair<Model::iterator, bool> model_result;
+	Checked<Map> m;
+	Model model;
+	int step;
+	for (step = 0; step < steps; step++) {
+		int key = RANDOM(range), hi;
+		std::string value = check_value(key, step);
+		typename Map::value_type v(key, value);
+		model_result mr;
+		Model::iterator mt;
+		size_t count, mcount;
+		result r;
+		iterator it;
+		switch (RANDOM(12)) {
+		case 0:
+			r = m.insert(v);
+			mr = model.insert(v);
+			assert(r.second == mr.second && *r.first == *mr.first);
+			break;
+		case 1:
+			r = m.emplace(key, value);
+			mr = model.insert(v);
+			assert(r.second == mr.second && *r.first == *mr.first);
+			break;
+		case 2:
+			it = m.emplace_hint(check_hint(m, key, range), key, value);
+			mr = model.insert(v);
+			assert(*it == *mr.first);
+			break;
+		case 3:
+			/* the value is only moved from when it is inserted */
+			r = m.try_emplace(key, std::move(value));
+			mr = model.insert(v);
+			assert(r.second == mr.second && *r.first == *mr.first);
+			assert(r.second || value == v.second);
+			break;
+		case 4:
+			it = m.try_emplace(check_hint(m, key, range), key, value);
+			mr = model.insert(v);
+			assert(*it == *mr.first);
+			break;
+		case 5:
+			r = m.insert_or_assign(key, value);
+			assert(r.second == (model.count(key) == 0));
+			model[key] = value;
+			assert(*r.first == *model.find(key));
+			break;
+		case 6:
+			m[key] = value;
+			model[key] = value;
+			break;
+		case 7:
+			count = m.erase(key);
+			mcount = model.erase(key);
+			assert(count == mcount);
+			break;
+		case 8:
+			it = m.find(key);
+			if (it == m.end()) break;
+			it = m.erase(it);
+			mt = model.erase(model.find(key));
+			assert(check_at(m, it, model, mt));
+			break;
+		case 9:
+			hi = key + RANDOM(8);
+			it = m.erase(m.lower_bound(key), m.lower_bound(hi));
+			mt = model.erase(model.lower_bound(key), model.lower_bound(hi));
+			assert(check_at(m, it, model, mt));
+			break;
+		case 10:
+			check_find(m, model, key);
+			break;
+		case 11:
+			check_extract(m, model, key, range, value);
+			break;
+		}
+		if (range < 100 || (step & 63) == 0) {
+			check_same(m, model);
+		}
+	}
+	check_same(m, model);
+	m.clear();
+	model.clear();
+	check_same(m, model);
+	printf("map in %d keys, %d steps: ok\n", range, steps);
+}
+
+// between maps of one pool a node handle moves the node itself, into
+// another pool the value is moved into a new node
+static void check_handles(int count)
+{
+	Checked<FastMap> a, c;
+	Model ma, mb, mc;
+	FastMap::node_type nh, other;
+	FastMap::insert_return_type r;
+	FastMap::iterator it;
+	const std::string *p;
+	int i;
+	for (i = 0; i < count; i++) {
+		a.emplace(i, check_value(i, 0));
+		ma[i] = check_value(i, 0);
+	}
+	c.emplace(-1, check_value(-1, 0));
+	mc[-1] = check_value(-1, 0);
+	Checked<FastMap> b(a.get_allocator());
+	assert(b.get_allocator() == a.get_allocator());
+	assert(c.get_allocator() != a.get_allocator());
+	for (i = 0; i < count; i++) {
+		if (i % 3 == 2) continue;
+		nh = a.extract(i);
+		assert(nh.get_allocator() == a.get_allocator());
+		p = &nh.mapped();
+		r = ((i % 3 == 0)? b : c).insert(std::move(nh));
+		assert(r.inserted && r.node.empty() && nh.empty());
+		assert(r.position->first == i && r.position->second == ma[i]);
+		assert((&r.position->second == p) == (i % 3 == 0));
+		((i % 3 == 0)? mb : mc)[i] = ma[i];
+		ma.erase(i);
+	}
+	check_same(a, ma);
+	check_same(b, mb);
+	check_same(c, mc);
+	/* a duplicate leaves the node in the handle */
+	if (count > 2) {
+		b.emplace(2, check_value(2, 1));
+		mb[2] = check_value(2, 1);
+		nh = a.extract(2);
+		p = &nh.mapped();
+		r = b.insert(std::move(nh));
+		assert(!r.inserted && nh.empty() && &r.node.mapped() == p);
+		assert(r.position->second == mb[2] && r.node.mapped() == ma[2]);
+		it = a.insert(a.end(), std::move(r.node));
+		assert(it->second == ma[2] && r.node.empty());
+	}
+	/* handles outlive the map they came from */
+	{
+		Checked<FastMap> t;
+		t.emplace(count, check_value(count, 2));
+		t.emplace(count + 1, check_value(count + 1, 2));
+		nh = t.extract(count);
+		other = t.extract(count + 1);
+	}
+	nh.swap(other);
+	assert(nh.key() == count + 1 && other.key() == count);
+	r = c.insert(std::move(nh));
+	assert(r.inserted && r.position->second == check_value(count + 1, 2));
+	mc[count + 1] = check_value(count + 1, 2);
+	/* empty handles */
+	nh = a.extract(-1);
+	assert(nh.empty());
+	r = a.insert(std::move(nh));
+	assert(!r.inserted && r.position == a.end() && r.node.empty());
+	it = a.insert(a.begin(), std::move(nh));
+	assert(it == a.end());
+	check_same(a, ma);
+	check_same(b, mb);
+	check_same(c, mc);
+	/* std::allocator is always equal */
+	{
+		Checked<HeapMap> x, y;
+		x.emplace(1, check_value(1, 3));
+		HeapMap::node_type h = x.extract(1);
+		p = &h.mapped();
+		HeapMap::insert_return_type hr = y.insert(std::move(h));
+		assert(hr.inserted && &hr.position->second == p);
+		assert(x.empty() && y.size() == 1 && x.validate() == 0);
+	}
+	printf("node handles of %d keys: ok\n", count);
+}
+
+// copies, moves and swaps, each one keeps its own nodes
+template <class Map>
+static void check_copy(int count)
+{
+	Checked<Map> a, c;
+	Model ma, mc;
+	int i;
+	for (i = 0; i < count; i++) {
+		int key = RANDOM(count * 2);
+		a[key] = ma[key] = check_value(key, i);
+	}
+	for (i = 0; i < 10; i++) {
+		c[i * 7] = mc[i * 7] = check_value(i * 7, i);
+	}
+	{
+		Checked<Map> b(a);
+		check_same(b, ma);
+		assert(b == a && !(b != a) && !(b < a));
+		if (count > 0) {
+			b.erase(b.begin());
+			Model mb(std::next(ma.begin()), ma.end());
+			assert(b != a && (a < b) == (ma < mb));
+		}
+		b = c;
+		check_same(b, mc);
+		check_same(c, mc);
+		b[-1] = "b only";
+		Checked<Map> d(std::move(b));
+		assert(b.empty() && b.begin() == b.end() && b.validate() == 0);
+		b.emplace(1, "b again");
+		assert(b.size() == 1 && b.validate() == 0);
+		assert(d.size() == mc.size() + 1 && d.begin()->second == "b only");
+		d.erase(-1);
+		check_same(d, mc);
+		b = std::move(d);
+		check_same(b, mc);
+		assert(d.empty() && d.validate() == 0);
+	}
+	check_same(a, ma);
+	a.swap(c);
+	ma.swap(mc);
+	check_same(a, ma);
+	check_same(c, mc);
+	avl::swap(a, c);
+	check_same(a, mc);
+	check_same(c, ma);
+	assert((a < c) == (mc < ma) && (c < a) == (ma < mc));
+	{
+		Map x = { {3, "three"}, {1, "one"}, {2, "two"}, {1, "uno"} };
+		Model y = { {3, "three"}, {1, "one"}, {2, "two"}, {1, "uno"} };
+		assert(x.size() == 3 && std::equal(x.begin(), x.end(), y.begin()));
+		x = { {5, "five"} };
+		assert(x.size() == 1 && x.begin()->second == "five");
+	}
+	printf("copy, move and swap %d keys: ok\n", count);
+}
+
+// avl::set the same way, its iterators are all const
+static void check_set(int range, int steps)
+{
+	typedef avl::set<int> Set;
+	Checked<Set> s;
+	std::set<int> model;
+	int step;
+	for (step = 0; step < steps; step++) {
+		int key = RANDOM(range), hi = key + RANDOM(8);
+		std::pair<Set::iterator, bool> r;
+		Set::iterator it;
+		Set::node_type nh;
+		Set::insert_return_type ir;
+		size_t count, mcount;
+		bool inserted;
+		switch (RANDOM(7)) {
+		case 0:
+			r = s.insert(key);
+			inserted = model.insert(key).second;
+			assert(r.second == inserted && *r.first == key);
+			break;
+		case 1:
+			it = s.emplace_hint(check_hint(s, key, range), key);
+			model.insert(key);
+			assert(*it == key);
+			break;
+		case 2:
+			count = s.erase(key);
+			mcount = model.erase(key);
+			assert(count == mcount);
+			break;
+		case 3:
+			it = s.erase(s.lower_bound(key), s.upper_bound(hi));
+			model.erase(model.lower_bound(key), model.upper_bound(hi));
+			assert(check_at(s, it, model, model.upper_bound(hi)));
+			break;
+		case 4:
+			assert(check_at(s, s.find(key), model, model.find(key)));
+			assert(check_at(s, s.lower_bound(key), model,
+						model.lower_bound(key)));
+			assert(check_at(s, s.upper_bound(key), model,
+						model.upper_bound(key)));
+			assert(s.count(key) == model.count(key));
+			break;
+		case 5:
+			nh = s.extract(key);
+			mcount = model.erase(key);
+			assert(nh.empty() == (mcount == 0));
+			if (nh.empty()) break;
+			nh.value() = hi;
+			inserted = model.insert(hi).second;
+			ir = s.insert(std::move(nh));
+			assert(ir.inserted == inserted && *ir.position == hi);
+			break;
+		case 6:
+			if ((step & 255) == 0) {
+				Checked<Set> t(s);
+				check_same(t, model);
+				t.swap(s);
+			}
+			break;
+		}
+		if (range < 100 || (step & 63) == 0) {
+			check_same(s, model);
+		}
+	}
+	check_same(s, model);
+	printf("set in %d keys, %d steps: ok\n", range, steps);
+}
+
 void test1()
 {
 	int a[100];
@@ -168,9 +671,15 @@ void test2()
 	benchmark("linux rbtree", 1, COUNT);
 	benchmark("avlmini", 0, COUNT);
 	benchmark("std::map", 2, COUNT);
+	benchmark("avl_kary", 3, COUNT);
+	benchmark("avl::map", 4, COUNT);
+	benchmark("avl::map + std::allocator", 5, COUNT);
 	benchmark("linux rbtree", 1, COUNT2);
 	benchmark("avlmini", 0, COUNT2);
 	benchmark("std::map", 2, COUNT2);
+	benchmark("avl_kary", 3, COUNT2);
+	benchmark("avl::map", 4, COUNT2);
+	benchmark("avl::map + std::allocator", 5, COUNT2);
 }
 
 void test3()
@@ -178,8 +687,28 @@ void test3()
 	benchmark("std::map", 2, 1000);
 }
 
-int main(void)
+void test_check()
+{
+	check_map<FastMap>(1, 200);
+	check_map<FastMap>(8, 2000);
+	check_map<FastMap>(1000, 100000);
+	check_map<HeapMap>(1000, 100000);
+	check_handles(1);
+	check_handles(1000);
+	check_copy<FastMap>(0);
+	check_copy<FastMap>(1000);
+	check_copy<HeapMap>(1000);
+	check_set(8, 2000);
+	check_set(1000, 100000);
+}
+
+int main(int argc, char *argv[])
 {
+	const char *name = (argc > 1)? argv[1] : "";
+	if (strcmp(name, "check") == 0) {
+		test_check();
+		return 0;
+	}
 #ifdef _WIN32
 	SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_TIME_CRITICAL);
 #endif
@@ -0,0 +1,419 @@
+#include "avlmini.c"
+#include "avlpersist.c"
+#include "test/linux_rbtree.c"
+#include "test_avl.h"
+#include "test_thread.h"
+
+
+
+//---------------------------------------------------------------------
+// key value stored in avl_ptree
+//---------------------------------------------------------------------
+struct MyData
+{
+	int key;
+	int val;
+};
+
+static int data_compare(const void *d1, const void *d2)
+{
+	int x = ((const struct MyData*)d1)->key;
+	int y = ((const struct MyData*)d2)->key;
+	return (x < y)? -1 : ((x > y)? 1 : 0);
+}
+
+
+//---------------------------------------------------------------------
+// write amplification: nodes allocated per update
+//---------------------------------------------------------------------
+static void benchmark_write(int count)
+{
+	struct avl_tree tree;
+	struct avl_ptree ptree;
+	struct MyNode *nodes;
+	unsigned int ts;
+	int *keys, i;
+
+	keys = (int*)malloc(sizeof(int) * count);
+	nodes = (struct MyNode*)malloc(sizeof(struct MyNode) * count);
+	random_keys(keys, count, 0x11223344);
+
+	printf("insert %d keys:\n", count);
+
+	avl_tree_init(&tree, avl_node_compare, sizeof(struct MyNode), 0);
+	sleepms(200);
+	ts = gettime();
+	for (i = 0; i < count; i++) {
+		nodes[i].key = keys[i];
+		avl_tree_add(&tree, &nodes[i]);
+	}
+	ts = gettime() - ts;
+	printf("avl_tree  time: %dms, 1 node per insert\n", (int)ts);
+
+	avl_ptree_init(&ptree, data_compare, sizeof(struct MyData));
+	sleepms(200);
+	ts = gettime();
+	for (i = 0; i < count; i++) {
+		struct MyData data;
+		data.key = keys[i];
+		data.val = i;
+		avl_ptree_set(&ptree, &data);
+	}
+	ts = gettime() - ts;
+	printf("avl_ptree time: %dms, %.1f nodes (%d bytes) per insert\n",
+			(int)ts, (double)ptree.copies / count,
+			(int)(ptree.copies * (sizeof(struct avl_pnode) +
+			sizeof(struct MyData)) / count));
+
+	ptree.copies = 0;
+	ts = gettime();
+	for (i = 0; i < count; i++) {
+		struct MyData data;
+		data.key = keys[i];
+		avl_ptree_remove(&ptree, &data);
+	}
+	ts = gettime() - ts;
+	printf("avl_ptree remove time: %dms, %.1f nodes per remove\n",
+			(int)ts, (double)ptree.copies / count);
+
+	avl_ptree_destroy(&ptree);
+	free(nodes);
+	free(keys);
+	printf("\n");
+}
+
+
+//---------------------------------------------------------------------
+// one writer and many readers: mutex + avl_tree vs avl_ptree snapshot
+//---------------------------------------------------------------------
+#define KEY_RANGE     (1 << 20)
+#define READ_BATCH    16
+
+struct Shared
+{
+	int mode;                   /* 0: mutex + avl_tree, 1: avl_ptree */
+	int writers;                /* stress: workers 0 .. writers - 1 */
+	volatile int stop;
+	volatile long writes;       /* stress: updates made so far */
+	volatile long done;         /* stress: writers finished */
+	avl_mutex_t lock;           /* the tree, or stress writers */
+	struct avl_tree tree;
+	struct MyNode *nodes;
+	struct avl_ptree ptree;
+	int *vals;                  /* stress: value of key, 0 for absent */
+};
+
+static void *reader_main(void *arg)
+{
+	struct Worker *w = (struct Worker*)arg;
+	struct Shared *s = (struct Shared*)w->shared;
+	unsigned long found = 0;
+	while (!s->stop) {
+		int i;
+		if (s->mode == 0) {
+			for (i = 0; i < READ_BATCH; i++) {
+				struct MyNode key;
+				key.key = (int)(worker_rand(&w->seed) & (KEY_RANGE - 1));
+				avl_mutex_lock(&s->lock);
+				if (avl_tree_find(&s->tree, &key)) found++;
+				avl_mutex_unlock(&s->lock);
+			}
+		}
+		else {
+			struct avl_psnap snap;
+			avl_ptree_snapshot(&s->ptree, &snap);
+			for (i = 0; i < READ_BATCH; i++) {
+				struct MyData key;
+				key.key = (int)(worker_rand(&w->seed) & (KEY_RANGE - 1));
+				if (avl_psnap_find(&snap, &key)) found++;
+			}
+			avl_psnap_release(&snap);
+		}
+		w->ops += READ_BATCH;
+	}
+	return (void*)found;
+}
+
+static void *writer_main(void *arg)
+{
+	struct Worker *w = (struct Worker*)arg;
+	struct Shared *s = (struct Shared*)w->shared;
+	while (!s->stop) {
+		int key = (int)(worker_rand(&w->seed) & (KEY_RANGE - 1));
+		if (s->mode == 0) {
+			struct MyNode *node = &s->nodes[key];
+			avl_mutex_lock(&s->lock);
+			if (avl_node_empty(&node->node)) avl_tree_add(&s->tree, node);
+			else avl_tree_remove(&s->tree, node);
+			avl_mutex_unlock(&s->lock);
+		}
+		else {
+			struct MyData data;
+			data.key = key;
+			data.val = key;
+			if (avl_ptree_find(&s->ptree, &data) == NULL)
+				avl_ptree_set(&s->ptree, &data);
+			else
+				avl_ptree_remove(&s->ptree, &data);
+		}
+		w->ops++;
+	}
+	return NULL;
+}
+
+static void benchmark_threads(int mode, int readers, int millisec)
+{
+	struct Shared shared;
+	struct Worker workers[65];
+	unsigned long reads = 0;
+	int i;
+
+	shared.mode = mode;
+	shared.writers = 1;
+	shared.stop = 0;
+	shared.vals = NULL;
+	avl_mutex_init(&shared.lock);
+	avl_tree_init(&shared.tree, avl_node_compare, sizeof(struct MyNode), 0);
+	avl_ptree_init(&shared.ptree, data_compare, sizeof(struct MyData));
+	shared.nodes = (struct MyNode*)malloc(sizeof(struct MyNode) * KEY_RANGE);
+	for (i = 0; i < KEY_RANGE; i++) {
+		shared.nodes[i].key = i;
+		avl_node_init(&shared.nodes[i].node);
+	}
+	/* half full */
+	for (i = 0; i < KEY_RANGE; i += 2) {
+		if (mode == 0) {
+			avl_tree_add(&shared.tree, &shared.nodes[i]);
+		}	else {
+			struct MyData data;
+			data.key = data.val = i;
+			avl_ptree_set(&shared.ptree, &data);
+		}
+	}
+
+	workers_start(workers, readers + 1, &shared, writer_main, reader_main);
+	sleepms(millisec);
+	shared.stop = 1;
+	reads = workers_join(workers, readers + 1, 1);
+
+	printf("%s, %d readers: %.2fM reads/s, %.2fM writes/s, "
+			"%.0fns per read\n", (mode == 0)? "mutex + avl_tree" : "avl_ptree",
+			readers, reads / (millisec * 1000.0),
+			workers[0].ops / (millisec * 1000.0),
+			(reads > 0)? readers * millisec * 1e6 / reads : 0.0);
+
+	avl_ptree_destroy(&shared.ptree);
+	avl_mutex_destroy(&shared.lock);
+	free(shared.nodes);
+}
+
+//---------------------------------------------------------------------
+// stress: writers own the keys k with k % writers == id and take turns,
+// readers check that a snapshot keeps its values after later writes
+//---------------------------------------------------------------------
+#define STRESS_RANGE  (1 << 14)
+#define STRESS_OPS    100000
+#define STRESS_PROBES 16
+
+static void stress_writer(struct Worker *w)
+{
+	struct Shared *s = (struct Shared*)w->shared;
+	int slice = STRESS_RANGE / s->writers;
+	for (; w->ops < STRESS_OPS; w->ops++) {
+		struct MyData data;
+		const struct MyData *found;
+		int op = (int)(worker_rand(&w->seed) % 3);
+		int *val;
+		data.key = (int)(worker_rand(&w->seed) % slice) * s->writers + w->id;
+		data.val = (int)(w->ops + 1);
+		val = &s->vals[data.key];
+		avl_mutex_lock(&s->lock);
+		if (op == 0) {
+			found = (const struct MyData*)avl_ptree_find(&s->ptree, &data);
+			assert((found)? found->val == *val : *val == 0);
+		}
+		else if (op == 1) {
+			assert(avl_ptree_set(&s->ptree, &data) == ((*val)? 1 : 0));
+			*val = data.val;
+		}
+		else {
+			assert(avl_ptree_remove(&s->ptree, &data) == ((*val)? 0 : 1));
+			*val = 0;
+		}
+		avl_mutex_unlock(&s->lock);
+		avl_atomic_inc(&s->writes);
+	}
+	avl_atomic_inc(&s->done);
+}
+
+struct Collect
+{
+	int last;
+	size_t count;
+	const int *vals;            /* NULL: only check the order */
+};
+
+static void stress_visit(const void *data, void *user)
+{
+	const struct MyData *d = (const struct MyData*)data;
+	struct Collect *c = (struct Collect*)user;
+	assert(d->key > c->last);
+	if (c->vals) assert(c->vals[d->key] == d->val);
+	c->last = d->key;
+	c->count++;
+}
+
+static void stress_reader(struct Worker *w)
+{
+	struct Shared *s = (struct Shared*)w->shared;
+	while (avl_atomic_load(&s->done) < s->writers) {
+		struct avl_psnap snap;
+		struct MyData keys[STRESS_PROBES];
+		struct Collect collect;
+		int vals[STRESS_PROBES], i;
+		long writes;
+		avl_ptree_snapshot(&s->ptree, &snap);
+		writes = avl_atomic_load(&s->writes);
+		for (i = 0; i < STRESS_PROBES; i++) {
+			const struct MyData *found;
+			keys[i].key = (int)(worker_rand(&w->seed) % STRESS_RANGE);
+			found = (const struct MyData*)avl_psnap_find(&snap, &keys[i]);
+			vals[i] = (found)? found->val : 0;
+		}
+		/* let the writers replace most of what was probed */
+		while (avl_atomic_load(&s->writes) < writes + 64 &&
+				avl_atomic_load(&s->done) < s->writers) {
+			avl_thread_yield();
+		}
+		for (i = 0; i < STRESS_PROBES; i++) {
+			const struct MyData *found;
+			found = (const struct MyData*)avl_psnap_find(&snap, &keys[i]);
+			assert(((found)? found->val : 0) == vals[i]);
+		}
+		collect.last = -1;
+		collect.count = 0;
+		collect.vals = NULL;
+		avl_psnap_walk(&snap, stress_visit, &collect);
+		assert(collect.count == snap.count);
+		avl_psnap_release(&snap);
+		w->ops++;
+	}
+}
+
+static void *stress_main(void *arg)
+{
+	struct Worker *w = (struct Worker*)arg;
+	struct Shared *s = (struct Shared*)w->shared;
+	if (w->id < s->writers) stress_writer(w);
+	else stress_reader(w);
+	return NULL;
+}
+
+/* heights and balance of a version, returns its height */
+static int stress_pnode(const struct avl_pnode *node)
+{
+	int h0, h1;
+	if (node == NULL) return 0;
+	assert(node->refcnt >= 1);
+	h0 = stress_pnode(node->left);
+	h1 = stress_pnode(node->right);
+	assert(node->height == ((h0 > h1)? h0 : h1) + 1);
+	assert(h0 - h1 <= 1 && h1 - h0 <= 1);
+	return node->height;
+}
+
+static void stress(int writers, int readers)
+{
+	struct Shared shared;
+	struct Worker *workers;
+	struct avl_psnap snap;
+	struct Collect collect;
+	unsigned long snaps;
+	size_t count = 0;
+	int i;
+
+	workers = (struct Worker*)malloc(sizeof(struct Worker) *
+			(writers + readers));
+	shared.mode = 1;
+	shared.writers = writers;
+	shared.stop = 0;
+	shared.writes = 0;
+	shared.done = 0;
+	avl_mutex_init(&shared.lock);
+	avl_ptree_init(&shared.ptree, data_compare, sizeof(struct MyData));
+	shared.nodes = NULL;
+	shared.vals = (int*)malloc(sizeof(int) * STRESS_RANGE);
+	for (i = 0; i < STRESS_RANGE; i++) shared.vals[i] = 0;
+
+	workers_start(workers, writers + readers, &shared, NULL, stress_main);
+	snaps = workers_join(workers, writers + readers, writers);
+
+	avl_ptree_snapshot(&shared.ptree, &snap);
+	stress_pnode(snap.root);
+	collect.last = -1;
+	collect.count = 0;
+	collect.vals = shared.vals;
+	avl_psnap_walk(&snap, stress_visit, &collect);
+	for (i = 0; i < STRESS_RANGE; i++) count += (shared.vals[i] != 0);
+	assert(collect.count == count && snap.count == count);
+	avl_psnap_release(&snap);
+
+	printf("avl_ptree, %d writers, %d readers: %d keys, %lu snapshots, ok\n",
+			writers, readers, (int)count, snaps);
+
+	avl_ptree_destroy(&shared.ptree);
+	avl_mutex_destroy(&shared.lock);
+	free(shared.vals);
+	free(workers);
+}
+
+void test1()
+{
+	benchmark_write(1000000);
+}
+
+void test2()
+{
+	int readers, mode;
+	for (readers = 1; readers <= 8; readers *= 2) {
+		for (mode = 0; mode < 2; mode++) {
+			benchmark_threads(mode, readers, 2000);
+		}
+	}
+	printf("\n");
+}
+
+void test_stress()
+{
+	stress(1, 1);
+	stress(1, 4);
+	stress(2, 2);
+	stress(4, 4);
+}
+
+int main(int argc, char *argv[])
+{
+	const char *name = (argc > 1)? argv[1] : "";
+	if (strcmp(name, "stress") == 0) {
+		test_stress();
+		return 0;
+	}
+	test1();
+	test2();
+	return 0;
+}
+
+
+/*
+insert 1000000 keys:
+avl_tree  time: 859ms, 1 node per insert
+avl_ptree time: 1910ms, 20.5 nodes (656 bytes) per insert
+avl_ptree remove time: 1851ms, 17.7 nodes per remove
+
+(single cpu, threads are time sliced)
+mutex + avl_tree, 1 readers: 0.35M reads/s, 0.54M writes/s, 2898ns per read
+avl_ptree, 1 readers: 0.19M reads/s, 0.11M writes/s, 5187ns per read
+mutex + avl_tree, 8 readers: 0.62M reads/s, 0.13M writes/s, 12999ns per read
+avl_ptree, 8 readers: 0.65M reads/s, 0.03M writes/s, 12323ns per read
+*/
+
@@ -0,0 +1,321 @@
+#include "avlmini.c"
+#include "avlrcu.c"
+#include "test/linux_rbtree.c"
+#include "test_avl.h"
+#include "test_thread.h"
+
+
+
+//---------------------------------------------------------------------
+// one writer and many readers: rwlock + avl_tree vs avl_rcu_tree
+//---------------------------------------------------------------------
+#define KEY_RANGE     (1 << 20)
+#define READ_BATCH    32
+#define READ_RATIO    100
+
+struct Shared
+{
+	int mode;                   /* 0: rwlock + avl_tree, 1: avl_rcu_tree */
+	int writers;                /* stress: workers 0 .. writers - 1 */
+	volatile int stop;
+	volatile long reads;        /* total reads, paces the writer */
+	volatile long removed;      /* stress: nodes removed */
+	volatile long done;         /* stress: writers finished */
+	avl_rwlock_t lock;
+	struct avl_tree tree;
+	struct avl_rcu_tree rcu;
+	struct MyNode *nodes;
+	struct MyNode **current;    /* stress: node of key in the tree */
+	int *used;                  /* stress: nodes taken by each writer */
+};
+
+static void *reader_main(void *arg)
+{
+	struct Worker *w = (struct Worker*)arg;
+	struct Shared *s = (struct Shared*)w->shared;
+	unsigned long found = 0;
+	int reader = (s->mode == 1)? avl_rcu_reader(&s->rcu) : 0;
+	while (!s->stop) {
+		int i;
+		if (s->mode == 0) {
+			for (i = 0; i < READ_BATCH; i++) {
+				struct MyNode key;
+				key.key = (int)(worker_rand(&w->seed) & (KEY_RANGE - 1));
+				avl_rwlock_rdlock(&s->lock);
+				if (avl_tree_find(&s->tree, &key)) found++;
+				avl_rwlock_rdunlock(&s->lock);
+			}
+		}
+		else {
+			avl_rcu_read_lock(&s->rcu, reader);
+			for (i = 0; i < READ_BATCH; i++) {
+				struct MyNode key;
+				key.key = (int)(worker_rand(&w->seed) & (KEY_RANGE - 1));
+				if (avl_rcu_find(&s->rcu, &key)) found++;
+			}
+			avl_rcu_read_unlock(&s->rcu, reader);
+		}
+		w->ops += READ_BATCH;
+		avl_atomic_inc(&s->reads);
+	}
+	return (void*)found;
+}
+
+static void *writer_main(void *arg)
+{
+	struct Worker *w = (struct Worker*)arg;
+	struct Shared *s = (struct Shared*)w->shared;
+	while (!s->stop) {
+		struct MyNode *node;
+		if ((long)(w->ops * READ_RATIO / READ_BATCH) >
+				avl_atomic_load(&s->reads)) {
+			avl_thread_yield();
+			continue;
+		}
+		node = &s->nodes[worker_rand(&w->seed) & (KEY_RANGE - 1)];
+		if (s->mode == 0) {
+			avl_rwlock_wrlock(&s->lock);
+			if (avl_node_empty(&node->node)) avl_tree_add(&s->tree, node);
+			else avl_tree_remove(&s->tree, node);
+			avl_rwlock_wrunlock(&s->lock);
+		}
+		else {
+			if (avl_node_empty(&node->node)) avl_rcu_add(&s->rcu, node);
+			else avl_rcu_remove(&s->rcu, node);
+		}
+		w->ops++;
+	}
+	return NULL;
+}
+
+static void benchmark(int mode, int readers, int millisec)
+{
+	struct Shared shared;
+	struct Worker *workers;
+	unsigned long reads = 0;
+	int i;
+
+	workers = (struct Worker*)malloc(sizeof(struct Worker) * (readers + 1));
+	shared.mode = mode;
+	shared.writers = 1;
+	shared.stop = 0;
+	shared.reads = 0;
+	avl_rwlock_init(&shared.lock);
+	avl_tree_init(&shared.tree, avl_node_compare, sizeof(struct MyNode), 0);
+	/* erased nodes stay in the array, nothing to reclaim */
+	avl_rcu_init(&shared.rcu, avl_node_compare, sizeof(struct MyNode), 0,
+			readers, NULL);
+	shared.nodes = (struct MyNode*)malloc(sizeof(struct MyNode) * KEY_RANGE);
+	for (i = 0; i < KEY_RANGE; i++) {
+		shared.nodes[i].key = i;
+		avl_node_init(&shared.nodes[i].node);
+	}
+	for (i = 0; i < KEY_RANGE; i += 2) {
+		if (mode == 0) avl_tree_add(&shared.tree, &shared.nodes[i]);
+		else avl_rcu_add(&shared.rcu, &shared.nodes[i]);
+	}
+
+	workers_start(workers, readers + 1, &shared, writer_main, reader_main);
+	sleepms(millisec);
+	shared.stop = 1;
+	reads = workers_join(workers, readers + 1, 1);
+
+	printf("%s, %d readers: %.2fM reads/s, %.3fM writes/s\n",
+			(mode == 0)? "rwlock + avl_tree" : "avl_rcu_tree",
+			readers, reads / (millisec * 1000.0),
+			workers[0].ops / (millisec * 1000.0));
+
+	avl_rcu_destroy(&shared.rcu);
+	avl_rwlock_destroy(&shared.lock);
+	free(shared.nodes);
+	free(workers);
+}
+
+//---------------------------------------------------------------------
+// stress: writers own the keys k with k % writers == id, readers check
+// that nothing they found is reclaimed before their read unlock
+//---------------------------------------------------------------------
+#define STRESS_RANGE  (1 << 14)
+#define STRESS_OPS    100000
+
+static volatile long stress_reclaimed = 0;
+
+/* nodes are never reused, a reclaimed one is only marked */
+static void stress_reclaim(void *data)
+{
+	((struct MyNode*)data)->val = -1;
+	avl_atomic_inc(&stress_reclaimed);
+}
+
+static void stress_writer(struct Worker *w)
+{
+	struct Shared *s = (struct Shared*)w->shared;
+	struct MyNode *pool = s->nodes + (size_t)w->id * STRESS_OPS;
+	int reader = avl_rcu_reader(&s->rcu);
+	int slice = STRESS_RANGE / s->writers, used = 0;
+	assert(reader >= 0);
+	for (; w->ops < STRESS_OPS; w->ops++) {
+		int key = (int)(worker_rand(&w->seed) % slice) * s->writers + w->id;
+		int op = (int)(worker_rand(&w->seed) % 3);
+		struct MyNode **cur = &s->current[key];
+		if (op == 0 || (op == 2 && *cur == NULL)) {
+			struct MyNode k;
+			k.key = key;
+			avl_rcu_read_lock(&s->rcu, reader);
+			assert(avl_rcu_find(&s->rcu, &k) == (void*)*cur);
+			avl_rcu_read_unlock(&s->rcu, reader);
+		}
+		else if (op == 1) {
+			struct MyNode *node = &pool[used];
+			node->key = node->val = key;
+			avl_node_init(&node->node);
+			assert(avl_rcu_add(&s->rcu, node) == (void*)*cur);
+			if (*cur == NULL) {
+				*cur = node;
+				used++;
+			}
+		}
+		else {
+			avl_rcu_remove(&s->rcu, *cur);
+			*cur = NULL;
+			avl_atomic_inc(&s->removed);
+		}
+	}
+	s->used[w->id] = used;
+	avl_atomic_inc(&s->done);
+}
+
+static void stress_reader(struct Worker *w)
+{
+	struct Shared *s = (struct Shared*)w->shared;
+	int reader = avl_rcu_reader(&s->rcu);
+	assert(reader >= 0);
+	while (avl_atomic_load(&s->done) < s->writers) {
+		struct MyNode *found[READ_BATCH];
+		int i;
+		avl_rcu_read_lock(&s->rcu, reader);
+		for (i = 0; i < READ_BATCH; i++) {
+			struct MyNode key;
+			key.key = (int)(worker_rand(&w->seed) % STRESS_RANGE);
+			found[i] = (struct MyNode*)avl_rcu_find(&s->rcu, &key);
+			assert(found[i] == NULL || (found[i]->key == key.key &&
+						found[i]->val == key.key));
+		}
+		/* removed meanwhile maybe, but not reclaimed */
+		for (i = 0; i < READ_BATCH; i++) {
+			assert(found[i] == NULL || found[i]->val == found[i]->key);
+		}
+		avl_rcu_read_unlock(&s->rcu, reader);
+		w->ops++;
+	}
+}
+
+static void *stress_main(void *arg)
+{
+	struct Worker *w = (struct Worker*)arg;
+	struct Shared *s = (struct Shared*)w->shared;
+	if (w->id < s->writers) stress_writer(w);
+	else stress_reader(w);
+	return NULL;
+}
+
+static void stress(int writers, int readers)
+{
+	struct Shared shared;
+	struct Worker *workers;
+	struct MyNode *node;
+	unsigned long reads;
+	int i, j, count = 0;
+
+	workers = (struct Worker*)malloc(sizeof(struct Worker) *
+			(writers + readers));
+	shared.mode = 1;
+	shared.writers = writers;
+	shared.stop = 0;
+	shared.reads = 0;
+	shared.removed = 0;
+	shared.done = 0;
+	stress_reclaimed = 0;
+	avl_rwlock_init(&shared.lock);
+	avl_rcu_init(&shared.rcu, avl_node_compare, sizeof(struct MyNode), 0,
+			writers + readers, stress_reclaim);
+	shared.nodes = (struct MyNode*)malloc(sizeof(struct MyNode) *
+			STRESS_OPS * writers);
+	shared.current = (struct MyNode**)malloc(sizeof(void*) * STRESS_RANGE);
+	shared.used = (int*)malloc(sizeof(int) * writers);
+	for (i = 0; i < STRESS_RANGE; i++) shared.current[i] = NULL;
+
+	workers_start(workers, writers + readers, &shared, NULL, stress_main);
+	reads = workers_join(workers, writers + readers, writers);
+
+	avl_rcu_synchronize(&shared.rcu);
+	assert(stress_reclaimed == shared.removed);
+	for (i = 0; i < writers; i++) {
+		for (j = 0; j < shared.used[i]; j++) {
+			node = &shared.nodes[(size_t)i * STRESS_OPS + j];
+			assert(node->val == ((shared.current[node->key] == node)?
+						node->key : -1));
+		}
+	}
+	assert(avl_test_validate(&shared.rcu.tree.root) == 0);
+	node = (struct MyNode*)avl_tree_first(&shared.rcu.tree);
+	for (i = 0; i < STRESS_RANGE; i++) {
+		if (shared.current[i] == NULL) continue;
+		assert(node == shared.current[i]);
+		node = (struct MyNode*)avl_tree_next(&shared.rcu.tree, node);
+		count++;
+	}
+	assert(node == NULL && count == (int)shared.rcu.tree.count);
+
+	printf("avl_rcu_tree, %d writers, %d readers: %d keys, "
+			"%ld reclaimed, %lu read batches, ok\n", writers, readers,
+			count, shared.removed, reads);
+
+	avl_rcu_destroy(&shared.rcu);
+	avl_rwlock_destroy(&shared.lock);
+	free(shared.used);
+	free(shared.current);
+	free(shared.nodes);
+	free(workers);
+}
+
+void test1()
+{
+	int readers, mode;
+	for (readers = 1; readers <= 32; readers *= 2) {
+		for (mode = 0; mode < 2; mode++) {
+			benchmark(mode, readers, 2000);
+		}
+	}
+}
+
+void test_stress()
+{
+	stress(1, 1);
+	stress(1, 4);
+	stress(2, 2);
+	stress(4, 4);
+}
+
+int main(int argc, char *argv[])
+{
+	const char *name = (argc > 1)? argv[1] : "";
+	if (strcmp(name, "stress") == 0) {
+		test_stress();
+		return 0;
+	}
+	test1();
+	return 0;
+}
+
+
+/*
+(single cpu, threads are time sliced, reads can not scale here)
+rwlock + avl_tree, 1 readers: 0.63M reads/s, 0.006M writes/s
+avl_rcu_tree, 1 readers: 0.70M reads/s, 0.007M writes/s
+rwlock + avl_tree, 8 readers: 0.63M reads/s, 0.000M writes/s
+avl_rcu_tree, 8 readers: 0.59M reads/s, 0.006M writes/s
+rwlock + avl_tree, 32 readers: 0.70M reads/s, 0.000M writes/s
+avl_rcu_tree, 32 readers: 0.69M reads/s, 0.007M writes/s
+*/
+
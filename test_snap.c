@@ -0,0 +1,132 @@
+#include "avlmini.c"
+#include "avlsnap.c"
+#include "test/linux_rbtree.c"
+#include "test_avl.h"
+
+
+
+//---------------------------------------------------------------------
+// int keys
+//---------------------------------------------------------------------
+static int int_compare(const void *k1, const void *k2)
+{
+	int x = *(const int*)k1;
+	int y = *(const int*)k2;
+	return (x < y)? -1 : ((x > y)? 1 : 0);
+}
+
+static inline int int_compare_inline(const void *k1, const void *k2)
+{
+	int x = *(const int*)k1;
+	int y = *(const int*)k2;
+	return (x < y)? -1 : ((x > y)? 1 : 0);
+}
+
+
+//---------------------------------------------------------------------
+// benchmark: avl_node_find vs frozen snapshot
+//---------------------------------------------------------------------
+static void benchmark(int count)
+{
+	struct avl_tree tree;
+	struct avl_snap snap;
+	struct MyNode **nodes;
+	unsigned int ts, total;
+	int *keys, *queries, i, mode, missing;
+
+	keys = (int*)malloc(sizeof(int) * count);
+	queries = (int*)malloc(sizeof(int) * count);
+	nodes = (struct MyNode**)malloc(sizeof(void*) * count);
+	random_keys(keys, count, 0x11223344);
+	random_keys(queries, count, 0x55667788);
+	for (i = 0; i < count; i++) queries[i] = queries[i] * 2 - count / 2;
+
+	avl_tree_init(&tree, avl_node_compare, sizeof(struct MyNode), 0);
+	for (i = 0; i < count; i++) {
+		nodes[i] = avl_node_new(keys[i] * 2);
+		avl_tree_add(&tree, nodes[i]);
+	}
+
+	printf("search %d keys:\n", count);
+
+	ts = gettime();
+	avl_tree_freeze(&tree, &snap, AVL_OFFSET(struct MyNode, key),
+			sizeof(int), int_compare);
+	ts = gettime() - ts;
+	printf("freeze time: %dms\n", (int)ts);
+
+	for (mode = 0; mode < 3; mode++) {
+		sleepms(200);
+		total = 0;
+		missing = 0;
+		ts = gettime();
+		for (i = 0; i < count; i++) {
+			struct MyNode *res = NULL;
+			if (mode == 0) {
+				struct MyNode key;
+				struct avl_node *node;
+				key.key = queries[i];
+				avl_node_find(&tree.root, &key.node, avl_node_compare, node);
+				res = (struct MyNode*)node;
+			}
+			else if (mode == 1) {
+				res = (struct MyNode*)avl_snap_find(&snap, &queries[i]);
+			}
+			else {
+				size_t slot;
+				avl_snap_search(&snap, &queries[i], int_compare_inline, slot);
+				if (slot && *(int*)avl_snap_key(&snap, slot) == queries[i])
+					res = (struct MyNode*)avl_snap_item(&snap, slot);
+			}
+			if (res == NULL) missing++;
+			else total += queries[i];
+		}
+		ts = gettime() - ts;
+		printf("%s time: %dms missing=%d checksum=%u\n",
+				(mode == 0)? "avl_node_find" :
+				((mode == 1)? "avl_snap_find" : "avl_snap_search"),
+				(int)ts, missing, total);
+	}
+
+	assert(avl_snap_valid(&snap));
+	avl_tree_remove(&tree, nodes[0]);
+	assert(!avl_snap_valid(&snap));
+	free(nodes[0]);
+
+	avl_snap_destroy(&snap);
+	for (i = 1; i < count; i++) free(nodes[i]);
+	free(nodes);
+	free(keys);
+	free(queries);
+	printf("\n");
+}
+
+void test1()
+{
+	benchmark(1000000);
+	benchmark(10000000);
+}
+
+int main(void)
+{
+#ifdef _WIN32
+	SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_TIME_CRITICAL);
+#endif
+	test1();
+	return 0;
+}
+
+/*
+search 1000000 keys:
+freeze time: 175ms
+avl_node_find time: 355ms missing=250000 checksum=4153501520
+avl_snap_find time: 233ms missing=250000 checksum=4153501520
+avl_snap_search time: 165ms missing=250000 checksum=4153501520
+
+search 10000000 keys:
+freeze time: 2275ms
+avl_node_find time: 3595ms missing=2500000 checksum=3100791584
+avl_snap_find time: 2897ms missing=2500000 checksum=3100791584
+avl_snap_search time: 2146ms missing=2500000 checksum=3100791584
+*/
+
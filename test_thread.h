@@ -0,0 +1,66 @@
+/*********************************************************************
+ *
+ * test_thread.h - worker threads for the concurrent tests
+ *
+ * NOTE:
+ * test_conc.c, test_persist.c and test_rcu.c keep their own Shared
+ * state and start workers here: each one gets an id, a seed of its
+ * own and counts the operations it made.
+ *
+ *********************************************************************/
+#ifndef _TEST_THREAD_H__
+#define _TEST_THREAD_H__
+
+#include "avlsync.h"
+
+
+struct Worker
+{
+	void *shared;               /* Shared of the test */
+	avl_thread_t thread;
+	int id;                     /* 0 .. count - 1 */
+	unsigned int seed;
+	unsigned long ops;
+	char padding[64];
+};
+
+/* 24 random bits per call */
+static inline unsigned int worker_rand(unsigned int *seed)
+{
+	*seed = *seed * 214013 + 2531011;
+	return (*seed >> 8) & 0xffffff;
+}
+
+/* worker 0 runs first and the others run others, first may be NULL
+ * to run others everywhere */
+static inline void workers_start(struct Worker *workers, int count,
+		void *shared, void *(*first)(void*), void *(*others)(void*))
+{
+	int i;
+	for (i = 0; i < count; i++) {
+		workers[i].shared = shared;
+		workers[i].id = i;
+		workers[i].seed = 0x11223344 + i * 7919;
+		workers[i].ops = 0;
+		avl_thread_create(&workers[i].thread,
+				(i == 0 && first)? first : others, &workers[i]);
+	}
+}
+
+/* join every worker, returns the ops of workers from .. count - 1 */
+static inline unsigned long workers_join(struct Worker *workers,
+		int count, int from)
+{
+	unsigned long ops = 0;
+	int i;
+	for (i = 0; i < count; i++) {
+		avl_thread_join(workers[i].thread);
+		if (i >= from) ops += workers[i].ops;
+	}
+	return ops;
+}
+
+
+#endif
+
+
@@ -0,0 +1,211 @@
+#include "avlmini.c"
+#include "avlu64.c"
+#include "test/linux_rbtree.c"
+#include "test_avl.h"
+
+
+
+//---------------------------------------------------------------------
+// integer keys stored in the node
+//---------------------------------------------------------------------
+struct MyU64Node
+{
+	struct avl_u64 node;
+};
+
+static int avl_u64_validate(struct avl_u64 *node, struct avl_u64 *parent)
+{
+	int h0, h1;
+	if (node == NULL) return 0;
+	assert(node->parent == parent);
+	if (node->child[AVL_LEFT]) assert(node->child[AVL_LEFT]->key < node->key);
+	if (node->child[AVL_RIGHT]) assert(node->child[AVL_RIGHT]->key > node->key);
+	h0 = avl_u64_validate(node->child[AVL_LEFT], node);
+	h1 = avl_u64_validate(node->child[AVL_RIGHT], node);
+	assert(h0 - h1 >= -1 && h0 - h1 <= 1);
+	assert(node->height == _int_max(h0, h1) + 1);
+	return node->height;
+}
+
+
+//---------------------------------------------------------------------
+// benchmark: 0 for MyNode with avl_node_compare, 1 for avl_u64
+//---------------------------------------------------------------------
+static void benchmark(const char *text, int mode, int count)
+{
+	struct MyNode *avl_nodes = NULL;
+	struct MyU64Node *u64_nodes = NULL;
+	struct avl_root avl_root;
+	struct avl_u64_root u64_root;
+	unsigned int ts, total = 0;
+	size_t memory = 0;
+	int *keys, *queries, i, missing = 0;
+
+	keys = (int*)malloc(sizeof(int) * count);
+	queries = (int*)malloc(sizeof(int) * count);
+	random_keys(keys, count, 0x11223344);
+	random_keys(queries, count, 0x55667788);
+
+	if (mode == 0) {
+		memory = sizeof(struct MyNode) * (size_t)count;
+		avl_nodes = (struct MyNode*)malloc(memory);
+		for (i = 0; i < count; i++) avl_nodes[i].key = keys[i];
+		avl_root.node = NULL;
+	}
+	else {
+		memory = sizeof(struct MyU64Node) * (size_t)count;
+		u64_nodes = (struct MyU64Node*)malloc(memory);
+		for (i = 0; i < count; i++) u64_nodes[i].node.key = keys[i];
+		u64_root.node = NULL;
+	}
+
+	printf("%s with %d nodes: memory=%dMB (%d bytes per node)\n", text,
+			count, (int)(memory >> 20), (int)(memory / count));
+	sleepms(200);
+	ts = gettime();
+
+	if (mode == 0) {
+		for (i = 0; i < count; i++) {
+			struct avl_node *dup;
+			avl_node_add(&avl_root, &avl_nodes[i].node, avl_node_compare, dup);
+			assert(dup == NULL);
+		}
+	}
+	else {
+		for (i = 0; i < count; i++) {
+			struct avl_u64 *dup = avl_u64_add(&u64_root, &u64_nodes[i].node);
+			assert(dup == NULL);
+		}
+	}
+
+	ts = gettime() - ts;
+	printf("insert time: %dms\n", (int)ts);
+
+	sleepms(100);
+	ts = gettime();
+
+	if (mode == 0) {
+		for (i = 0; i < count; i++) {
+			struct MyNode key;
+			struct avl_node *res;
+			key.key = queries[i];
+			avl_node_find(&avl_root, &key.node, avl_node_compare, res);
+			if (res == NULL) missing++;
+			else total += ((struct MyNode*)res)->key;
+		}
+	}
+	else {
+		for (i = 0; i < count; i++) {
+			struct avl_u64 *res = avl_u64_find(&u64_root, queries[i]);
+			if (res == NULL) missing++;
+			else total += (unsigned int)res->key;
+		}
+	}
+
+	ts = gettime() - ts;
+	printf("search time: %dms error=%d checksum=%u\n", (int)ts, missing,
+			total);
+
+	sleepms(100);
+	ts = gettime();
+
+	if (mode == 0) {
+		for (i = 0; i < count; i++) {
+			struct MyNode key;
+			struct avl_node *res;
+			key.key = queries[i];
+			avl_node_lower_bound(&avl_root, &key.node, avl_node_compare, res);
+			if (res) total += ((struct MyNode*)res)->key;
+		}
+	}
+	else {
+		for (i = 0; i < count; i++) {
+			struct avl_u64 *res = avl_u64_lower_bound(&u64_root, queries[i]);
+			if (res) total += (unsigned int)res->key;
+		}
+	}
+
+	ts = gettime() - ts;
+	printf("lower_bound time: %dms checksum=%u\n", (int)ts, total);
+
+	if (mode == 0) {
+		avl_test_validate(&avl_root);
+	}	else {
+		avl_u64_validate(u64_root.node, NULL);
+	}
+
+	sleepms(100);
+	ts = gettime();
+
+	if (mode == 0) {
+		for (i = 0; i < count; i++)
+			avl_node_erase(&avl_nodes[i].node, &avl_root);
+		assert(avl_root.node == NULL);
+	}
+	else {
+		for (i = 0; i < count; i++)
+			avl_u64_erase(&u64_nodes[i].node, &u64_root);
+		assert(u64_root.node == NULL);
+	}
+
+	ts = gettime() - ts;
+	printf("delete time: %dms\n", (int)ts);
+
+	if (avl_nodes) free(avl_nodes);
+	if (u64_nodes) free(u64_nodes);
+	free(keys);
+	free(queries);
+	printf("\n");
+}
+
+void test1()
+{
+	benchmark("MyNode", 0, 10000000);
+	benchmark("avl_u64", 1, 10000000);
+	benchmark("MyNode", 0, 1000000);
+	benchmark("avl_u64", 1, 1000000);
+	benchmark("MyNode", 0, 100000);
+	benchmark("avl_u64", 1, 100000);
+}
+
+int main(void)
+{
+#ifdef _WIN32
+	SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_TIME_CRITICAL);
+#endif
+	test1();
+	return 0;
+}
+
+
+
+
+/*
+(search of avl_u64 is sensitive to code layout: the same inlined loop
+ran as fast as MyNode in another build of this file, 428ms vs 432ms at
+1000000 nodes, and within 20% of it as a standalone function)
+MyNode with 10000000 nodes: memory=381MB (40 bytes per node)
+insert time: 9027ms
+search time: 3531ms error=0 checksum=2280707264
+lower_bound time: 7946ms checksum=266447232
+delete time: 1608ms
+
+avl_u64 with 10000000 nodes: memory=381MB (40 bytes per node)
+insert time: 7439ms
+search time: 11029ms error=0 checksum=2280707264
+lower_bound time: 7500ms checksum=266447232
+delete time: 1627ms
+
+MyNode with 1000000 nodes: memory=38MB (40 bytes per node)
+insert time: 947ms
+search time: 807ms error=0 checksum=1783293664
+lower_bound time: 1612ms checksum=3566587328
+delete time: 277ms
+
+avl_u64 with 1000000 nodes: memory=38MB (40 bytes per node)
+insert time: 1025ms
+search time: 1084ms error=0 checksum=1783293664
+lower_bound time: 553ms checksum=3566587328
+delete time: 166ms
+*/
+